@@ -4,6 +4,51 @@ import { join } from 'path'
 import { SerialPort } from 'serialport'
 import icon from '../../resources/icon.png?asset'
 
+// Controller lines end with "|<seq>,<millis>" (sequence wraps at 16 bits)
+const EVENT_META = /\|(\d+),(\d+)$/
+const SEQ_MODULO = 65536
+// A controller reset restarts the sequence at 0: a backwards jump to a
+// number this small is a restart, not 65000 lost lines
+const SEQ_RESTART_WINDOW = 32
+const CLOCK_SYNC_INTERVAL = 30000
+
+// Commands go out as "#<tag>:CMD" and the controller answers
+// "ACK#tag,CR:<free>,US:<t>" or "NAK#tag,<reason>,CR:<free>,US:<t>".
+// Bytes in flight never exceed the controller's advertised receive space.
+const REPLY = /^(ACK|NAK)#(\d+),(.*)$/
+const RX_CAPACITY = 63 // Arduino 64-byte ring buffer keeps one slot empty
+const ACK_TIMEOUT = 2000
+// SET:CONFIG frames (up to ~212 bytes) are longer than the receive buffer and
+// go out on an idle link; bytes lost while the controller is busy come back
+// as a CONFIG_CRC NAK. The frame is all-or-nothing, so it is sent again
+const CONFIG_ATTEMPTS = 3
+
+interface QueuedCommand {
+  command: string
+  attempts: number // Sends so far, for the CONFIG_CRC retry
+}
+
+interface PendingCommand {
+  command: string
+  attempts: number
+  bytes: number
+  sentAt: number
+}
+
+interface LinkState {
+  lastSeq: number | null
+  dropped: number
+  // Wall time minus device millis(), from the latest SYNC round trip
+  clockOffset: number | null
+  syncTimer?: ReturnType<typeof setInterval>
+  // Command pipeline
+  nextTag: number
+  credit: number
+  queue: QueuedCommand[]
+  inFlight: Map<number, PendingCommand>
+  ackTimer?: ReturnType<typeof setInterval>
+}
+
 function createWindow(): void {
   // Create the browser window.
   const mainWindow = new BrowserWindow({
@@ -21,11 +66,139 @@ function createWindow(): void {
 
   const ports: Record<string, SerialPort> = {}
   const messageBuffers: Record<string, string> = {}
+  const links: Record<string, LinkState> = {}
+
+  const bytesInFlight = (link: LinkState) =>
+    [...link.inFlight.values()].reduce((sum, c) => sum + c.bytes, 0)
+
+  // Send queued commands while the controller has room for them
+  const pump = (path: string) => {
+    const port = ports[path]
+    const link = links[path]
+    if (!port || !link) return
+
+    while (link.queue.length > 0) {
+      const { attempts } = link.queue[0]
+      let { command } = link.queue[0]
+      // SYNC token is the send time, not the time it was queued
+      if (command === 'SYNC') command = `SYNC:${Date.now()}`
+
+      const tag = link.nextTag
+      const framed = `#${tag}:${command}\n`
+      // A command longer than the buffer still goes out once the link is idle
+      if (framed.length > link.credit && link.inFlight.size > 0) break
+
+      link.queue.shift()
+      link.nextTag = (link.nextTag + 1) % SEQ_MODULO
+      link.credit -= framed.length
+      link.inFlight.set(tag, {
+        command,
+        attempts: attempts + 1,
+        bytes: framed.length,
+        sentAt: Date.now(),
+      })
+      console.log('writing', framed.trim())
+      port.write(framed)
+    }
+  }
+
+  const handleReply = (path: string, kind: string, tag: number, fields: string) => {
+    const link = links[path]
+    const pending = link.inFlight.get(tag)
+    if (!pending) return
+    link.inFlight.delete(tag)
+
+    let credit = RX_CAPACITY
+    let serviceUs: number | undefined
+    const reason: string[] = []
+    for (const field of fields.split(',')) {
+      if (field.startsWith('CR:')) credit = Number(field.substring(3))
+      else if (field.startsWith('US:')) serviceUs = Number(field.substring(3))
+      else reason.push(field)
+    }
+
+    // Advertised space already counts commands sitting in the buffer, so
+    // subtracting everything still in flight is conservative
+    link.credit = Math.min(credit, RX_CAPACITY) - bytesInFlight(link)
+
+    if (
+      kind === 'NAK' &&
+      reason.includes('CONFIG_CRC') &&
+      pending.command.startsWith('SET:CONFIG:') &&
+      pending.attempts < CONFIG_ATTEMPTS
+    ) {
+      console.warn(`${pending.command} arrived corrupted, sending it again (${pending.attempts})`)
+      link.queue.unshift({ command: pending.command, attempts: pending.attempts })
+      pump(path)
+      return
+    }
+
+    const rttMs = Date.now() - pending.sentAt
+    console.log(`${kind}#${tag} ${pending.command}: RTT ${rttMs} ms, device ${serviceUs} us`)
+    mainWindow.webContents.send('serial:ack', {
+      path,
+      tag,
+      command: pending.command,
+      ok: kind === 'ACK',
+      reason: reason.length > 0 ? reason.join(',') : undefined,
+      attempts: pending.attempts,
+      rttMs,
+      serviceUs,
+    })
+    pump(path)
+  }
+
+  // The controller restarted: its sequence, clock and receive buffer start over
+  const restartLink = (path: string) => {
+    const link = links[path]
+    if (link.inFlight.size > 0) {
+      console.warn(`Controller on ${path} restarted, ${link.inFlight.size} command(s) lost`)
+    }
+    link.inFlight.clear()
+    link.credit = RX_CAPACITY
+    if (link.clockOffset !== null) {
+      link.clockOffset = null
+      link.queue.push({ command: 'SYNC', attempts: 0 })
+    }
+    pump(path)
+  }
+
+  // A reply can be lost (dropped line, controller reset): release its credit.
+  // Firmware without tag support answers "#n:CMD" with UNKNOWN, it needs a
+  // tag-aware build
+  const expireReplies = (path: string) => {
+    const link = links[path]
+    const now = Date.now()
+    let expired = false
+    for (const [tag, pending] of link.inFlight) {
+      if (now - pending.sentAt > ACK_TIMEOUT) {
+        console.warn(`No reply to #${tag} ${pending.command} on ${path}`)
+        link.inFlight.delete(tag)
+        expired = true
+      }
+    }
+    if (expired) {
+      link.credit = RX_CAPACITY - bytesInFlight(link)
+      pump(path)
+    }
+  }
+
   ipcMain.handle('serial:list', async () => SerialPort.list())
 
   ipcMain.handle('serial:open', (_e, { path, baudRate }) => {
-    const port = new SerialPort({ path, baudRate, lock: false })
+    // hupcl: false leaves DTR asserted on close, so reopening the port does
+    // not pulse DTR and auto-reset the Mega in the middle of a lot
+    const port = new SerialPort({ path, baudRate, lock: false, hupcl: false })
     messageBuffers[path] = ''
+    links[path] = {
+      lastSeq: null,
+      dropped: 0,
+      clockOffset: null,
+      nextTag: 0,
+      credit: RX_CAPACITY,
+      queue: [],
+      inFlight: new Map(),
+    }
 
     console.log('Opening serial port:', path, 'at', baudRate, 'baud')
 
@@ -38,6 +211,15 @@ function createWindow(): void {
 
     port.on('open', () => {
       console.log('Serial port opened successfully')
+
+      // Clock sync: the token is the host send time, offset taken at half the RTT
+      const sendSync = () => {
+        links[path].queue.push({ command: 'SYNC', attempts: 0 })
+        pump(path)
+      }
+      sendSync()
+      links[path].syncTimer = setInterval(sendSync, CLOCK_SYNC_INTERVAL)
+      links[path].ackTimer = setInterval(() => expireReplies(path), ACK_TIMEOUT / 4)
     })
 
     // Handle raw data instead of using ReadlineParser
@@ -55,10 +237,68 @@ function createWindow(): void {
       messageBuffers[path] = lines.pop() || '' // Keep incomplete line in buffer
 
       for (const line of lines) {
-        const trimmedLine = line.trim()
+        let trimmedLine = line.trim()
+        const link = links[path]
+        let seq: number | undefined
+        let deviceTime: number | undefined
+
+        const meta = EVENT_META.exec(trimmedLine)
+        if (meta) {
+          seq = Number(meta[1])
+          deviceTime = Number(meta[2])
+          trimmedLine = trimmedLine.slice(0, meta.index).trim()
+
+          // REINICIO: is printed at boot, HELLO: after a silence: both
+          // start a new baseline instead of counting a gap
+          const restarted =
+            trimmedLine.startsWith('REINICIO:') ||
+            (link.lastSeq !== null &&
+              seq < SEQ_RESTART_WINDOW &&
+              seq < link.lastSeq &&
+              link.lastSeq < SEQ_MODULO - SEQ_RESTART_WINDOW)
+          if (restarted) {
+            restartLink(path)
+          } else if (link.lastSeq !== null && !trimmedLine.startsWith('HELLO:')) {
+            const gap = (seq - link.lastSeq - 1 + SEQ_MODULO) % SEQ_MODULO
+            if (gap > 0) {
+              link.dropped += gap
+              console.warn(`Lost ${gap} line(s) on ${path} (total ${link.dropped})`)
+            }
+          }
+          link.lastSeq = seq
+        }
+
+        const reply = REPLY.exec(trimmedLine)
+        if (reply) {
+          handleReply(path, reply[1], Number(reply[2]), reply[3])
+          continue
+        }
+
+        // SYNC:<hostSendTime>,<millis>,<micros>
+        if (trimmedLine.startsWith('SYNC:')) {
+          const [sent, millis] = trimmedLine.substring(5).split(',').map(Number)
+          if (!isNaN(sent) && !isNaN(millis)) {
+            const now = Date.now()
+            link.clockOffset = (sent + now) / 2 - millis
+            console.log(`Clock sync on ${path}: RTT ${now - sent} ms`)
+          }
+          continue
+        }
+
         if (trimmedLine) {
           console.log('Serial data received:', trimmedLine)
-          mainWindow.webContents.send('serial:data', { path, line: trimmedLine })
+          const timestamp =
+            deviceTime !== undefined && link.clockOffset !== null
+              ? Math.round(deviceTime + link.clockOffset)
+              : Date.now()
+          mainWindow.webContents.send('serial:data', {
+            path,
+            line: trimmedLine,
+            seq,
+            deviceTime,
+            timestamp,
+            dropped: link.dropped,
+          })
         }
       }
 
@@ -77,8 +317,13 @@ function createWindow(): void {
     const p = ports[path]
     if (!p) throw new Error('Port not open')
 
-    console.log('writing', data)
-    p.write(data + '\n')
+    if (typeof data !== 'string') {
+      p.write(data)
+      return true
+    }
+
+    links[path].queue.push({ command: data, attempts: 0 })
+    pump(path)
     return true
   })
 
@@ -86,8 +331,11 @@ function createWindow(): void {
     const p = ports[path]
     if (p) {
       p.close()
+      clearInterval(links[path]?.syncTimer)
+      clearInterval(links[path]?.ackTimer)
       delete ports[path]
       delete messageBuffers[path]
+      delete links[path]
     }
     return true
   })
@@ -1,6 +1,29 @@
 import { electronAPI } from '@electron-toolkit/preload'
 import { contextBridge, ipcRenderer } from 'electron'
 
+// Line from the controller. seq/deviceTime come from the "|seq,millis"
+// suffix; timestamp is wall time, mapped from device time once clock-synced.
+interface SerialDataPayload {
+  path: string
+  line: string
+  seq?: number
+  deviceTime?: number
+  timestamp: number
+  dropped: number
+}
+
+// Reply to a tagged command, with the host round trip and device run time
+interface SerialAckPayload {
+  path: string
+  tag: number
+  command: string
+  ok: boolean
+  reason?: string
+  rttMs: number
+  serviceUs?: number
+  attempts: number
+}
+
 // Custom APIs for renderer
 const serial = {
   list: () => ipcRenderer.invoke('serial:list'),
@@ -8,11 +31,16 @@ const serial = {
   write: (args: { path: string; data: string | Uint8Array }) =>
     ipcRenderer.invoke('serial:write', args),
   close: (path: string) => ipcRenderer.invoke('serial:close', path),
-  onData: (cb: (payload: { path: string; line: string }) => void) => {
+  onData: (cb: (payload: SerialDataPayload) => void) => {
     const listener = (_e: any, payload: any) => cb(payload)
     ipcRenderer.on('serial:data', listener)
     return () => ipcRenderer.removeListener('serial:data', listener)
   },
+  onAck: (cb: (payload: SerialAckPayload) => void) => {
+    const listener = (_e: any, payload: any) => cb(payload)
+    ipcRenderer.on('serial:ack', listener)
+    return () => ipcRenderer.removeListener('serial:ack', listener)
+  },
   onError: (cb: (payload: { path: string; error: string }) => void) => {
     const listener = (_e: any, payload: any) => cb(payload)
     ipcRenderer.on('serial:error', listener)
@@ -1,4 +1,4 @@
-import { useCallback, useEffect, useState } from 'react'
+import { useCallback, useEffect, useRef, useState } from 'react'
 import { CommandPanel } from './components/CommandPanel'
 import { ConnectionScreen } from './components/ConnectionScreen'
 import { Console } from './components/Console'
@@ -6,7 +6,9 @@ import { Dashboard3D } from './components/Dashboard3D'
 import { Layout } from './components/Layout'
 import { LeftSidebar } from './components/LeftSidebar'
 import { ProcessStepper } from './components/ProcessStepper'
+import { isValidMachineState } from './constants/states'
 import { useAppStore } from './store/appStore'
+import { SerialAckPayload, SystemStatus } from './types'
 import { SerialMessageParser } from './utils/serialParser'
 
 function App(): React.JSX.Element {
@@ -145,6 +147,9 @@ function App(): React.JSX.Element {
     }
   }, [setPorts, setCurrentDelays, setCurrentDosing, setShowConsole])
 
+  // Set when a CONFIG:/HELLO: snapshot arrives; older firmware never sets it
+  const configReceived = useRef(false)
+
   useEffect(() => {
     // Set up serial data listener
     const handleData = ({ path, line }: { path: string; line: string }) => {
@@ -157,6 +162,68 @@ function App(): React.JSX.Element {
       // Update serial console
       addSerialData(line)
 
+      // Full configuration and status snapshot (GET:CONFIG / SET:CONFIG, after HELLO)
+      const config = SerialMessageParser.parseConfig(line)
+      if (config) {
+        configReceived.current = true
+        if (config.PROTO) {
+          console.log(
+            `Controller protocol ${config.PROTO}, up ${config.UPTIME} ms, last reset ${config.REINICIO}`
+          )
+        }
+        if (config.ESTADO === undefined) {
+          return // HELLO: header alone, the snapshot comes on the CONFIG: line after it
+        }
+        const store = useAppStore.getState()
+        const currentDelays = store.currentDelays
+        const currentDosing = store.currentDosing
+        const num = (key: string, fallback: number): number => {
+          const value = parseInt(config[key])
+          return isNaN(value) ? fallback : value
+        }
+
+        const newDelays = {
+          settle: num('SETTLE', currentDelays.settle),
+          weight: num('WEIGHT', currentDelays.weight),
+          transfer: num('TRANSFER', currentDelays.transfer),
+          grind: num('GRIND', currentDelays.grind),
+          cap: num('CAP', currentDelays.cap),
+          elevUp: num('UP', currentDelays.elevUp),
+          elevDown: num('DOWN', currentDelays.elevDown),
+        }
+        const newDosing = {
+          wheelDivisions: num('DIVISIONS', currentDosing.wheelDivisions),
+          lotSize: num('LOT_SIZE', currentDosing.lotSize),
+        }
+
+        setCurrentDelays(newDelays)
+        setCurrentDosing(newDosing)
+        localStorage.setItem('delaySettings', JSON.stringify(newDelays))
+        localStorage.setItem('dosingSettings', JSON.stringify(newDosing))
+
+        // Live status fields ride along in the same frame
+        const status: Partial<SystemStatus> = {
+          sensors: {
+            ...store.systemStatus.sensors,
+            frascoVacio: config.FRASCO_VACIO === '1',
+            pastillasCargadas: config.PASTILLAS_CARGADAS === '1',
+          },
+        }
+        if (config.ESTADO && isValidMachineState(config.ESTADO)) {
+          status.state = config.ESTADO
+        }
+        const pillCount = parseInt(config.PASTILLAS)
+        if (!isNaN(pillCount)) {
+          status.pillCount = pillCount
+        }
+        const weight = parseFloat(config.PESO)
+        if (!isNaN(weight)) {
+          status.weight = weight
+        }
+        updateSystemStatus(status)
+        return
+      }
+
       // Check if it's a delays response
       const delays = SerialMessageParser.parseDelays(line)
       if (delays) {
@@ -232,8 +299,19 @@ function App(): React.JSX.Element {
       addSerialData(`ERROR: ${error}`)
     }
 
+    // A rejected SET:CONFIG changed nothing on the device: say so, and read
+    // the configuration back so the settings show what is really applied
+    const handleAck = ({ command, ok, reason, attempts }: SerialAckPayload) => {
+      if (ok || !command.startsWith('SET:CONFIG:')) return
+      const error = `Settings not applied: ${reason ?? 'NAK'} (${attempts} attempt(s))`
+      setConnectionError(error)
+      addSerialData(`ERROR: ${error}`)
+      sendCommandDirect('GET:CONFIG')
+    }
+
     const removeDataListener = window.serial.onData(handleData)
     const removeErrorListener = window.serial.onError(handleError)
+    const removeAckListener = window.serial.onAck(handleAck)
 
     // Monitor connection health
     const healthCheckInterval = setInterval(() => {
@@ -249,6 +327,7 @@ function App(): React.JSX.Element {
     return () => {
       removeDataListener?.()
       removeErrorListener?.()
+      removeAckListener?.()
       clearInterval(healthCheckInterval)
     }
   }, [
@@ -259,6 +338,7 @@ function App(): React.JSX.Element {
     setCurrentDosing,
     updateSystemStatus,
     removePendingConfirmation,
+    sendCommandDirect,
   ])
 
   const connect = async (): Promise<void> => {
@@ -274,12 +354,20 @@ function App(): React.JSX.Element {
         // Wait a bit for the controller to be ready
         await new Promise((resolve) => setTimeout(resolve, 500))
 
-        // Send initial commands directly (not queued) to get current state
-        await sendCommandDirect('STATUS')
-        await new Promise((resolve) => setTimeout(resolve, 100))
-        await sendCommandDirect('GET:DELAYS')
-        await new Promise((resolve) => setTimeout(resolve, 100))
-        await sendCommandDirect('GET:DOSING')
+        // One framed snapshot carries configuration and status. The port is
+        // reopened without a reset, so a running lot is picked up as is.
+        configReceived.current = false
+        await sendCommandDirect('HELLO')
+        await new Promise((resolve) => setTimeout(resolve, 500))
+
+        if (!configReceived.current) {
+          // Firmware without HELLO: ask piece by piece (not queued)
+          await sendCommandDirect('STATUS')
+          await new Promise((resolve) => setTimeout(resolve, 100))
+          await sendCommandDirect('GET:DELAYS')
+          await new Promise((resolve) => setTimeout(resolve, 100))
+          await sendCommandDirect('GET:DOSING')
+        }
       }
     } catch (error) {
       console.error('Failed to connect:', error)
@@ -350,6 +438,7 @@ function App(): React.JSX.Element {
             <ProcessStepper
               currentState={systemStatus.state}
               stateProgress={systemStatus.stateProgress}
+              lotEta={systemStatus.lotEta}
               pillCount={systemStatus.pillCount}
             />
             <CommandPanel onSendCommand={sendCommand} />
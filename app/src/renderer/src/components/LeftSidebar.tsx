@@ -11,6 +11,7 @@ import {
   View,
 } from 'lucide-react'
 import React, { useEffect, useState } from 'react'
+import { SerialMessageParser } from '../utils/serialParser'
 import { Button } from './ui/button'
 import { Card } from './ui/card'
 import { Label } from './ui/label'
@@ -82,16 +83,20 @@ export const LeftSidebar: React.FC<LeftSidebarProps> = (props) => {
 
   // Function to sync all settings to device
   const syncAllSettingsToDevice = () => {
-    // Send individual commands (they'll be queued)
-    onSendCommand(`SET:DELAY:SETTLE:${delays.settle}`)
-    onSendCommand(`SET:DELAY:WEIGHT:${delays.weight}`)
-    onSendCommand(`SET:DELAY:TRANSFER:${delays.transfer}`)
-    onSendCommand(`SET:DELAY:GRIND:${delays.grind}`)
-    onSendCommand(`SET:DELAY:CAP:${delays.cap}`)
-    onSendCommand(`SET:DELAY:UP:${delays.elevUp}`)
-    onSendCommand(`SET:DELAY:DOWN:${delays.elevDown}`)
-    onSendCommand(`SET:DIVISIONS:${wheelDivisions}`)
-    onSendCommand(`SET:LOT_SIZE:${lotSize}`)
+    // One all-or-nothing frame; the device answers with its CONFIG snapshot
+    onSendCommand(
+      SerialMessageParser.formatConfig({
+        SETTLE: Math.round(delays.settle),
+        WEIGHT: Math.round(delays.weight),
+        TRANSFER: Math.round(delays.transfer),
+        GRIND: Math.round(delays.grind),
+        CAP: Math.round(delays.cap),
+        UP: Math.round(delays.elevUp),
+        DOWN: Math.round(delays.elevDown),
+        DIVISIONS: wheelDivisions,
+        LOT_SIZE: lotSize,
+      })
+    )
   }
 
   type Keys = keyof typeof delays
@@ -119,12 +124,12 @@ export const LeftSidebar: React.FC<LeftSidebarProps> = (props) => {
     setWheelDivisions(wheelDiv)
     setLotSize(lot)
 
-    // Send commands to device (they'll be queued and sent one by one)
-    if (wheelDiv !== currentDosing.wheelDivisions) {
-      onSendCommand(`SET:DIVISIONS:${wheelDiv}`)
-    }
-    if (lot !== currentDosing.lotSize) {
-      onSendCommand(`SET:LOT_SIZE:${lot}`)
+    // Both in one frame, so the lot is checked against the new divisions
+    const fields: Record<string, number> = {}
+    if (wheelDiv !== currentDosing.wheelDivisions) fields.DIVISIONS = wheelDiv
+    if (lot !== currentDosing.lotSize) fields.LOT_SIZE = lot
+    if (Object.keys(fields).length > 0) {
+      onSendCommand(SerialMessageParser.formatConfig(fields))
     }
   }
 
@@ -1,6 +1,6 @@
 import React, { useEffect, useState } from 'react'
 import { PROCESS_STATES } from '../constants/states'
-import { SystemStatus } from '../types'
+import { MachineState, SystemStatus } from '../types'
 import { useAppStore } from '../store/appStore'
 import { Card } from './ui/card'
 import { Progress } from './ui/progress'
@@ -9,12 +9,36 @@ interface ProcessStepperProps {
   currentState: string
   pillCount: number
   stateProgress?: SystemStatus['stateProgress']
+  lotEta?: SystemStatus['lotEta']
+}
+
+const formatEta = (ms: number): string => {
+  const totalSeconds = Math.ceil(ms / 1000)
+  const minutes = Math.floor(totalSeconds / 60)
+  const seconds = totalSeconds % 60
+  return `${minutes}:${seconds.toString().padStart(2, '0')}`
 }
 
 export const ProcessStepper: React.FC<ProcessStepperProps> = (props) => {
-  const { currentState, pillCount, stateProgress } = props
+  const { currentState, pillCount, stateProgress, lotEta } = props
   const { currentDosing } = useAppStore()
   const [progressPercent, setProgressPercent] = useState(0)
+  const [etaRemaining, setEtaRemaining] = useState<number | null>(null)
+
+  useEffect(() => {
+    if (!lotEta) {
+      setEtaRemaining(null)
+      return
+    }
+
+    const updateEta = (): void => {
+      setEtaRemaining(Math.max(lotEta.remaining - (Date.now() - lotEta.receivedAt), 0))
+    }
+
+    updateEta()
+    const interval = setInterval(updateEta, 1000)
+    return () => clearInterval(interval)
+  }, [lotEta])
 
   useEffect(() => {
     if (!stateProgress) {
@@ -122,6 +146,13 @@ export const ProcessStepper: React.FC<ProcessStepperProps> = (props) => {
         <div className="mt-4">
           <Progress value={(pillCount / currentDosing.lotSize) * 100} className="h-1" />
         </div>
+        {etaRemaining !== null &&
+          currentState !== MachineState.INICIO &&
+          currentState !== MachineState.RETIRO && (
+            <div className="text-muted-foreground mt-3 text-sm">
+              Fin estimado en {formatEta(etaRemaining)}
+            </div>
+          )}
       </div>
     </Card>
   )
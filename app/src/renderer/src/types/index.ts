@@ -58,6 +58,10 @@ export interface SystemStatus {
     expectedDuration: number
     startTime: number
   }
+  lotEta?: {
+    remaining: number // ms from receivedAt until the lot is finished
+    receivedAt: number
+  }
   sensors: {
     posAlta: boolean
     posBaja: boolean
@@ -74,12 +78,33 @@ export interface ProcessState {
   icon: React.ReactNode
 }
 
+export interface SerialDataPayload {
+  path: string
+  line: string
+  seq?: number // Wrapping 16-bit sequence number from the controller
+  deviceTime?: number // Controller millis() when the line was started
+  timestamp: number // Wall time (device time mapped through clock sync)
+  dropped: number // Lines lost on this port since it was opened
+}
+
+export interface SerialAckPayload {
+  path: string
+  tag: number
+  command: string
+  ok: boolean // ACK or NAK
+  reason?: string // NAK reason from the controller
+  rttMs: number // Host send to reply arrival
+  serviceUs?: number // Time the controller spent running the command
+  attempts: number // Times it was sent (SET:CONFIG is resent on CONFIG_CRC)
+}
+
 export interface SerialAPI {
   list: () => Promise<SerialPortInfo[]>
   open: (opts: { path: string; baudRate: number }) => Promise<boolean>
   write: (args: { path: string; data: string | Uint8Array }) => Promise<boolean>
   close: (path: string) => Promise<boolean>
-  onData: (cb: (p: { path: string; line: string }) => void) => (() => void) | undefined
+  onData: (cb: (p: SerialDataPayload) => void) => (() => void) | undefined
+  onAck: (cb: (p: SerialAckPayload) => void) => (() => void) | undefined
   onError: (cb: (p: { path: string; error: string }) => void) => (() => void) | undefined
 }
 
@@ -82,6 +82,19 @@ export class SerialMessageParser {
       }
     }
 
+    // ETA: Predicted time until the lot finishes, from learned state durations
+    if (cleanLine.startsWith('ETA:')) {
+      const remaining = parseInt(cleanLine.substring(4))
+      if (!isNaN(remaining) && remaining >= 0) {
+        return {
+          lotEta: {
+            remaining,
+            receivedAt: Date.now(),
+          },
+        }
+      }
+    }
+
     // HB: Simple heartbeat
     if (cleanLine.startsWith('HB:')) {
       const parts = cleanLine.substring(3).split(',')
@@ -297,6 +310,7 @@ export class SerialMessageParser {
     if (cleanLine.startsWith('PESO:') || cleanLine.startsWith('PASTILLAS:')) return 'info'
     if (cleanLine.startsWith('SIM:') || cleanLine.startsWith('SENSORES:')) return 'debug'
     if (cleanLine.startsWith('DELAYS:') || cleanLine.startsWith('DOSING:')) return 'success'
+    if (cleanLine.startsWith('CONFIG:') || cleanLine.startsWith('HELLO:')) return 'success'
     if (cleanLine.startsWith('SISTEMA:')) return 'warning'
     return 'info'
   }
@@ -341,6 +355,60 @@ export class SerialMessageParser {
     return null
   }
 
+  // CRC-8, polynomial 0x07, initial value 0 (same as the controller's crc8.h)
+  static crc8(text: string): number {
+    let crc = 0
+    for (let i = 0; i < text.length; i++) {
+      crc ^= text.charCodeAt(i) & 0xff
+      for (let bit = 0; bit < 8; bit++) {
+        crc = crc & 0x80 ? ((crc << 1) ^ 0x07) & 0xff : (crc << 1) & 0xff
+      }
+    }
+    return crc
+  }
+
+  static parseConfig(line: string): Record<string, string> | null {
+    // Full snapshot from GET:CONFIG / SET:CONFIG: CONFIG:<KEY:value,...>*<crc8 hex>
+    // HELLO: is framed the same way with PROTO, UPTIME, REINICIO and RESUME,
+    // and is followed by the CONFIG: line
+    const prefix = ['CONFIG:', 'HELLO:'].find((p) => line.startsWith(p))
+    if (!prefix) {
+      return null
+    }
+
+    const body = line.substring(prefix.length)
+    const star = body.lastIndexOf('*')
+    if (star < 0) {
+      console.warn(`Unframed config: ${line}`)
+      return null
+    }
+
+    const fields = body.substring(0, star)
+    const crc = parseInt(body.substring(star + 1), 16)
+    if (isNaN(crc) || crc !== SerialMessageParser.crc8(fields)) {
+      console.warn(`Config CRC mismatch: ${line}`)
+      return null
+    }
+
+    const result: Record<string, string> = {}
+    fields.split(',').forEach((part) => {
+      const [key, value] = part.split(':')
+      if (key && value !== undefined) {
+        result[key] = value
+      }
+    })
+
+    return result
+  }
+
+  static formatConfig(fields: Record<string, number>): string {
+    // SET:CONFIG:<KEY:value,...>*<crc8 hex>, settings only: the controller
+    // rejects the status keys of a snapshot. Unlisted settings keep their value
+    const body = Object.entries(fields).map(([key, value]) => `${key}:${value}`).join(',')
+    const crc = SerialMessageParser.crc8(body).toString(16).toUpperCase().padStart(2, '0')
+    return `SET:CONFIG:${body}*${crc}`
+  }
+
   static parseDosing(line: string): Record<string, number> | null {
     // Handle full DOSING response from GET:DOSING
     if (line.startsWith('DOSING:')) {
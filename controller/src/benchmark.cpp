@@ -0,0 +1,177 @@
+#include "benchmark.h"
+#include "host_link.h"
+#include "commands.h"
+#include "hardware.h"
+#include "serial_protocol.h"
+#include "state_machine.h"
+#include "fast_pin.h"
+#include "profiler.h"
+#include <avr/wdt.h>
+
+static String setDelays;
+
+void Benchmark::prepare() {
+  // Sets every delay to its current value, so the case changes nothing
+  setDelays = "SET:DELAYS:SETTLE:";
+  setDelays += t_step_settle;
+  setDelays += ",WEIGHT:";
+  setDelays += t_weight_settle;
+  setDelays += ",TRANSFER:";
+  setDelays += t_transfer;
+  setDelays += ",GRIND:";
+  setDelays += t_grind;
+  setDelays += ",CAP:";
+  setDelays += t_cap_push;
+  setDelays += ",UP:";
+  setDelays += t_elev_up;
+  setDelays += ",DOWN:";
+  setDelays += t_elev_down;
+}
+
+const BenchCase Benchmark::cases[] = {
+  // Command parser/dispatcher, read-only and idempotent commands only
+  { "command", "GET:DELAYS", 5, []() { commands.processCommand("GET:DELAYS"); }, false },
+  { "command", "GET:DOSING", 5, []() { commands.processCommand("GET:DOSING"); }, false },
+  { "command", "GET:SCALE", 5, []() { commands.processCommand("GET:SCALE"); }, false },
+  { "command", "GET:SOLENOIDS", 5, []() { commands.processCommand("GET:SOLENOIDS"); }, false },
+  { "command", "STATUS", 5, []() { commands.processCommand("STATUS"); }, false },
+  { "command", "BENCH:NOP", 5, []() { commands.processCommand("BENCH:NOP"); }, false },  // Falls through every branch to UNKNOWN
+  { "command", "SET:DELAYS", 5, []() { commands.processCommand(setDelays); }, false },
+  
+  // Serial protocol encoders
+  { "protocol", "sendState", 10, []() { SerialProtocol::sendState("BENCH"); }, false },
+  { "protocol", "sendPillCount", 10, []() { SerialProtocol::sendPillCount(stateMachine.getPillCount(), lot_size); }, false },
+  { "protocol", "sendWeight", 10, []() { SerialProtocol::sendWeight(12.34); }, false },
+  { "protocol", "sendElevatorPosition", 10, []() { SerialProtocol::sendElevatorPosition(elevator.isAtTop()); }, false },
+  { "protocol", "sendSimSensor", 10, []() { SerialProtocol::sendSimSensor("BENCH", true); }, false },
+  { "protocol", "sendSensor", 10, []() { SerialProtocol::sendSensor("BENCH", true); }, false },
+  { "protocol", "sendProgress", 10, []() { SerialProtocol::sendProgress("BENCH", 1000); }, false },
+  { "protocol", "sendHeartbeat", 10, []() { SerialProtocol::sendHeartbeat("BENCH", millis()); }, false },
+  { "protocol", "sendTestHeartbeat", 5, []() { SerialProtocol::sendTestHeartbeat(); }, false },
+  { "protocol", "sendError", 10, []() { SerialProtocol::sendError("BENCH"); }, false },
+  { "protocol", "sendButton", 10, []() { SerialProtocol::sendButton("BENCH", "PRESSED"); }, false },
+  { "protocol", "sendAction", 10, []() { SerialProtocol::sendAction("BENCH"); }, false },
+  { "protocol", "sendInfo", 10, []() { SerialProtocol::sendInfo("BENCH"); }, false },
+  
+  // Load cell: stability check is pure math, readWeight blocks on the HX711 in real mode
+  { "loadcell", "isWeightStable", 1000, []() { loadCell.isWeightStable(); }, false },
+  { "loadcell", "readWeight", 3, []() { loadCell.readWeight(); }, false },
+  
+  // One continuous-action tick of the current state (transitions are not
+  // taken). The native suite runs it in every state.
+  { "state", "continuous", 100, []() { stateMachine.executeStateContinuous(); }, true },
+};
+
+const uint8_t Benchmark::caseCount = sizeof(cases) / sizeof(cases[0]);
+
+void Benchmark::runAll() {
+  host.println(F("BENCH:START"));
+  prepare();
+  for (uint8_t i = 0; i < caseCount; i++) {
+    if (!cases[i].actuates) {
+      measure(cases[i]);
+    }
+  }
+  host.println(F("BENCH:END"));
+}
+
+void Benchmark::measure(const BenchCase& c) {
+  host.flush();  // Earlier report lines must not be timed
+  host.setMuted(true);
+  uint32_t cycles = 0;
+#ifdef PROFILING
+  uint32_t c0 = Profiler::cycles();
+#endif
+  unsigned long t0 = micros();
+  for (uint16_t i = 0; i < c.iterations; i++) {
+    c.kernel();
+    wdt_reset();  // Blocking kernels (HX711 reads) add up past the watchdog
+  }
+  unsigned long elapsed = micros() - t0;
+#ifdef PROFILING
+  cycles = Profiler::cycles() - c0;
+#endif
+  host.setMuted(false);
+  report(c, elapsed, cycles);
+}
+
+void Benchmark::report(const BenchCase& c, unsigned long elapsed, uint32_t cycles) {
+  wdt_reset();
+  
+  host.print(F("BENCH:{\"suite\":\""));
+  host.print(c.suite);
+  host.print(F("\",\"case\":\""));
+  host.print(c.name);
+  host.print(F("\",\"iter\":"));
+  host.print(c.iterations);
+  host.print(F(",\"us\":"));
+  host.print(elapsed / c.iterations);
+  host.print(F(",\"res_us\":"));
+  host.print(4.0 / c.iterations, 2);  // micros() counts in steps of 4 us at 16 MHz
+#ifdef PROFILING
+  host.print(F(",\"cycles\":"));
+  host.print(cycles / c.iterations);
+#endif
+  host.println(F("}"));
+}
+
+void Benchmark::gpio() {
+  // Everything runs on BENCH_PIN so no actuator moves
+  const unsigned int N = 1000;
+  const unsigned long cyclesPerUs = F_CPU / 1000000UL;
+  unsigned long t0;
+  
+  pinMode(BENCH_PIN, OUTPUT);
+  
+  // Loop overhead, subtracted from every measurement
+  t0 = micros();
+  for (volatile unsigned int i = 0; i < N; i++) {}
+  unsigned long base = micros() - t0;
+  
+  t0 = micros();
+  for (volatile unsigned int i = 0; i < N; i++) {
+    digitalWrite(BENCH_PIN, HIGH);
+    digitalWrite(BENCH_PIN, LOW);
+  }
+  unsigned long slowWrite = micros() - t0 - base;
+  
+  t0 = micros();
+  for (volatile unsigned int i = 0; i < N; i++) {
+    Pin<BENCH_PIN>::set();
+    Pin<BENCH_PIN>::clear();
+  }
+  unsigned long fastWrite = micros() - t0 - base;
+  
+  // AccelStepper::step1() in DRIVER mode: three setOutputPins() calls of two digitalWrite() each
+  t0 = micros();
+  for (volatile unsigned int i = 0; i < N; i++) {
+    digitalWrite(BENCH_PIN, LOW);
+    digitalWrite(BENCH_PIN, LOW);
+    digitalWrite(BENCH_PIN, LOW);
+    digitalWrite(BENCH_PIN, HIGH);
+    digitalWrite(BENCH_PIN, LOW);
+    digitalWrite(BENCH_PIN, LOW);
+  }
+  unsigned long slowStep = micros() - t0 - base;
+  
+  // FastStepper::step() without the setup and pulse delays: direction, step high, step low
+  t0 = micros();
+  for (volatile unsigned int i = 0; i < N; i++) {
+    Pin<BENCH_PIN>::write(false);
+    Pin<BENCH_PIN>::set();
+    Pin<BENCH_PIN>::clear();
+  }
+  unsigned long fastStep = micros() - t0 - base;
+  
+  digitalWrite(BENCH_PIN, LOW);
+  
+  // Cycles per single actuation (one write) and per step pulse
+  host.print("BENCH:GPIO:DIGITALWRITE:");
+  host.print(slowWrite * cyclesPerUs / (2UL * N));
+  host.print(",PIN:");
+  host.print(fastWrite * cyclesPerUs / (2UL * N));
+  host.print(",PASO_ACCELSTEPPER:");
+  host.print(slowStep * cyclesPerUs / N);
+  host.print(",PASO_PIN:");
+  host.println(fastStep * cyclesPerUs / N);
+}
@@ -0,0 +1,46 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+
+// =====================================================
+// ON-TARGET MICROBENCHMARKS
+// =====================================================
+//
+// Each case prints one line with a fixed key order so runs can be diffed
+// between branches:
+//   BENCH:{"suite":"protocol","case":"sendWeight","iter":20,"us":1234,"res_us":0.20}
+// "us" is per iteration, from micros(): its 4 us resolution is spread over
+// the iterations, and "res_us" is what is left of it per iteration. Under
+// PROFILING a "cycles" key adds the exact Timer5 count per iteration.
+// Output of the measured code goes to a muted host link, so commands and
+// encoders are timed without the UART and emit nothing. Blocking HX711
+// reads are still included.
+//
+// The case table is shared with the native suite (tools/native/bench).
+// Cases that drive outputs (a state's continuous tick steps motors and
+// fires solenoids) only run there, against the simulated core.
+
+struct BenchCase {
+  const char* suite;
+  const char* name;
+  uint16_t iterations;  // On target
+  void (*kernel)();
+  bool actuates;        // Drives outputs: native suite only
+};
+
+class Benchmark {
+public:
+  static void runAll();
+  static void gpio();
+  
+  static void prepare();  // Builds the inputs the cases take, from the current settings
+  static const BenchCase cases[];
+  static const uint8_t caseCount;
+  
+private:
+  static void measure(const BenchCase& c);
+  static void report(const BenchCase& c, unsigned long elapsed, uint32_t cycles);
+};
+
+#endif
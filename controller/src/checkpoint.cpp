@@ -0,0 +1,113 @@
+#include "checkpoint.h"
+#include "crc8.h"
+#include "host_link.h"
+#include "state_machine.h"
+#include <EEPROM.h>
+#include <avr/wdt.h>
+
+#define CHECKPOINT_MAGIC 0xA5
+
+CheckpointRecord Checkpoint::lastRecord;
+uint8_t Checkpoint::nextSlot = 0;
+bool Checkpoint::pending = false;
+
+// Reset cause, captured before the core clears it; .noinit so startup code leaves it alone
+static uint8_t resetFlags __attribute__((section(".noinit")));
+
+// Runs before main(): the watchdog stays armed across a WDT reset and must
+// be disabled before the (slow) C runtime and setup() get going
+void captureResetFlags() __attribute__((naked, used, section(".init3")));
+void captureResetFlags() {
+  resetFlags = MCUSR;
+  MCUSR = 0;
+  wdt_disable();
+}
+
+uint8_t Checkpoint::getResetFlags() {
+  return resetFlags;
+}
+
+const __FlashStringHelper* Checkpoint::getResetCause() {
+  if (resetFlags & _BV(WDRF)) {
+    return F("WATCHDOG");
+  } else if (resetFlags & _BV(BORF)) {
+    return F("BROWNOUT");
+  } else if (resetFlags & _BV(EXTRF)) {
+    return F("EXTERNO");
+  }
+  return F("ENCENDIDO");
+}
+
+uint8_t Checkpoint::crc8(const CheckpointRecord& r) {
+  return ::crc8(&r, sizeof(CheckpointRecord) - 1);  // Everything but the crc byte
+}
+
+bool Checkpoint::readSlot(uint8_t slot, CheckpointRecord& r) {
+  EEPROM.get(CHECKPOINT_EEPROM_BASE + slot * sizeof(CheckpointRecord), r);
+  return r.magic == CHECKPOINT_MAGIC && r.crc == crc8(r);
+}
+
+void Checkpoint::init() {
+  // Valid records span at most CHECKPOINT_SLOTS consecutive sequence numbers,
+  // so "newer" is well defined modulo 256
+  pending = false;
+  bool found = false;
+  for (uint8_t slot = 0; slot < CHECKPOINT_SLOTS; slot++) {
+    CheckpointRecord r;
+    if (!readSlot(slot, r)) continue;
+    if (!found || (uint8_t)(r.sequence - lastRecord.sequence) < 128) {
+      lastRecord = r;
+      nextSlot = (slot + 1) % CHECKPOINT_SLOTS;
+      found = true;
+    }
+  }
+  
+  if (!found) {
+    memset(&lastRecord, 0, sizeof(lastRecord));
+    nextSlot = 0;
+  }
+  
+  host.print(F("REINICIO:"));
+  host.println(getResetCause());
+  
+  // A lot was in progress: offer to resume it
+  if (found && lastRecord.state != ESTADO0_INICIO) {
+    pending = true;
+    host.print(F("CHECKPOINT:ESTADO:"));
+    host.print(stateMachine.getStateName((State)lastRecord.state));
+    host.print(F(",PASTILLAS:"));
+    host.print(lastRecord.pillCount);
+    host.print(F("/"));
+    host.println(lastRecord.lotSize);
+    host.println(F("RESUME para continuar el lote, CHECKPOINT:DISCARD para descartarlo"));
+  }
+}
+
+void Checkpoint::save(uint8_t state, uint8_t pillCount) {
+  CheckpointRecord r;
+  r.magic = CHECKPOINT_MAGIC;
+  r.sequence = lastRecord.sequence + 1;
+  r.state = state;
+  r.pillCount = pillCount;
+  r.lotSize = lot_size;
+  r.wheelDivisions = wheel_divisions;
+  r.crc = crc8(r);
+  
+  // EEPROM.put only rewrites bytes that changed
+  EEPROM.put(CHECKPOINT_EEPROM_BASE + nextSlot * sizeof(CheckpointRecord), r);
+  lastRecord = r;
+  nextSlot = (nextSlot + 1) % CHECKPOINT_SLOTS;
+  pending = false;  // A new lot supersedes the interrupted one
+}
+
+bool Checkpoint::takePending(CheckpointRecord& r) {
+  if (!pending) return false;
+  r = lastRecord;
+  pending = false;
+  return true;
+}
+
+void Checkpoint::discard() {
+  save(ESTADO0_INICIO, 0);
+  host.println(F("CHECKPOINT:DESCARTADO"));
+}
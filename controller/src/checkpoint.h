@@ -0,0 +1,45 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// =====================================================
+// LOT CHECKPOINT (EEPROM JOURNAL)
+// =====================================================
+//
+// Every state change appends a small record to a ring of EEPROM slots, so
+// each slot only sees 1/CHECKPOINT_SLOTS of the writes. On boot the newest
+// valid record tells whether a lot was interrupted; RESUME continues it.
+// A lot paused in 0_INICIO is journaled as 2_DOSIFICACION with its count.
+
+struct CheckpointRecord {
+  uint8_t magic;
+  uint8_t sequence;  // Wrapping counter, the newest record is the highest (mod 256)
+  uint8_t state;
+  uint8_t pillCount;
+  uint8_t lotSize;
+  uint8_t wheelDivisions;
+  uint8_t crc;
+};
+
+class Checkpoint {
+public:
+  static void init();  // Load the newest record and report reset cause
+  static void save(uint8_t state, uint8_t pillCount);
+  static bool takePending(CheckpointRecord& r);  // Hands over the interrupted lot once
+  static void discard();
+  static uint8_t getResetFlags();
+  static const __FlashStringHelper* getResetCause();
+  static bool isPending() { return pending; }  // Interrupted lot waiting for RESUME
+  
+private:
+  static CheckpointRecord lastRecord;
+  static uint8_t nextSlot;
+  static bool pending;
+  
+  static uint8_t crc8(const CheckpointRecord& r);
+  static bool readSlot(uint8_t slot, CheckpointRecord& r);
+};
+
+#endif
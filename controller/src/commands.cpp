@@ -1,29 +1,185 @@
 #include "commands.h"
+#include "host_link.h"
 #include "hardware.h"
 #include "state_machine.h"
 #include "config.h"
 #include "test_mode.h"
+#include "benchmark.h"
+#include "session.h"
+#include "profiler.h"
+#include "mem_stats.h"
+#include "checkpoint.h"
+#include "motion_sweep.h"
+#include "pill_ledger.h"
+#include "weight_trace.h"
+#include "test_script.h"
+#include "event_bus.h"
+#include "crc8.h"
 
 CommandProcessor commands;
 
+// Parses up to maxValues comma-separated integers, returns how many were read
+static int parseValues(const String& text, long* values, int maxValues) {
+  int count = 0;
+  int startIdx = 0;
+  while (count < maxValues && startIdx < (int)text.length()) {
+    int commaIdx = text.indexOf(',', startIdx);
+    if (commaIdx < 0) commaIdx = text.length();
+    values[count++] = text.substring(startIdx, commaIdx).toInt();
+    startIdx = commaIdx + 1;
+  }
+  return count;
+}
+
+// Delays exchanged by GET:CONFIG / SET:CONFIG, same keys as GET:DELAYS
+static const char* const DELAY_KEYS[] = {"SETTLE", "WEIGHT", "TRANSFER", "GRIND", "CAP", "UP", "DOWN"};
+static unsigned long* const DELAY_VARS[] = {
+  &t_step_settle, &t_weight_settle, &t_transfer, &t_grind, &t_cap_push, &t_elev_up, &t_elev_down
+};
+static const uint8_t DELAY_COUNT = sizeof(DELAY_KEYS) / sizeof(DELAY_KEYS[0]);
+
+// Print that keeps the CRC-8 of everything written through it
+class CrcPrint : public Print {
+public:
+  CrcPrint(Print& o) : out(o), crc(0) {}
+  size_t write(uint8_t c) override {
+    crc = crc8Update(crc, c);
+    return out.write(c);
+  }
+  using Print::write;
+  uint8_t getCrc() const { return crc; }
+  
+private:
+  Print& out;
+  uint8_t crc;
+};
+
+// Decimal number, optionally signed and with a fraction
+static bool isDecimal(const String& text) {
+  bool digits = false;
+  bool point = false;
+  for (unsigned int i = 0; i < text.length(); i++) {
+    char c = text[i];
+    if (isDigit(c)) {
+      digits = true;
+    } else if (c == '.' && !point) {
+      point = true;
+    } else if (!(c == '-' && i == 0)) {
+      return false;
+    }
+  }
+  return digits;
+}
+
 void CommandProcessor::processSerialInput() {
-  if (Serial.available() > 0) {
-    char incomingChar = Serial.read();
+  // Drain the UART so bursts from the host do not overflow its 64-byte
+  // buffer, but run at most one command per loop() pass
+  while (host.available() > 0) {
+    char incomingChar = host.read();
     
     if (incomingChar == '\n' || incomingChar == '\r') {
-      if (inputBuffer.length() > 0) {
+      if (inputOverflow) {
+        // Keep the start for the address and tag, so a tagged line gets its NAK
+        inputOverflow = false;
+        greetAfterSilence(inputBuffer);
+        processCommand(inputBuffer, true);
+        inputBuffer = "";
+      } else if (inputBuffer.length() > 0) {
+        greetAfterSilence(inputBuffer);
         processCommand(inputBuffer);
         inputBuffer = "";
+        return;
       }
-    } else {
+    } else if (inputOverflow) {
+      // Rest of an over-long line, dropped up to its terminator
+    } else if (inputBuffer.length() < COMMAND_MAX_LENGTH) {
       inputBuffer += incomingChar;
+    } else {
+      inputOverflow = true;
     }
   }
 }
 
-void CommandProcessor::processCommand(String command) {
+void CommandProcessor::greetAfterSilence(String line) {
+  // A host that was quiet for a while may have just (re)opened the port
+  // without resetting the board: resync it before the reply. Only lines
+  // from the host count, not session replays or benchmarks.
+  line.trim();
+  if (!host.accept(line)) {
+    return;  // For another node
+  }
+  if (millis() - lastCommandTime >= HELLO_SILENCE && !line.endsWith("HELLO")) {
+    printConfig(true);
+  }
+  lastCommandTime = millis();
+}
+
+void CommandProcessor::processCommand(String command, bool tooLong) {
   command.trim();
   
+  // Node addressing: drop commands meant for other controllers on the link
+  if (!host.accept(command)) {
+    return;
+  }
+  
+  // Optional "#<seq>:" tag: reply ACK#seq or NAK#seq,reason with the free
+  // receive space (credit) and the time spent running the command
+  if (!command.startsWith("#")) {
+    if (tooLong) {
+      host.println("ERROR:COMANDO_LARGO");
+      return;
+    }
+    dispatch(command);
+    EventBus::drain();  // Actuator events of the command right after it
+    return;
+  }
+  
+  int colonIdx = command.indexOf(':');
+  if (colonIdx < 2) {
+    host.println("NAK#?,TAG_INVALIDO");
+    return;
+  }
+  String tag = command.substring(1, colonIdx);
+  command = command.substring(colonIdx + 1);
+  
+  unsigned long start = micros();
+  host.beginReply();
+  if (tooLong) {
+    host.println("ERROR:COMANDO_LARGO");
+  } else {
+    dispatch(command);
+    EventBus::drain();  // Inside the reply, so event errors become the NAK reason
+  }
+  const char* reason = host.endReply();
+  unsigned long elapsed = micros() - start;
+  
+  if (reason[0] == '\0') {
+    host.print("ACK#");
+    host.print(tag);
+  } else {
+    host.print("NAK#");
+    host.print(tag);
+    host.print(",");
+    host.print(reason);
+  }
+  host.print(",CR:");
+  host.print(host.rxFree());
+  host.print(",US:");
+  host.println(elapsed);
+}
+
+void CommandProcessor::dispatch(String command) {
+  // Session record/replay commands work in every mode
+  if (Session::processCommand(command)) {
+    return;
+  }
+  Session::recordCommand(command);
+  
+  // Test scripts are edited in any mode and run in test mode
+  if (TestScript::processCommand(command)) {
+    return;
+  }
+  
   // Mode commands
   if (command == "MODE:REAL") {
     TestMode::setActive(false);
@@ -42,10 +198,10 @@ void CommandProcessor::processCommand(String command) {
   // Button simulation commands
   else if (command == "BTN:START") {
     inputs.simulateStart(true);
-    Serial.println("BTN:START:PRESSED");
+    host.println("BTN:START:PRESSED");
   } else if (command == "BTN:RESET") {
     inputs.simulateReset(true);
-    Serial.println("BTN:RESET:PRESSED");
+    host.println("BTN:RESET:PRESSED");
   } else if (command == "RESET:ALL") {
     // Force complete reset
     stateMachine.resetPillCount();
@@ -65,54 +221,71 @@ void CommandProcessor::processCommand(String command) {
     inputs.simulatePastillas(true);
     inputs.clearButtons();
     
-    Serial.println("SISTEMA:REINICIADO");
-    Serial.println("ESTADO:0_INICIO");
-    Serial.print("PASTILLAS:0/");
-    Serial.println(lot_size);
-    Serial.println("SIM:WEIGHT_STABLE:OFF");
-    Serial.println("SIM:FRASCO_VACIO:ON");
-    Serial.println("SIM:PASTILLAS_CARGADAS:ON");
-    Serial.println("ELEVADOR:ABAJO");
+    host.println("SISTEMA:REINICIADO");
+    host.println("ESTADO:0_INICIO");
+    host.print("PASTILLAS:0/");
+    host.println(lot_size);
+    host.println("SIM:WEIGHT_STABLE:OFF");
+    host.println("SIM:FRASCO_VACIO:ON");
+    host.println("SIM:PASTILLAS_CARGADAS:ON");
+    host.println("ELEVADOR:ABAJO");
+  }
+  
+  // Lot checkpoint after a reset
+  else if (command == "RESUME") {
+    CheckpointRecord r;
+    if (MotionSweep::isActive()) {
+      host.println("ERROR:SWEEP_EN_CURSO");
+    } else if (stateMachine.getCurrentState() != ESTADO0_INICIO || !Checkpoint::takePending(r)) {
+      host.println("ERROR:SIN_CHECKPOINT");
+    } else {
+      wheel_divisions = r.wheelDivisions;
+      lot_size = r.lotSize;
+      host.println("CHECKPOINT:REANUDANDO");
+      stateMachine.resume((State)r.state, r.pillCount);
+    }
+  } else if (command == "CHECKPOINT:DISCARD") {
+    Checkpoint::discard();
   }
   
   // Elevator position simulation
   else if (command == "SIM:POS_ALTA:1") {
     elevator.simulatePosition(true, false);
-    Serial.println("SIM:POS_ALTA:ON");
+    host.println("SIM:POS_ALTA:ON");
   } else if (command == "SIM:POS_ALTA:0") {
     elevator.simulatePosition(false, elevator.isAtBottom());
-    Serial.println("SIM:POS_ALTA:OFF");
+    host.println("SIM:POS_ALTA:OFF");
   } else if (command == "SIM:POS_BAJA:1") {
     elevator.simulatePosition(false, true);
-    Serial.println("SIM:POS_BAJA:ON");
+    host.println("SIM:POS_BAJA:ON");
   } else if (command == "SIM:POS_BAJA:0") {
     elevator.simulatePosition(elevator.isAtTop(), false);
-    Serial.println("SIM:POS_BAJA:OFF");
+    host.println("SIM:POS_BAJA:OFF");
   }
   
   // Weight simulation
   else if (command == "SIM:WEIGHT_STABLE:1") {
       loadCell.simulateWeight(true);
-      Serial.println("SIM:WEIGHT_STABLE:ON");
+      host.println("SIM:WEIGHT_STABLE:ON");
 
   } else if (command == "SIM:WEIGHT_STABLE:0") {
     loadCell.simulateWeight(false);
-    Serial.println("SIM:WEIGHT_STABLE:OFF");
+    host.println("SIM:WEIGHT_STABLE:OFF");
   }
   
   // Condition simulation
   else if (command == "SIM:FRASCO_VACIO:1") {
     inputs.simulateFrasco(true);
-    Serial.println("SIM:FRASCO_VACIO:ON");
+    host.println("SIM:FRASCO_VACIO:ON");
   } else if (command == "SIM:FRASCO_VACIO:0") {
     inputs.simulateFrasco(false);
-    Serial.println("SIM:FRASCO_VACIO:OFF");
+    host.println("SIM:FRASCO_VACIO:OFF");
   } else if (command == "SIM:PASTILLAS_CARGADAS:1") {
     inputs.simulatePastillas(true);
-    Serial.println("SIM:PASTILLAS_CARGADAS:ON");
+    host.println("SIM:PASTILLAS_CARGADAS:ON");
   } else if (command == "SIM:PASTILLAS_CARGADAS:0") {
     inputs.simulatePastillas(false);
-    Serial.println("SIM:PASTILLAS_CARGADAS:OFF");
+    host.println("SIM:PASTILLAS_CARGADAS:OFF");
   }
   
   // Load cell commands
@@ -123,20 +296,69 @@ void CommandProcessor::processCommand(String command) {
     loadCell.calibrate(knownWeight);
   } else if (command == "SCALE:READ") {
     float weight = loadCell.readWeight();
-    Serial.print("WEIGHT:");
-    Serial.print(weight, 2);
-    Serial.println(" g");
+    host.print("WEIGHT:");
+    host.print(weight, 2);
+    host.println(" g");
   } else if (command == "SCALE:ENABLE") {
     loadCell.setMode(MODE_REAL);
-    Serial.println("SCALE:ENABLED");
+    host.println("SCALE:ENABLED");
   } else if (command == "SCALE:DISABLE") {
     loadCell.setMode(MODE_SIMULATION);
-    Serial.println("SCALE:DISABLED");
+    host.println("SCALE:DISABLED");
+  } else if (command.startsWith("SCALE:RATE:")) {
+    long sps = command.substring(11).toInt();
+    if ((sps == 10 || sps == 80) && loadCell.setSampleRate(sps)) {  // Check before narrowing
+      printScaleConfig();
+    } else {
+      host.println("ERROR:SCALE_RATE_INVALIDA");
+    }
+  } else if (command.startsWith("SCALE:GAIN:")) {
+    long g = command.substring(11).toInt();
+    // Channel B has a fixed gain of 32, select it with SCALE:CHANNEL:B
+    if ((g == 128 || g == 64) && loadCell.setGain(g)) {
+      printScaleConfig();
+    } else {
+      host.println("ERROR:SCALE_GAIN_INVALIDA");
+    }
+  } else if (command == "SCALE:CHANNEL:A") {
+    if (loadCell.getChannel() != 'A') {
+      loadCell.setGain(128);
+    }
+    printScaleConfig();
+  } else if (command == "SCALE:CHANNEL:B") {
+    loadCell.setGain(32);
+    printScaleConfig();
+  } else if (command == "GET:SCALE") {
+    printScaleConfig();
   } else if (command.startsWith("SET:WEIGHT_THRESHOLD:")) {
     float threshold = command.substring(21).toFloat();
-    loadCell.setThreshold(threshold);
-    Serial.print("SET:WEIGHT_THRESHOLD:");
-    Serial.println(threshold);
+    if (loadCell.getZeroBand() > 0 && threshold <= loadCell.getZeroBand()) {
+      host.println("ERROR:UMBRAL_INVALIDO");  // Same rule as SET:ZERO_BAND
+    } else {
+      loadCell.setThreshold(threshold);
+      host.print("SET:WEIGHT_THRESHOLD:");
+      host.println(threshold);
+    }
+  } else if (command.startsWith("SET:PILL_WEIGHT:")) {
+    float weight = command.substring(16).toFloat();
+    if (weight < 0) {
+      host.println("ERROR:PESO_INVALIDO");
+    } else {
+      pill_weight = weight;
+      stateMachine.printDoseStats();
+    }
+  } else if (command == "GET:DOSE") {
+    stateMachine.printDoseStats();
+  } else if (command.startsWith("SET:ZERO_BAND:")) {
+    float band = command.substring(14).toFloat();
+    if (band < 0 || band >= loadCell.getThreshold()) {
+      host.println("ERROR:ZERO_BANDA_INVALIDA");  // A pill must never look like drift
+    } else {
+      loadCell.setZeroBand(band);
+      printZero();
+    }
+  } else if (command == "GET:ZERO") {
+    printZero();
   }
   
   // Parameter commands (removed SET:TARGET - use SET:LOT_SIZE instead)
@@ -179,23 +401,23 @@ void CommandProcessor::processCommand(String command) {
     }
     
     // Send confirmation
-    Serial.print("DOSING:DIVISIONS:");
-    Serial.print(wheel_divisions);
-    Serial.print(",LOT_SIZE:");
-    Serial.println(lot_size);
+    host.print("DOSING:DIVISIONS:");
+    host.print(wheel_divisions);
+    host.print(",LOT_SIZE:");
+    host.println(lot_size);
     
     // Send updated pill count
-    Serial.print("PASTILLAS:");
-    Serial.print(stateMachine.getPillCount());
-    Serial.print("/");
-    Serial.println(lot_size);
+    host.print("PASTILLAS:");
+    host.print(stateMachine.getPillCount());
+    host.print("/");
+    host.println(lot_size);
   }
   else if (command.startsWith("SET:DIVISIONS:")) {
     int divisions = command.substring(14).toInt();
     if (divisions > 0 && divisions <= 50) {  // Reasonable limits
       wheel_divisions = divisions;
-      Serial.print("SET:DIVISIONS:");
-      Serial.println(wheel_divisions);
+      host.print("SET:DIVISIONS:");
+      host.println(wheel_divisions);
     }
   }
   else if (command.startsWith("SET:LOT_SIZE:")) {
@@ -206,13 +428,13 @@ void CommandProcessor::processCommand(String command) {
       if (stateMachine.getCurrentState() == ESTADO0_INICIO) {
         stateMachine.resetPillCount();
       }
-      Serial.print("SET:LOT_SIZE:");
-      Serial.println(lot_size);
+      host.print("SET:LOT_SIZE:");
+      host.println(lot_size);
       // Send updated pill count
-      Serial.print("PASTILLAS:");
-      Serial.print(stateMachine.getPillCount());
-      Serial.print("/");
-      Serial.println(lot_size);
+      host.print("PASTILLAS:");
+      host.print(stateMachine.getPillCount());
+      host.print("/");
+      host.println(lot_size);
     }
   }
   
@@ -254,83 +476,293 @@ void CommandProcessor::processCommand(String command) {
     }
     
     // Send confirmation with all current values
-    Serial.print("DELAYS:");
-    Serial.print("SETTLE:");
-    Serial.print(t_step_settle);
-    Serial.print(",WEIGHT:");
-    Serial.print(t_weight_settle);
-    Serial.print(",TRANSFER:");
-    Serial.print(t_transfer);
-    Serial.print(",GRIND:");
-    Serial.print(t_grind);
-    Serial.print(",CAP:");
-    Serial.print(t_cap_push);
-    Serial.print(",UP:");
-    Serial.print(t_elev_up);
-    Serial.print(",DOWN:");
-    Serial.println(t_elev_down);
+    host.print("DELAYS:");
+    host.print("SETTLE:");
+    host.print(t_step_settle);
+    host.print(",WEIGHT:");
+    host.print(t_weight_settle);
+    host.print(",TRANSFER:");
+    host.print(t_transfer);
+    host.print(",GRIND:");
+    host.print(t_grind);
+    host.print(",CAP:");
+    host.print(t_cap_push);
+    host.print(",UP:");
+    host.print(t_elev_up);
+    host.print(",DOWN:");
+    host.println(t_elev_down);
   }
   else if (command.startsWith("SET:DELAY:SETTLE:")) {
     t_step_settle = command.substring(17).toInt();
-    Serial.print("SET:DELAY:SETTLE:");
-    Serial.println(t_step_settle);
+    host.print("SET:DELAY:SETTLE:");
+    host.println(t_step_settle);
   }
   else if (command.startsWith("SET:DELAY:WEIGHT:")) {
     t_weight_settle = command.substring(17).toInt();
-    Serial.print("SET:DELAY:WEIGHT:");
-    Serial.println(t_weight_settle);
+    host.print("SET:DELAY:WEIGHT:");
+    host.println(t_weight_settle);
   }
   else if (command.startsWith("SET:DELAY:TRANSFER:")) {
     t_transfer = command.substring(19).toInt();
-    Serial.print("SET:DELAY:TRANSFER:");
-    Serial.println(t_transfer);
+    host.print("SET:DELAY:TRANSFER:");
+    host.println(t_transfer);
   }
   else if (command.startsWith("SET:DELAY:GRIND:")) {
     t_grind = command.substring(16).toInt();
-    Serial.print("SET:DELAY:GRIND:");
-    Serial.println(t_grind);
+    host.print("SET:DELAY:GRIND:");
+    host.println(t_grind);
   }
   else if (command.startsWith("SET:DELAY:CAP:")) {
     t_cap_push = command.substring(14).toInt();
-    Serial.print("SET:DELAY:CAP:");
-    Serial.println(t_cap_push);
+    host.print("SET:DELAY:CAP:");
+    host.println(t_cap_push);
   }
   else if (command.startsWith("SET:DELAY:UP:")) {
     t_elev_up = command.substring(13).toInt();
-    Serial.print("SET:DELAY:UP:");
-    Serial.println(t_elev_up);
+    host.print("SET:DELAY:UP:");
+    host.println(t_elev_up);
   }
   else if (command.startsWith("SET:DELAY:DOWN:")) {
     t_elev_down = command.substring(15).toInt();
-    Serial.print("SET:DELAY:DOWN:");
-    Serial.println(t_elev_down);
+    host.print("SET:DELAY:DOWN:");
+    host.println(t_elev_down);
+  }
+  else if (command.startsWith("SET:SOLENOID:")) {
+    // SET:SOLENOID:TRASPASO:pull_in_ms,hold_percent (hold 100 = always full on)
+    String params = command.substring(13);
+    int colonIdx = params.indexOf(':');
+    int commaIdx = params.indexOf(',');
+    if (colonIdx > 0 && commaIdx > colonIdx) {
+      String target = params.substring(0, colonIdx);
+      long pullIn = params.substring(colonIdx + 1, commaIdx).toInt();
+      long hold = params.substring(commaIdx + 1).toInt();
+      if (pullIn < 0 || hold < 0 || hold > 100) {
+        host.println("ERROR:SOLENOIDE_PARAMETROS_INVALIDOS");
+      } else if (target == transferSolenoid.getName()) {
+        transferSolenoid.setStrikeHold(pullIn, hold);
+        printSolenoids();
+      } else if (target == capSolenoid.getName()) {
+        capSolenoid.setStrikeHold(pullIn, hold);
+        printSolenoids();
+      } else {
+        host.println("ERROR:SOLENOIDE_DESCONOCIDO");
+      }
+    } else {
+      host.println("ERROR:SOLENOIDE_PARAMETROS_INVALIDOS");
+    }
+  }
+  else if (command == "GET:SOLENOIDS") {
+    printSolenoids();
   }
   else if (command == "GET:DOSING") {
-    Serial.print("DOSING:DIVISIONS:");
-    Serial.print(wheel_divisions);
-    Serial.print(",LOT_SIZE:");
-    Serial.println(lot_size);
+    host.print("DOSING:DIVISIONS:");
+    host.print(wheel_divisions);
+    host.print(",LOT_SIZE:");
+    host.println(lot_size);
+  }
+  else if (command == "DOSING:HOME") {
+    dosingWheel.home();
+  }
+  else if (command.startsWith("DOSING:POCKET:")) {
+    if (!dosingWheel.isReferenced()) {
+      host.println("ERROR:DOSIFICADOR_SIN_REFERENCIA");
+    } else if (dosingWheel.isDispensing()) {
+      host.println("ERROR:DOSIFICADOR_OCUPADO");
+    } else if (!dosingWheel.moveToPocket(command.substring(14).toInt())) {
+      host.println("ERROR:BOLSILLO_INVALIDO");
+    }
+  }
+  else if (command == "GET:DOSING_POS") {
+    host.print("DOSIFICADOR:BOLSILLO:");
+    host.print(dosingWheel.getPocket());
+    host.print("/");
+    host.print(wheel_divisions);
+    host.print(",PASO:");
+    host.print(dosingWheel.getStepInRevolution());
+    host.print("/");
+    host.print(dosingWheel.stepsPerRevolution());
+    host.print(",REF:");
+    host.print(dosingWheel.isReferenced() ? 1 : 0);
+    host.print(",REINDEX:");
+    host.print(dosingWheel.getReindexCount());
+    host.print(",ERR_MAX:");
+    host.println(dosingWheel.getMaxIndexError());
+  }
+  // Motion profiles: SET:MOTION:ELEV:speed,accel,microsteps
+  else if (command.startsWith("SET:MOTION:")) {
+    bool isElevator = command.startsWith("SET:MOTION:ELEV:");
+    bool isDosing = command.startsWith("SET:MOTION:DOSING:");
+    long values[3];
+    String params = command.substring(command.indexOf(':', 11) + 1);
+    
+    // Range-checked as long: 65537 would wrap to a valid unsigned int
+    MotionProfile profile;
+    if ((isElevator || isDosing) && parseValues(params, values, 3) == 3 &&
+        values[0] > 0 && values[0] <= MOTION_SPEED_LIMIT && values[1] >= 0 && values[1] <= 0xFFFF &&
+        values[2] > 0 && values[2] <= 8) {
+      profile.speed = values[0];
+      profile.accel = values[1];
+      profile.microsteps = values[2];
+    } else {
+      profile.speed = 0;
+    }
+    
+    if (!isElevator && !isDosing) {
+      host.println("ERROR:EJE_DESCONOCIDO");
+    } else if (!isValidMotionProfile(profile) || (isDosing && profile.accel == 0)) {
+      host.println("ERROR:PERFIL_INVALIDO");
+    } else {
+      bool applied = isElevator ? elevator.setProfile(profile) : dosingWheel.setProfile(profile);
+      printMotion();
+      if (!applied) {
+        host.println("MOTION:PENDIENTE");  // Taken at the start of the next move
+      }
+    }
+  }
+  else if (command == "GET:MOTION") {
+    printMotion();
+  }
+  // Sweep: MOTION:SWEEP:ELEV|DOSING:v0,v1,dv,a0,a1,da
+  else if (command == "MOTION:SWEEP:STOP") {
+    MotionSweep::stop();
+  }
+  else if (command.startsWith("MOTION:SWEEP:")) {
+    bool isElevator = command.startsWith("MOTION:SWEEP:ELEV:");
+    bool isDosing = command.startsWith("MOTION:SWEEP:DOSING:");
+    long values[6];
+    String params = command.substring(command.indexOf(':', 13) + 1);
+    
+    if ((!isElevator && !isDosing) || parseValues(params, values, 6) != 6) {
+      host.println("ERROR:SWEEP_FORMATO");
+    } else {
+      for (int i = 0; i < 6; i++) {
+        if (values[i] < 0) values[i] = 0;
+        if (values[i] > 0xFFFF) values[i] = 0xFFFF;  // Saturate, do not wrap into unsigned int
+      }
+      MotionSweep::start(isElevator ? SWEEP_ELEVATOR : SWEEP_DOSING,
+                         values[0], values[1], values[2], values[3], values[4], values[5]);
+    }
+  }
+  // Weight trace: TRACE:ARM:DOSING|TRANSFER[,samples]
+  else if (command.startsWith("TRACE:ARM:")) {
+    String params = command.substring(10);
+    int commaIdx = params.indexOf(',');
+    String sourceName = commaIdx < 0 ? params : params.substring(0, commaIdx);
+    long samples = commaIdx < 0 ? TRACE_SAMPLES : params.substring(commaIdx + 1).toInt();
+    TraceTrigger source = sourceName == "DOSING" ? TRACE_DOSING :
+                          sourceName == "TRANSFER" ? TRACE_TRANSFER : TRACE_NONE;
+    
+    if (!loadCell.isConnected()) {
+      host.println("ERROR:ESCALA_NO_ENCONTRADA");
+    } else if (source == TRACE_NONE) {
+      host.println("ERROR:TRACE_FUENTE_INVALIDA");
+    } else if (samples <= 0 || samples > TRACE_SAMPLES || !WeightTrace::arm(source, samples)) {
+      host.println("ERROR:TRACE_PARAMETROS_INVALIDOS");
+    }
+  }
+  else if (command == "TRACE:DISARM") {
+    WeightTrace::disarm();
+  }
+  else if (command == "TRACE:DUMP") {
+    WeightTrace::dump();
+  }
+  else if (command == "LOT:REPORT") {
+    PillLedger::report();
+  }
+  else if (command == "LOT:ABORT") {
+    if (!stateMachine.isLotPaused()) {
+      host.println("ERROR:SIN_LOTE_PAUSADO");
+    } else {
+      stateMachine.abortLot();
+    }
+  }
+  else if (command.startsWith("SET:WEIGHT_STREAM:")) {
+    stateMachine.setWeightStream(command.substring(18).toInt() != 0);
+    host.print("WEIGHT_STREAM:");
+    host.println(stateMachine.getWeightStream() ? 1 : 0);
+  }
+  else if (command.startsWith("SET:EVENTS:")) {
+    EventBus::setMask(strtol(command.substring(11).c_str(), NULL, 0));
+    printEvents();
+  }
+  else if (command == "GET:EVENTS") {
+    printEvents();
+  }
+  else if (command.startsWith("SET:PRESTAGE:")) {
+    stateMachine.setPrestage(command.substring(13).toInt() != 0);
+    host.print("PRESTAGE:");
+    host.println(stateMachine.getPrestage() ? 1 : 0);
+  }
+  else if (command == "GET:DURATIONS") {
+    stateMachine.printDurations();
+  }
+  else if (command == "HELLO") {
+    printConfig(true);
+  }
+  else if (command == "GET:CONFIG") {
+    printConfig();
+  }
+  else if (command.startsWith("SET:CONFIG:")) {
+    applyConfig(command.substring(11));
   }
   else if (command == "GET:DELAYS") {
-    Serial.print("DELAYS:");
-    Serial.print("SETTLE:");
-    Serial.print(t_step_settle);
-    Serial.print(",WEIGHT:");
-    Serial.print(t_weight_settle);
-    Serial.print(",TRANSFER:");
-    Serial.print(t_transfer);
-    Serial.print(",GRIND:");
-    Serial.print(t_grind);
-    Serial.print(",CAP:");
-    Serial.print(t_cap_push);
-    Serial.print(",UP:");
-    Serial.print(t_elev_up);
-    Serial.print(",DOWN:");
-    Serial.println(t_elev_down);
+    host.print("DELAYS:");
+    host.print("SETTLE:");
+    host.print(t_step_settle);
+    host.print(",WEIGHT:");
+    host.print(t_weight_settle);
+    host.print(",TRANSFER:");
+    host.print(t_transfer);
+    host.print(",GRIND:");
+    host.print(t_grind);
+    host.print(",CAP:");
+    host.print(t_cap_push);
+    host.print(",UP:");
+    host.print(t_elev_up);
+    host.print(",DOWN:");
+    host.println(t_elev_down);
   }
   
   // Status and help
-  else if (command == "STATUS") {
+  else if (command == "BENCH:GPIO") {
+    Benchmark::gpio();
+  } else if (command == "BENCH:ALL") {
+    Benchmark::runAll();
+  } else if (command.startsWith("SET:ID:")) {
+    int id = command.substring(7).toInt();
+    if (id >= 0 && id < 255) {
+      host.setDeviceId(id);
+      host.print("ID:");
+      host.println(host.getDeviceId());
+    } else {
+      host.println("ERROR:ID_INVALIDO");
+    }
+  } else if (command == "GET:ID") {
+    host.print("ID:");
+    host.println(host.getDeviceId());
+  } else if (command.startsWith("SYNC:")) {
+    // Answer before anything else is queued so the host can halve the RTT
+    unsigned long ms = millis();
+    unsigned long us = micros();
+    host.print("SYNC:");
+    host.print(command.substring(5));
+    host.print(",");
+    host.print(ms);
+    host.print(",");
+    host.println(us);
+  } else if (command.startsWith("SET:META:")) {
+    host.setEventMeta(command.substring(9).toInt() != 0);
+    host.print("META:");
+    host.println(host.getEventMeta() ? 1 : 0);
+  } else if (command == "MEM") {
+    MemStats::report();
+  } else if (command == "PROF") {
+#ifdef PROFILING
+    Profiler::report();
+#else
+    host.println("ERROR:PROFILING_DESHABILITADO");
+#endif
+  } else if (command == "STATUS") {
     printStatus();
   } else if (command == "HELP") {
     printHelp();
@@ -338,70 +770,406 @@ void CommandProcessor::processCommand(String command) {
   
   // Unknown command
   else {
-    Serial.print("UNKNOWN:");
-    Serial.println(command);
+    host.print("UNKNOWN:");
+    host.println(command);
   }
 }
 
+void CommandProcessor::printMotion() {
+  const MotionProfile& elev = elevator.getProfile();
+  const MotionProfile& dosing = dosingWheel.getProfile();
+  host.print("MOTION:ELEV:");
+  host.print(elev.speed);
+  host.print(",");
+  host.print(elev.accel);
+  host.print(",");
+  host.print(elev.microsteps);
+  host.print(",DOSING:");
+  host.print(dosing.speed);
+  host.print(",");
+  host.print(dosing.accel);
+  host.print(",");
+  host.println(dosing.microsteps);
+}
+
 void CommandProcessor::printStatus() {
-  Serial.print("STATUS:");
-  Serial.print("ESTADO:");
-  Serial.print(stateMachine.getStateName());
-  Serial.print(",PASTILLAS:");
-  Serial.print(stateMachine.getPillCount());
-  Serial.print("/");
-  Serial.print(lot_size);
-  Serial.print(",MODO:");
-  Serial.print(globalMode == MODE_REAL ? "REAL" : "SIM");
-  Serial.print(",PESO:");
-  Serial.print(loadCell.readWeight());
-  Serial.print(",FRASCO_VACIO:");
-  Serial.print(inputs.isFrascoVacio() ? "1" : "0");
-  Serial.print(",PASTILLAS_CARGADAS:");
-  Serial.print(inputs.isPastillasCargadas() ? "1" : "0");
-  Serial.println();
+  host.print("STATUS:");
+  host.print("ESTADO:");
+  host.print(stateMachine.getStateName());
+  host.print(",PASTILLAS:");
+  host.print(stateMachine.getPillCount());
+  host.print("/");
+  host.print(lot_size);
+  host.print(",MODO:");
+  host.print(globalMode == MODE_REAL ? "REAL" : "SIM");
+  host.print(",PESO:");
+  host.print(loadCell.readWeight());
+  host.print(",FRASCO_VACIO:");
+  host.print(inputs.isFrascoVacio() ? "1" : "0");
+  host.print(",PASTILLAS_CARGADAS:");
+  host.print(inputs.isPastillasCargadas() ? "1" : "0");
+  host.print(",DUTY_TRASPASO:");
+  host.print(transferSolenoid.getDutyPercent());
+  host.print(",DUTY_TAPA:");
+  host.print(capSolenoid.getDutyPercent());
+  host.println();
+}
+
+void CommandProcessor::printSolenoids() {
+  // One line per solenoid: strike/hold settings, last-window duty and energy
+  host.print("SOLENOIDE:");
+  host.print(transferSolenoid.getName());
+  host.print(":PULL_IN:");
+  host.print(transferSolenoid.getPullInTime());
+  host.print(",HOLD:");
+  host.print(transferSolenoid.getHoldPercent());
+  host.print(",DUTY:");
+  host.print(transferSolenoid.getDutyPercent());
+  host.print(",ENERGIA_MS:");
+  host.println(transferSolenoid.getEnergy());
+  
+  host.print("SOLENOIDE:");
+  host.print(capSolenoid.getName());
+  host.print(":PULL_IN:");
+  host.print(capSolenoid.getPullInTime());
+  host.print(",HOLD:");
+  host.print(capSolenoid.getHoldPercent());
+  host.print(",DUTY:");
+  host.print(capSolenoid.getDutyPercent());
+  host.print(",ENERGIA_MS:");
+  host.println(capSolenoid.getEnergy());
+}
+
+void CommandProcessor::printScaleConfig() {
+  host.print("ESCALA:RATE:");
+  host.print(loadCell.getSampleRate());
+  host.print(",GAIN:");
+  host.print(loadCell.getGain());
+  host.print(",CANAL:");
+  host.print(loadCell.getChannel());
+  host.print(",CALIBRADA:");
+  host.print(loadCell.isCalibrated() ? 1 : 0);
+  host.print(",ESTABLE_MS:");
+  host.println(loadCell.getStableWindow());
+}
+
+void CommandProcessor::printConfig(bool hello) {
+  // CONFIG:<body>*<crc8 of body, 2 hex digits>. HELLO: is protocol, uptime
+  // and boot info framed the same way, on a line of its own before the
+  // CONFIG: line: both on one line would not fit in a bus slot (BUS_LINE_MAX)
+  if (hello) {
+    host.print("HELLO:");
+    CrcPrint header(host);
+    header.print("PROTO:");
+    header.print(PROTOCOL_VERSION);
+    header.print(",UPTIME:");
+    header.print(millis());
+    header.print(",REINICIO:");
+    header.print(Checkpoint::getResetCause());
+    header.print(",RESUME:");
+    header.print(Checkpoint::isPending() ? 1 : 0);
+    printCrc(header.getCrc());
+  }
+  
+  host.print("CONFIG:");
+  CrcPrint body(host);
+  for (uint8_t i = 0; i < DELAY_COUNT; i++) {
+    body.print(DELAY_KEYS[i]);
+    body.print(":");
+    body.print(*DELAY_VARS[i]);
+    body.print(",");
+  }
+  body.print("DIVISIONS:");
+  body.print(wheel_divisions);
+  body.print(",LOT_SIZE:");
+  body.print(lot_size);
+  body.print(",THRESHOLD:");
+  body.print(loadCell.getThreshold(), 3);
+  body.print(",PILL:");
+  body.print(pill_weight, 3);
+  body.print(",ZERO_BAND:");
+  body.print(loadCell.getZeroBand(), 3);
+  body.print(",PRESTAGE:");
+  body.print(stateMachine.getPrestage() ? 1 : 0);
+  body.print(",STREAM:");
+  body.print(stateMachine.getWeightStream() ? 1 : 0);
+  
+  // Live status, read-only (SET:CONFIG rejects these keys)
+  body.print(",ESTADO:");
+  body.print(stateMachine.getStateName());
+  body.print(",PASTILLAS:");
+  body.print(stateMachine.getPillCount());
+  body.print(",MODO:");
+  body.print(TestMode::isActive() ? "TEST" : globalMode == MODE_REAL ? "REAL" : "SIM");
+  body.print(",PESO:");
+  body.print(loadCell.getWeight(), 2);  // Last reading, GET:CONFIG never waits on the HX711
+  body.print(",FRASCO_VACIO:");
+  body.print(inputs.isFrascoVacio() ? 1 : 0);
+  body.print(",PASTILLAS_CARGADAS:");
+  body.print(inputs.isPastillasCargadas() ? 1 : 0);
+  
+  printCrc(body.getCrc());
+}
+
+void CommandProcessor::printCrc(uint8_t crc) {
+  host.print("*");
+  if (crc < 0x10) host.print("0");
+  host.println(crc, HEX);
+}
+
+void CommandProcessor::applyConfig(const String& frame) {
+  int star = frame.lastIndexOf('*');
+  if (star < 0) {
+    host.println("ERROR:CONFIG_FORMATO");
+    return;
+  }
+  String body = frame.substring(0, star);
+  String crcText = frame.substring(star + 1);
+  if (crcText.length() != 2 ||
+      strtol(crcText.c_str(), NULL, 16) != crc8(body.c_str(), body.length())) {
+    host.println("ERROR:CONFIG_CRC");
+    return;
+  }
+  
+  // Stage every field on a copy of the current configuration
+  unsigned long delays[DELAY_COUNT];
+  for (uint8_t i = 0; i < DELAY_COUNT; i++) {
+    delays[i] = *DELAY_VARS[i];
+  }
+  long divisions = wheel_divisions;
+  long lotSize = lot_size;
+  float threshold = loadCell.getThreshold();
+  float pill = pill_weight;
+  float zeroBand = loadCell.getZeroBand();
+  bool prestage = stateMachine.getPrestage();
+  bool stream = stateMachine.getWeightStream();
+  
+  // Per-field problems as KEY=DESCONOCIDO|FORMATO|RANGO
+  String errors = "";
+  int startIdx = 0;
+  while (startIdx < (int)body.length()) {
+    int commaIdx = body.indexOf(',', startIdx);
+    if (commaIdx < 0) commaIdx = body.length();
+    String field = body.substring(startIdx, commaIdx);
+    startIdx = commaIdx + 1;
+    
+    int colonIdx = field.indexOf(':');
+    String key = colonIdx > 0 ? field.substring(0, colonIdx) : field;
+    String value = colonIdx > 0 ? field.substring(colonIdx + 1) : String("");
+    const char* problem = NULL;
+    
+    // Status fields of GET:CONFIG / HELLO are not settings; leaving them out
+    // also keeps the widest frame within COMMAND_MAX_LENGTH
+    if (key == "ESTADO" || key == "PASTILLAS" || key == "MODO" || key == "PESO" ||
+        key == "FRASCO_VACIO" || key == "PASTILLAS_CARGADAS" || key == "PROTO" ||
+        key == "UPTIME" || key == "REINICIO" || key == "RESUME") {
+      problem = "SOLO_LECTURA";
+    } else if (!isDecimal(value)) {
+      problem = "FORMATO";
+    }
+    
+    float number = value.toFloat();
+    bool integer = value.indexOf('.') < 0;
+    bool known = true;
+    bool inRange = true;
+    uint8_t d = 0;
+    while (d < DELAY_COUNT && key != DELAY_KEYS[d]) d++;
+    
+    // Counts and ms take no fraction, it would be silently truncated
+    if ((d < DELAY_COUNT || key == "DIVISIONS" || key == "LOT_SIZE") && !integer && !problem) {
+      problem = "FORMATO";
+    }
+    
+    if (problem) {
+      // Read-only or malformed, reported as is
+    } else if (d < DELAY_COUNT) {
+      inRange = number >= 0 && number <= DELAY_MAX;
+      delays[d] = value.toInt();
+    } else if (key == "DIVISIONS") {
+      inRange = number >= 1 && number <= 50;
+      divisions = value.toInt();
+    } else if (key == "LOT_SIZE") {
+      inRange = number >= 1;  // Checked against the divisions below
+      lotSize = value.toInt();
+    } else if (key == "THRESHOLD") {
+      inRange = number > 0 && number <= CONFIG_WEIGHT_MAX;
+      threshold = number;
+    } else if (key == "PILL") {
+      inRange = number >= 0 && number <= CONFIG_WEIGHT_MAX;
+      pill = number;
+    } else if (key == "ZERO_BAND") {
+      inRange = number >= 0 && number <= CONFIG_WEIGHT_MAX;
+      zeroBand = number;
+    } else if (key == "PRESTAGE") {
+      inRange = value == "0" || value == "1";
+      prestage = number != 0;
+    } else if (key == "STREAM") {
+      inRange = value == "0" || value == "1";
+      stream = number != 0;
+    } else {
+      known = false;
+    }
+    
+    if (!known) {
+      problem = "DESCONOCIDO";
+    } else if (!problem && !inRange) {
+      problem = "RANGO";
+    }
+    if (problem) {
+      if (errors.length() > 0) errors += ",";
+      errors += key + "=" + problem;
+    }
+  }
+  
+  // Cross-field rules
+  if (lotSize > divisions && errors.indexOf("LOT_SIZE=") < 0) {
+    if (errors.length() > 0) errors += ",";
+    errors += "LOT_SIZE=RANGO";
+  }
+  if (zeroBand >= threshold && errors.indexOf("ZERO_BAND=") < 0) {
+    if (errors.length() > 0) errors += ",";
+    errors += "ZERO_BAND=RANGO";  // A pill must never look like drift
+  }
+  
+  // All or nothing
+  if (errors.length() > 0) {
+    host.print("ERROR:CONFIG:");
+    host.println(errors);
+    return;
+  }
+  for (uint8_t i = 0; i < DELAY_COUNT; i++) {
+    *DELAY_VARS[i] = delays[i];
+  }
+  bool lotChanged = divisions != wheel_divisions || lotSize != lot_size;
+  wheel_divisions = divisions;
+  lot_size = lotSize;
+  loadCell.setThreshold(threshold);
+  pill_weight = pill;
+  loadCell.setZeroBand(zeroBand);
+  stateMachine.setPrestage(prestage);
+  stateMachine.setWeightStream(stream);
+  if (lotChanged && stateMachine.getCurrentState() == ESTADO0_INICIO) {
+    stateMachine.resetPillCount();  // Same as SET:LOT_SIZE; an unchanged lot keeps a paused count
+  }
+  printConfig();
+}
+
+void CommandProcessor::printEvents() {
+  host.print("EVENTS:MASK:");
+  host.print(EventBus::getMask());
+  host.print(",COMPILADO:");
+  host.print(EVENT_COMPILE_MASK);
+  host.print(",PERDIDOS:");
+  host.println(EventBus::getDropped());
+}
+
+void CommandProcessor::printZero() {
+  host.print("ZERO:DERIVA:");
+  host.print(loadCell.getZeroDrift(), 3);
+  host.print(",TASA_MG_H:");
+  host.print(loadCell.getZeroDriftRate(), 1);
+  host.print(",AJUSTES:");
+  host.print(loadCell.getZeroCorrections());
+  host.print(",BANDA:");
+  host.println(loadCell.getZeroBand(), 2);
 }
 
 void CommandProcessor::printHelp() {
-  Serial.println("=== COMANDOS DE MODO ===");
-  Serial.println("MODE:REAL - Usar sensores/temporizadores reales");
-  Serial.println("MODE:SIM - Usar simulacion (por defecto)");
-  Serial.println("");
-  Serial.println("=== COMANDOS DE CONTROL ===");
-  Serial.println("BTN:START - Pulsar boton de inicio");
-  Serial.println("BTN:RESET - Pulsar boton de reinicio");
-  Serial.println("");
-  Serial.println("=== COMANDOS DE SIMULACION ===");
-  Serial.println("SIM:POS_ALTA:1/0 - Establecer elevador en posicion alta");
-  Serial.println("SIM:POS_BAJA:1/0 - Establecer elevador en posicion baja");
-  Serial.println("SIM:WEIGHT_STABLE:1/0 - Establecer peso estable");
-  Serial.println("SIM:FRASCO_VACIO:1/0 - Establecer frasco vacio");
-  Serial.println("SIM:PASTILLAS_CARGADAS:1/0 - Establecer pastillas cargadas");
-  Serial.println("");
-  Serial.println("=== COMANDOS DE CELDA DE CARGA ===");
-  Serial.println("SCALE:ENABLE/DISABLE - Usar celda de carga real/simulada");
-  Serial.println("SCALE:TARE - Poner a cero la balanza");
-  Serial.println("SCALE:CAL:peso - Calibrar con peso conocido");
-  Serial.println("SCALE:READ - Leer peso actual");
-  Serial.println("SET:WEIGHT_THRESHOLD:n - Establecer umbral de deteccion de peso");
-  Serial.println("");
-  Serial.println("=== COMANDOS DE PARAMETROS ===");
-  Serial.println("SET:DIVISIONS:n - Establecer divisiones de rueda (max pastillas en rueda)");
-  Serial.println("SET:LOT_SIZE:n - Establecer tamaño del lote");
-  Serial.println("SET:DOSING:DIVISIONS:n,LOT_SIZE:n - Configurar dosificacion completa");
-  Serial.println("");
-  Serial.println("=== COMANDOS DE TIEMPOS ===");
-  Serial.println("SET:DELAY:SETTLE:n - Tiempo de asentamiento");
-  Serial.println("SET:DELAY:WEIGHT:n - Tiempo de peso");
-  Serial.println("SET:DELAY:TRANSFER:n - Tiempo de transferencia");
-  Serial.println("SET:DELAY:GRIND:n - Tiempo de molienda");
-  Serial.println("SET:DELAY:CAP:n - Tiempo de tapado");
-  Serial.println("SET:DELAY:UP:n - Tiempo elevador arriba");
-  Serial.println("SET:DELAY:DOWN:n - Tiempo elevador abajo");
-  Serial.println("SET:DELAYS:SETTLE:n,WEIGHT:n,... - Configurar todos los tiempos");
-  Serial.println("");
-  Serial.println("=== COMANDOS DE CONSULTA ===");
-  Serial.println("GET:DELAYS - Obtener configuracion de tiempos");
-  Serial.println("GET:DOSING - Obtener configuracion de dosificacion");
-  Serial.println("STATUS - Obtener estado actual");
+  host.println("=== COMANDOS DE MODO ===");
+  host.println("MODE:REAL - Usar sensores/temporizadores reales");
+  host.println("MODE:SIM - Usar simulacion (por defecto)");
+  host.println("");
+  host.println("=== COMANDOS DE CONTROL ===");
+  host.println("BTN:START - Pulsar boton de inicio");
+  host.println("BTN:RESET - Pulsar boton de reinicio");
+  host.println("RESUME - Reanudar lote interrumpido desde el checkpoint");
+  host.println("CHECKPOINT:DISCARD - Descartar lote interrumpido");
+  host.println("");
+  host.println("=== COMANDOS DE SIMULACION ===");
+  host.println("SIM:POS_ALTA:1/0 - Establecer elevador en posicion alta");
+  host.println("SIM:POS_BAJA:1/0 - Establecer elevador en posicion baja");
+  host.println("SIM:WEIGHT_STABLE:1/0 - Establecer peso estable");
+  host.println("SIM:FRASCO_VACIO:1/0 - Establecer frasco vacio");
+  host.println("SIM:PASTILLAS_CARGADAS:1/0 - Establecer pastillas cargadas");
+  host.println("");
+  host.println("=== COMANDOS DE CELDA DE CARGA ===");
+  host.println("SCALE:ENABLE/DISABLE - Usar celda de carga real/simulada");
+  host.println("SCALE:TARE - Poner a cero la balanza");
+  host.println("SET:ZERO_BAND:g - Banda de seguimiento automatico de cero (0 = apagado)");
+  host.println("GET:ZERO - Deriva de cero desde la ultima tara, tasa en mg/h y ajustes");
+  host.println("SCALE:CAL:peso - Calibrar con peso conocido");
+  host.println("SCALE:READ - Leer peso actual");
+  host.println("SCALE:RATE:10/80 - Velocidad de muestreo del HX711 (SPS)");
+  host.println("SCALE:GAIN:128/64 - Ganancia del canal A");
+  host.println("SCALE:CHANNEL:A/B - Seleccionar canal (B usa ganancia 32)");
+  host.println("GET:SCALE - Obtener configuracion de la balanza");
+  host.println("SET:WEIGHT_THRESHOLD:n - Peso minimo sobre la base para detectar la pastilla (g)");
+  host.println("SET:PILL_WEIGHT:g - Peso nominal de la pastilla para contar caidas multiples (0 = apagado)");
+  host.println("GET:DOSE - Peso nominal, redosificaciones y caidas multiples del lote");
+  host.println("");
+  host.println("=== COMANDOS DE PARAMETROS ===");
+  host.println("SET:DIVISIONS:n - Establecer divisiones de rueda (max pastillas en rueda)");
+  host.println("SET:LOT_SIZE:n - Establecer tamaño del lote");
+  host.println("SET:DOSING:DIVISIONS:n,LOT_SIZE:n - Configurar dosificacion completa");
+  host.println("");
+  host.println("=== COMANDOS DE TIEMPOS ===");
+  host.println("SET:DELAY:SETTLE:n - Tiempo de asentamiento");
+  host.println("SET:DELAY:WEIGHT:n - Tiempo de peso");
+  host.println("SET:DELAY:TRANSFER:n - Tiempo de transferencia");
+  host.println("SET:DELAY:GRIND:n - Tiempo de molienda");
+  host.println("SET:DELAY:CAP:n - Tiempo de tapado");
+  host.println("SET:DELAY:UP:n - Tiempo elevador arriba");
+  host.println("SET:DELAY:DOWN:n - Tiempo elevador abajo");
+  host.println("SET:DELAYS:SETTLE:n,WEIGHT:n,... - Configurar todos los tiempos");
+  host.println("SET:SOLENOID:TRASPASO/TAPA:ms,% - Tiempo de atraccion y ciclo de mantenimiento");
+  host.println("");
+  host.println("=== COMANDOS DE CONSULTA ===");
+  host.println("GET:DELAYS - Obtener configuracion de tiempos");
+  host.println("HELLO - Version de protocolo, uptime y reinicio (HELLO:campos*crc8), luego CONFIG:");
+  host.println("GET:CONFIG - Configuracion y estado en una linea CONFIG:campos*crc8");
+  host.println("SET:CONFIG:campos*crc8 - Aplicar ajustes (todo o nada; sin los campos de estado)");
+  host.println("GET:DOSING - Obtener configuracion de dosificacion");
+  host.println("DOSING:HOME - Buscar el indice de la rueda (bolsillo 0)");
+  host.println("DOSING:POCKET:n - Ir al bolsillo n por el camino mas corto");
+  host.println("SET:MOTION:ELEV/DOSING:vel,acel,micropasos - Perfil de movimiento (1/2/4/8)");
+  host.println("GET:MOTION - Perfiles de movimiento actuales");
+  host.println("MOTION:SWEEP:ELEV/DOSING:v0,v1,dv,a0,a1,da - Barrido de velocidad y aceleracion");
+  host.println("MOTION:SWEEP:STOP - Detener el barrido y restaurar el perfil");
+  host.println("TRACE:ARM:DOSING/TRANSFER[,n] - Capturar n muestras crudas de la balanza en la proxima caida");
+  host.println("TRACE:DISARM - Cancelar la captura");
+  host.println("TRACE:DUMP - Volcar la captura en reposo (hex empaquetado, ver tools/trace_to_csv.py)");
+  host.println("LOT:REPORT - Peso, asentamiento y traspaso de cada pastilla con estadisticas");
+  host.println("LOT:ABORT - Descartar el lote pausado por falta de pastillas");
+  host.println("SET:WEIGHT_STREAM:0/1 - Lineas PESO: durante el pesaje");
+  host.println("SET:EVENTS:mascara - Categorias de eventos: 1 ACCION, 2 ESTADO, 4 ERROR, 8 DEBUG");
+  host.println("GET:EVENTS - Mascara de eventos y eventos perdidos");
+  host.println("SET:PRESTAGE:0/1 - Dosificar la primera pastilla mientras sube el elevador");
+  host.println("GET:DURATIONS - Duraciones aprendidas por estado y ETA del lote");
+  host.println("GET:DOSING_POS - Bolsillo, paso en la vuelta, referencia y re-indexados");
+  host.println("GET:SOLENOIDS - Obtener configuracion, ciclo y energia de solenoides");
+  host.println("STATUS - Obtener estado actual");
+  host.println("");
+  host.println("=== COMANDOS DE DIRECCIONAMIENTO ===");
+  host.println("SET:ID:n - Direccion del nodo (0 = sin direccionamiento)");
+  host.println("GET:ID - Obtener direccion del nodo");
+  host.println("SYNC:token - Sincronizar reloj (responde token,millis,micros)");
+  host.println("SET:META:0/1 - Secuencia y marca de tiempo al final de cada linea");
+  host.println("#n:CMD - Ejecutar con respuesta ACK#n,CR:libre,US:t o NAK#n,motivo,CR:libre,US:t");
+  host.println("@n:COMANDO - Comando para el nodo n, @*:COMANDO para todos");
+  host.println("MEM - Memoria libre, marca de agua de stack/heap y fragmentacion");
+  host.println("BENCH:GPIO - Medir ciclos por actuacion y por pulso de paso");
+  host.println("BENCH:ALL - Medir comandos, protocolo, balanza y ciclo de estado (JSON)");
+  host.println("PROF - Ciclos por seccion de loop(), latencia ISR y cola TX (build -D PROFILING)");
+  host.println("");
+  host.println("=== COMANDOS DE SESION ===");
+  host.println("REC:ON/OFF - Grabar comandos, estados y pesos con marca de tiempo");
+  host.println("PLAY:ms,comando - Encolar comando grabado para reproducir");
+  host.println("PLAY:START/STOP - Iniciar/detener reproduccion");
+  host.println("");
+  host.println("=== SCRIPTS DE PRUEBA ===");
+  host.println("SCRIPT:ADD:paso[;paso] - Agregar pasos (comando de prueba, WAIT ms, WAIT ELEVATOR TOP/BOTTOM,");
+  host.println("  WAIT WEIGHT STABLE, WAIT DOSING IDLE [timeout], REPEAT n, END)");
+  host.println("SCRIPT:LIST/CLEAR - Listar/borrar el script");
+  host.println("SCRIPT:RUN/STOP - Ejecutar (modo prueba) o abortar con tiempos en us");
+  host.println("SCRIPT:SAVE/LOAD - Guardar/cargar el script en EEPROM");
 }
\ No newline at end of file
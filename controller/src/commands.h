@@ -6,14 +6,27 @@
 class CommandProcessor {
 private:
   String inputBuffer;
+  bool inputOverflow;  // Current line exceeded COMMAND_MAX_LENGTH, drop the rest of it
+  unsigned long lastCommandTime;  // For the HELLO greeting after host silence
+  
+  void dispatch(String command);
+  void greetAfterSilence(String line);  // HELLO: before the reply after HELLO_SILENCE
+  void applyConfig(const String& frame);
+  void printCrc(uint8_t crc);  // "*<2 hex digits>" and the line end of a framed reply
   
 public:
-  CommandProcessor() : inputBuffer("") {}
+  CommandProcessor() : inputBuffer(""), inputOverflow(false), lastCommandTime(0) {}
   
   void processSerialInput();
-  void processCommand(String command);
+  void processCommand(String command, bool tooLong = false);  // tooLong: NAK it, do not run it
   void printHelp();
   void printStatus();
+  void printScaleConfig();
+  void printZero();
+  void printEvents();
+  void printConfig(bool hello = false);
+  void printSolenoids();
+  void printMotion();
 };
 
 extern CommandProcessor commands;
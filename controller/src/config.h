@@ -24,13 +24,40 @@
 #define SOLENOID1_PIN 10  // Transfer solenoid
 #define SOLENOID2_PIN 11  // Cap push solenoid
 
+// Solenoid strike-and-hold: full current for the pull-in time, then PWM hold
+// (pin 10 = OC2A, pin 11 = OC1A). A hold duty of 100% keeps the coil fully on.
+#define SOLENOID_PULL_IN_DEFAULT 100     // Pull-in time at full current (ms)
+#define SOLENOID_HOLD_DUTY_DEFAULT 100   // Hold duty cycle (%), full on until set with SET:SOLENOID
+#define SOLENOID_DUTY_WINDOW 60000       // Window for duty/energy reporting (ms)
+
 // HX711 Load Cell Amplifier
 #define HX711_DOUT_PIN A0  // Data pin
 #define HX711_SCK_PIN A1   // Clock pin
+#define HX711_RATE_PIN -1  // RATE pin (HIGH = 80 SPS, LOW = 10 SPS); -1 if strapped on the board
 
 // Position sensors (optional - for real hardware)
 #define SENSOR_POS_ALTA_PIN A2
 #define SENSOR_POS_BAJA_PIN A3
+#define DOSING_INDEX_PIN A4          // Dosing wheel index (one flag per revolution)
+#define DOSING_INDEX_ACTIVE HIGH     // Sensor level while the flag is in front of it
+#define BENCH_PIN 13  // Spare pin (on-board LED) toggled by BENCH:GPIO
+
+#define SENSOR_DEBOUNCE_SAMPLES 3  // Consecutive ~1 ms samples to accept a sensor change
+
+// Host link - define HOST_RS485 (build flag) to talk over an RS-485 bus on Serial1
+#define RS485_DE_PIN 22        // Driver enable (DE and /RE tied together)
+#define BUS_NODES 8            // Time slots per bus frame
+#define BUS_LINE_MAX 322       // Longest line sent on the bus: CONFIG with every field at its limit,
+                               // a PESO of "-4294967040.00", address and metadata
+#define BUS_GUARD_MS 5         // Silence at the end of each slot: driver turnaround, tick and sync skew
+#define BUS_CLOCK_PPM 200      // Worst clock error of a node (crystal over temperature and ageing)
+#define BUS_SYNC_MS 30000UL    // Longest host silence the slots are sized for (the app SYNCs every 30 s)
+#define BUS_DRIFT_MS (BUS_SYNC_MS / (1000000UL / (2 * BUS_CLOCK_PPM)))  // 12 ms: two nodes drifting apart
+#define BUS_SLOT_MS (BUS_LINE_MAX * 10000UL / HOST_BAUD + 1 + BUS_GUARD_MS + BUS_DRIFT_MS)  // 353 ms at 9600
+#define BUS_TX_QUEUE 384       // Bytes queued while waiting for the slot
+#define BUS_TX_PER_TICK 4      // Bytes the sensor tick hands to the UART at most (one leaves per ms at 9600)
+#define BUS_RX_BUFFER 128      // Host bytes moved off the UART by the sensor tick
+#define BUS_REPORT_ROOM 48     // Queue room for "@255:BUS:DESCARTADAS:65535|65535,4294967295"
 
 // =====================================================
 // TIMING PARAMETERS (milliseconds)
@@ -44,6 +71,9 @@
 #define T_CAP_PUSH_DEFAULT 2500         // Cap pushing time
 #define T_ELEV_UP_DEFAULT 4000          // Elevator up time (fallback if no sensor)
 #define T_ELEV_DOWN_DEFAULT 4000        // Elevator down time (fallback if no sensor)
+#define DURATION_EWMA_SHIFT 2           // Learned state durations move 1/4 of the way to each sample
+#define DELAY_MAX 600000UL              // Upper bound accepted by SET:CONFIG (10 min)
+#define CONFIG_WEIGHT_MAX 1000.0        // Upper bound for THRESHOLD, PILL and ZERO_BAND in SET:CONFIG (g)
 
 // Keep old names for backward compatibility
 #define T_STEP_SETTLE t_step_settle
@@ -60,7 +90,12 @@
 
 #define WHEEL_DIVISIONS_DEFAULT 21      // Number of divisions in dosing wheel
 #define LOT_SIZE_DEFAULT 10             // Default number of pills to process
+#define PILL_WEIGHT_DEFAULT 0.0         // Nominal pill weight (g), 0 = every drop counts as one pill
+#define DOSE_MAX_RETRIES 3              // Empty drops in a row before the lot stops for lack of pills
 #define DEGREES_PER_DIVISION (360.0 / wheel_divisions)  // Calculated at runtime
+#define DOSING_INDEX_OFFSET 0           // Steps from the index edge to pocket 0 under the chute
+#define DOSING_HOME_SPEED 200           // Steps/s while searching the index
+#define DOSING_INDEX_TOLERANCE 2        // Re-index errors above this many steps are reported
 
 // =====================================================
 // LOAD CELL PARAMETERS
@@ -70,6 +105,28 @@
 #define WEIGHT_TOLERANCE 0.1             // Weight stability tolerance (grams)
 #define CALIBRATION_FACTOR_DEFAULT 420.0 // Default calibration factor
 
+// HX711 sampling - 10 or 80 samples per second (RATE pin / board strap)
+#define HX711_SPS_DEFAULT 10
+#define HX711_GAIN_DEFAULT 128           // 128/64 on channel A, 32 selects channel B
+
+// Filter and stability windows are expressed in samples so they scale with
+// the sample rate: 10 samples = 1000 ms at 10 SPS, 125 ms at 80 SPS
+#define WEIGHT_FILTER_SAMPLES 10         // Samples averaged per reading
+#define WEIGHT_STABLE_SAMPLES 10         // Sample periods weight must stay within tolerance
+#define BASELINE_SAMPLES 4               // Empty-pan conversions averaged while the wheel turns
+#define PRESTAGE_BASELINE_TIMEOUT 1000   // Pre-staged lot start waits this long for a still-pan baseline (ms)
+#define TRACE_SAMPLES 192                // Raw samples per trace capture (5 bytes each; 2.4 s at 80 SPS)
+#define TRACE_SAMPLES_PER_LINE 16        // Samples per TRACE:D line of a dump
+
+// Auto-zero tracking while the pan is empty and the machine is still
+#define ZERO_TRACK_BAND_DEFAULT 0.2      // Only readings within +/- this of zero are corrected (g, 0 = off)
+#define ZERO_TRACK_SAMPLES 16            // Conversions averaged per correction
+#define ZERO_TRACK_DIVISOR 4             // Each correction removes 1/4 of the measured error
+#define ZERO_TRACK_LIMIT 2.0             // Max total correction since the last tare (g)
+#define ZERO_TRACK_PREDROP_SAMPLES 4     // Empty-pan conversions tracked after each transfer, before the drop
+#define ZERO_TRACK_PREDROP_TIMEOUT 1000  // Drop anyway if they do not arrive (ms)
+#define ZERO_TRACK_PREDROP_MIN_SPS 80    // Only at this rate: 4 conversions are 50 ms at 80 SPS, 400 ms a pill at 10
+
 // =====================================================
 // MOTOR PARAMETERS
 // =====================================================
@@ -80,15 +137,52 @@
 #define DOSING_SPEED 800
 #define ELEVATOR_MAX_SPEED 1000
 #define DOSING_MAX_SPEED 800
-#define ELEVATOR_ACCELERATION 500
+#define ELEVATOR_ACCELERATION 0        // Start ramp (steps/s^2), 0 = full speed at once like plain runSpeed()
 #define DOSING_ACCELERATION 400
+#define STEP_DIR_SETUP_US 1             // DIR change to STEP rise (A4988 200 ns, DRV8825 650 ns)
+#define STEP_PULSE_US 2                 // STEP high time (A4988 1 us, DRV8825 1.9 us)
+
+// Runtime motion profiles (SET:MOTION) start from the values above
+#define MOTION_SPEED_LIMIT 4000         // Highest step rate AccelStepper sustains at 16 MHz
+#define MOTION_START_SPEED 100          // Elevator ramp starts here (steps/s)
+#define SWEEP_MAX_RUNS 64               // Speed x acceleration combinations per sweep
 
 // =====================================================
 // SYSTEM PARAMETERS
 // =====================================================
 
+#define HOST_BAUD 9600
+#define COMMAND_MAX_LENGTH 220      // Longer host lines are dropped with ERROR:COMANDO_LARGO; the widest
+                                    // SET:CONFIG (every setting at its limit, @id: and #tag:) is 212
+#define PROTOCOL_VERSION 2          // Reported by HELLO, bump on incompatible protocol changes
+#define HELLO_SILENCE 45000         // Greet a host that sends a command after this long quiet (> SYNC period)
+#define REPLY_REASON_MAX 24         // NAK reason characters kept
+#define EVENT_META_DEFAULT true     // Append "|seq,millis" to every outbound line
 #define HEARTBEAT_INTERVAL 5000  // 5 seconds to reduce traffic
 #define WEIGHT_PRINT_THRESHOLD 0.1  // Only print weight changes larger than this
-#define WEIGHT_STABLE_TIME 1000       // Time weight must be stable (ms)
+#define WEIGHT_STREAM_DEFAULT true  // PESO: lines while weighing (SET:WEIGHT_STREAM)
+#define PRESTAGE_DEFAULT false      // Dose the first pill while the elevator rises (SET:PRESTAGE)
+#define LEDGER_SIZE 64              // Per-pill records kept in RAM (11 bytes each)
+#define LEDGER_RECORDS_PER_LINE 8   // Records per LOT:DATOS line
+#define SCRIPT_MAX_STEPS 32         // Test script steps kept in RAM (5 bytes each)
+#define SCRIPT_MAX_DEPTH 4          // Nested REPEAT loops
+#define SCRIPT_WAIT_TIMEOUT 10000   // Default timeout of a script wait condition (ms)
+#define SCRIPT_REPORTS 16           // Step reports held until the script waits (10 bytes each)
+#define EVENT_QUEUE_SIZE 16         // Hardware events waiting for the telemetry drain (5 bytes each)
+#define EVENT_DRAIN_PER_PASS 4      // Events printed per loop() pass
+#define EVENT_MASK_DEFAULT 0x0F     // Categories printed at boot (SET:EVENTS), 0x08 = DEBUG
+#ifndef EVENT_COMPILE_MASK
+#define EVENT_COMPILE_MASK 0x0F     // Categories built in; -D EVENT_COMPILE_MASK=0x07 removes DEBUG events
+#endif
+#define WATCHDOG_TIMEOUT WDTO_8S    // Longest blocking path is HELP/BENCH output at 9600 baud
+
+// =====================================================
+// EEPROM LAYOUT
+// =====================================================
+
+#define CHECKPOINT_EEPROM_BASE 0    // Lot checkpoint journal
+#define CHECKPOINT_SLOTS 64         // 7-byte records, 448 bytes
+#define DEVICE_ID_EEPROM_ADDR 500   // Node address, 0/erased = addressing off
+#define SCRIPT_EEPROM_BASE 512      // Test script: magic, count, steps, crc (163 bytes max)
 
 #endif // CONFIG_H
\ No newline at end of file
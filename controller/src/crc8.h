@@ -0,0 +1,25 @@
+#ifndef CRC8_H
+#define CRC8_H
+
+#include <Arduino.h>
+
+// CRC-8, polynomial 0x07, initial value 0 (used for EEPROM records and dumps)
+
+inline uint8_t crc8Update(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+inline uint8_t crc8(const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint8_t crc = 0;
+  for (size_t i = 0; i < length; i++) {
+    crc = crc8Update(crc, bytes[i]);
+  }
+  return crc;
+}
+
+#endif
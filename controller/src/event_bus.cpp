@@ -0,0 +1,126 @@
+#include "event_bus.h"
+#include "host_link.h"
+#include "hardware.h"
+
+EventBus::Event EventBus::queue[EVENT_QUEUE_SIZE];
+volatile uint8_t EventBus::head = 0;
+volatile uint8_t EventBus::tail = 0;
+uint8_t EventBus::mask = EVENT_MASK_DEFAULT & EVENT_COMPILE_MASK;
+uint16_t EventBus::dropped = 0;
+uint16_t EventBus::droppedReported = 0;
+
+void EventBus::push(uint8_t id, long value) {
+  uint8_t next = (head + 1) % EVENT_QUEUE_SIZE;
+  if (next == tail) {
+    dropped++;  // Full: keep the older events, they are already in order
+    return;
+  }
+  queue[head].id = id;
+  queue[head].value = value;
+  head = next;  // Publish only once the slot is written
+}
+
+void EventBus::drain(uint8_t maxEvents) {
+  while (tail != head && maxEvents > 0) {
+    print(queue[tail]);
+    tail = (tail + 1) % EVENT_QUEUE_SIZE;
+    maxEvents--;
+  }
+
+  if (dropped != droppedReported) {
+    droppedReported = dropped;
+    host.print("EVENTOS:PERDIDOS:");
+    host.println(dropped);
+  }
+}
+
+void EventBus::print(const Event& e) {
+  switch (e.id) {
+    case EV_ELEVATOR_UP:
+      host.println("ACCION:ELEVADOR_SUBIENDO");
+      break;
+    case EV_ELEVATOR_DOWN:
+      host.println("ACCION:ELEVADOR_BAJANDO");
+      break;
+    case EV_ELEVATOR_STOPPED:
+      host.println("ACCION:ELEVADOR_DETENIDO");
+      break;
+    case EV_ELEVATOR_LATENCY: {
+      // Maximum as of this stop: later stops may already be in the ring
+      static unsigned long maxLatency = 0;
+      unsigned long halt = (unsigned long)e.value & 0xFFFF;
+      if (halt > maxLatency) {
+        maxLatency = halt;
+      }
+      host.print("ELEVADOR:LATENCIA_US:");
+      host.print(halt);
+      host.print(",LOOP:");
+      host.print((unsigned long)e.value >> 16);
+      host.print(",MAX:");
+      host.println(maxLatency);
+      break;
+    }
+    case EV_ELEVATOR_TOP:
+      host.println(e.value ? "TEST:ELEVATOR:UP" : "ELEVADOR:ARRIBA");
+      break;
+    case EV_ELEVATOR_BOTTOM:
+      host.println(e.value ? "TEST:ELEVATOR:DOWN" : "ELEVADOR:ABAJO");
+      break;
+
+    case EV_DOSING_START:
+      host.println("ACCION:DOSIFICANDO");
+      break;
+    case EV_DOSING_SEARCHING:
+      host.println("DOSIFICADOR:BUSCANDO_INDICE");
+      break;
+    case EV_DOSING_REFERENCED:
+      host.println("DOSIFICADOR:REFERENCIA:OK");
+      break;
+    case EV_DOSING_INDEX_FOUND:
+      host.print("DOSIFICADOR:REFERENCIA:OK,INDICE:");
+      host.println(e.value);
+      break;
+    case EV_DOSING_REINDEX:
+      host.print("DOSIFICADOR:REINDEX:ERR:");
+      host.println(e.value);
+      break;
+    case EV_DOSING_NO_INDEX:
+      host.println("ERROR:DOSIFICADOR_SIN_INDICE");
+      break;
+    case EV_DOSING_COMPLETE:
+      host.println("TEST:DOSING:COMPLETE");
+      break;
+    case EV_DOSING_STEPS:
+      host.print("DEBUG:DOSING:STEPS:");
+      host.println(e.value);
+      break;
+    case EV_DOSING_BUSY:
+      host.println("DEBUG:DOSING:ALREADY_IN_PROGRESS");
+      break;
+    case EV_DOSING_POSITION:
+      host.print("DEBUG:DOSING:POS:");
+      host.println(e.value);
+      break;
+
+    case EV_GRINDER_ON:
+      host.println("ACCION:MOLIENDO");
+      break;
+    case EV_GRINDER_OFF:
+      host.println("ACCION:MOLEDOR_DETENIDO");
+      break;
+    case EV_SOLENOID_ON:
+    case EV_SOLENOID_OFF:
+      host.print("ACCION:");
+      host.print(e.value == SOLENOID1_PIN ? transferSolenoid.getName() : capSolenoid.getName());
+      host.println(e.id == EV_SOLENOID_ON ? "_ACTIVADO" : "_DESACTIVADO");
+      break;
+
+    case EV_MODE:
+      host.print("MODO:");
+      host.println(e.value == MODE_REAL ? "REAL" : "SIMULACION");
+      break;
+    case EV_ZERO_LIMIT:
+      host.println("ZERO:LIMITE");  // Drift too large to track, needs SCALE:TARE
+      break;
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// =====================================================
+// EVENT BUS
+// =====================================================
+//
+// Hardware modules post compact events (id + one long) instead of
+// printing, so motion code never waits on the UART. post() only stores the
+// event and advances the head; drain() runs from loop() and after every
+// command and turns events into the usual protocol lines. There is one
+// producer and one consumer, both in the main context (never an ISR), and
+// each owns one 8-bit index, so the ring needs no locking.
+//
+// Every event belongs to a category. Categories outside
+// EVENT_COMPILE_MASK compile to nothing; the runtime mask (SET:EVENTS:<mask>)
+// filters the rest. A full ring drops the new event and drain() reports
+// EVENTOS:PERDIDOS:<total dropped>.
+
+enum EventCategory : uint8_t {
+  EVENT_ACTION = 0x01,  // ACCION: actuator changes
+  EVENT_STATUS = 0x02,  // Positions, referencing, mode
+  EVENT_ERROR = 0x04,
+  EVENT_DEBUG = 0x08
+};
+
+enum EventId : uint8_t {
+  EV_ELEVATOR_UP,
+  EV_ELEVATOR_DOWN,
+  EV_ELEVATOR_STOPPED,
+  EV_ELEVATOR_LATENCY,    // (loop latency << 16) | halt latency, us
+  EV_ELEVATOR_TOP,        // Timed arrival; value 1 in test mode
+  EV_ELEVATOR_BOTTOM,
+  EV_DOSING_START,
+  EV_DOSING_SEARCHING,
+  EV_DOSING_REFERENCED,   // Without index sensor
+  EV_DOSING_INDEX_FOUND,  // Index edge position
+  EV_DOSING_REINDEX,      // Index error in steps
+  EV_DOSING_NO_INDEX,
+  EV_DOSING_COMPLETE,     // Test mode
+  EV_DOSING_STEPS,        // Steps of a move
+  EV_DOSING_BUSY,
+  EV_DOSING_POSITION,
+  EV_GRINDER_ON,
+  EV_GRINDER_OFF,
+  EV_SOLENOID_ON,         // Solenoid pin
+  EV_SOLENOID_OFF,
+  EV_MODE,                // ControlMode
+  EV_ZERO_LIMIT
+};
+
+class EventBus {
+public:
+  static void post(uint8_t category, uint8_t id, long value = 0) {
+    if ((EVENT_COMPILE_MASK & category) && (mask & category)) {
+      push(id, value);
+    }
+  }
+  static void drain(uint8_t maxEvents = EVENT_QUEUE_SIZE);
+
+  static void setMask(uint8_t m) { mask = m & EVENT_COMPILE_MASK; }
+  static uint8_t getMask() { return mask; }
+  static uint16_t getDropped() { return dropped; }
+
+private:
+  struct Event {
+    uint8_t id;
+    long value;
+  };
+
+  static Event queue[EVENT_QUEUE_SIZE];
+  static volatile uint8_t head;  // Written by post() only
+  static volatile uint8_t tail;  // Written by drain() only
+  static uint8_t mask;
+  static uint16_t dropped;
+  static uint16_t droppedReported;
+
+  static void push(uint8_t id, long value);
+  static void print(const Event& e);
+};
+
+#endif
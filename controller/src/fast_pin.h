@@ -0,0 +1,144 @@
+#ifndef FAST_PIN_H
+#define FAST_PIN_H
+
+#include <Arduino.h>
+#include <AccelStepper.h>
+#include "config.h"
+#include "profiler.h"
+
+// =====================================================
+// COMPILE-TIME GPIO
+// =====================================================
+//
+// Pin<N> resolves the port and bit of an Arduino pin number at compile
+// time, so set()/clear() compile to a single sbi/cbi for ports A-G instead
+// of digitalWrite()'s table lookups. Ports H-L are outside the sbi/cbi
+// range on the ATmega2560 and fall back to an interrupt-safe
+// read-modify-write. Other targets use digitalWrite()/digitalRead().
+
+#if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+
+namespace pin_map {
+
+// PINx register addresses (data space); DDRx = PINx + 1, PORTx = PINx + 2
+enum : uint16_t {
+  REG_A = 0x20, REG_B = 0x23, REG_C = 0x26, REG_D = 0x29, REG_E = 0x2C, REG_F = 0x2F,
+  REG_G = 0x32, REG_H = 0x100, REG_J = 0x103, REG_K = 0x106, REG_L = 0x109
+};
+
+// Arduino Mega pin number -> PINx address
+constexpr uint16_t portOf(uint8_t p) {
+  return p <= 3 ? REG_E :
+         p == 4 ? REG_G :
+         p == 5 ? REG_E :
+         p <= 9 ? REG_H :
+         p <= 13 ? REG_B :
+         p <= 15 ? REG_J :
+         p <= 17 ? REG_H :
+         p <= 21 ? REG_D :
+         p <= 29 ? REG_A :
+         p <= 37 ? REG_C :
+         p == 38 ? REG_D :
+         p <= 41 ? REG_G :
+         p <= 49 ? REG_L :
+         p <= 53 ? REG_B :
+         p <= 61 ? REG_F : REG_K;
+}
+
+// Arduino Mega pin number -> bit within its port
+constexpr uint8_t bitOf(uint8_t p) {
+  return p == 0 ? 0 : p == 1 ? 1 : p == 2 ? 4 : p == 3 ? 5 : p == 4 ? 5 : p == 5 ? 3 :
+         p <= 9 ? p - 3 :              // PH3..PH6
+         p <= 13 ? p - 6 :             // PB4..PB7
+         p == 14 ? 1 : p == 15 ? 0 :   // PJ1, PJ0
+         p == 16 ? 1 : p == 17 ? 0 :   // PH1, PH0
+         p <= 21 ? 21 - p :            // PD3..PD0
+         p <= 29 ? p - 22 :            // PA0..PA7
+         p <= 37 ? 37 - p :            // PC7..PC0
+         p == 38 ? 7 :                 // PD7
+         p <= 41 ? 41 - p :            // PG2..PG0
+         p <= 49 ? 49 - p :            // PL7..PL0
+         p <= 53 ? 53 - p :            // PB3..PB0
+         p <= 61 ? p - 54 : p - 62;    // PF0..PF7, PK0..PK7
+}
+
+}  // namespace pin_map
+
+template <uint8_t N>
+class Pin {
+public:
+  static const uint16_t PIN_REG = pin_map::portOf(N);
+  static const uint8_t MASK = 1 << pin_map::bitOf(N);
+
+  static volatile uint8_t& in() { return *(volatile uint8_t*)PIN_REG; }
+  static volatile uint8_t& ddr() { return *(volatile uint8_t*)(PIN_REG + 1); }
+  static volatile uint8_t& out() { return *(volatile uint8_t*)(PIN_REG + 2); }
+
+  static void output() { modify(ddr(), true); }
+  static void input() { modify(ddr(), false); }
+  static void set() { modify(out(), true); }
+  static void clear() { modify(out(), false); }
+  static void write(bool high) { if (high) set(); else clear(); }
+  static bool read() { return (in() & MASK) != 0; }
+  static void toggle() { in() = MASK; }  // Writing PINx toggles PORTx
+
+private:
+  static void modify(volatile uint8_t& reg, bool high) {
+    if (PIN_REG < 0x40) {
+      // Low I/O space: single sbi/cbi, atomic by itself
+      if (high) reg |= MASK; else reg &= ~MASK;
+    } else {
+      uint8_t sreg = SREG;
+      cli();
+      if (high) reg |= MASK; else reg &= ~MASK;
+      SREG = sreg;
+    }
+  }
+};
+
+#else
+
+template <uint8_t N>
+class Pin {
+public:
+  static void output() { pinMode(N, OUTPUT); }
+  static void input() { pinMode(N, INPUT); }
+  static void set() { digitalWrite(N, HIGH); }
+  static void clear() { digitalWrite(N, LOW); }
+  static void write(bool high) { digitalWrite(N, high ? HIGH : LOW); }
+  static bool read() { return digitalRead(N) == HIGH; }
+  static void toggle() { digitalWrite(N, digitalRead(N) == HIGH ? LOW : HIGH); }
+};
+
+#endif
+
+// =====================================================
+// STEPPER WITH COMPILE-TIME STEP/DIR PINS
+// =====================================================
+
+// AccelStepper in DRIVER mode with the step pulse generated through Pin<>
+template <uint8_t STEP_PIN, uint8_t DIR_PIN>
+class FastStepper : public AccelStepper {
+public:
+  FastStepper() : AccelStepper(AccelStepper::DRIVER, STEP_PIN, DIR_PIN), dirLevel(0xFF) {}
+
+protected:
+  void step(long) override {
+    PROFILE_SECTION(PROF_STEP);
+    // DIR only when it changes, held STEP_DIR_SETUP_US before the rising
+    // edge; STEP high for STEP_PULSE_US (timings in config.h)
+    if (dirLevel != _direction) {
+      dirLevel = _direction;
+      Pin<DIR_PIN>::write(_direction);
+      delayMicroseconds(STEP_DIR_SETUP_US);
+    }
+    Pin<STEP_PIN>::set();
+    delayMicroseconds(STEP_PULSE_US);
+    Pin<STEP_PIN>::clear();
+  }
+
+private:
+  uint8_t dirLevel;  // Level last written to DIR, 0xFF = not yet written
+};
+
+#endif // FAST_PIN_H
@@ -1,80 +1,192 @@
 #include "hardware.h"
+#include "host_link.h"
+#include "event_bus.h"
+#include "weight_trace.h"
 #include "state_machine.h"  // For global delay variables
 
 // Global instances
 Elevator elevator;
 DosingWheel dosingWheel;
 LoadCell loadCell;
-Grinder grinder;
-Solenoid transferSolenoid(SOLENOID1_PIN, "TRASPASO");
-Solenoid capSolenoid(SOLENOID2_PIN, "TAPA");
+Grinder<MOTOR3_RELAY_PIN> grinder;
+Solenoid<SOLENOID1_PIN> transferSolenoid("TRASPASO");
+Solenoid<SOLENOID2_PIN> capSolenoid("TAPA");
 InputSystem inputs;
 ControlMode globalMode = MODE_SIMULATION;
 
+// =====================================================
+// MOTION PROFILES
+// =====================================================
+
+bool isValidMotionProfile(const MotionProfile& profile) {
+  bool microstepsOk = profile.microsteps == 1 || profile.microsteps == 2 ||
+                      profile.microsteps == 4 || profile.microsteps == 8;
+  return microstepsOk && profile.speed > 0 && profile.speed <= MOTION_SPEED_LIMIT;
+}
+
+// A4988-style MS1/MS2 (MS3 low): full, half, quarter, eighth
+static void writeMicrosteps(uint8_t ms1Pin, uint8_t ms2Pin, uint8_t microsteps) {
+  digitalWrite(ms1Pin, (microsteps == 2 || microsteps == 8) ? HIGH : LOW);
+  digitalWrite(ms2Pin, (microsteps == 4 || microsteps == 8) ? HIGH : LOW);
+}
+
 // =====================================================
 // ELEVATOR IMPLEMENTATION
 // =====================================================
 
-Elevator::Elevator() : motor(AccelStepper::DRIVER, MOTOR1_STEP_PIN, MOTOR1_DIR_PIN) {
+Elevator::Elevator() {
   movingUp = false;
   movingDown = false;
   atTop = false;
   atBottom = true;  // Start at bottom
   mode = MODE_SIMULATION;
   moveStartTime = 0;
+  sensorsReady = false;
+  sensorTop = false;
+  sensorBottom = false;
+  topCount = 0;
+  bottomCount = 0;
+  sensorHalt = false;
+  topChangeMicros = 0;
+  bottomChangeMicros = 0;
+  moveStartMicros = 0;
+  tripMicros = 0;
+  haltMicros = 0;
+  profile.speed = ELEVATOR_SPEED;
+  profile.accel = ELEVATOR_ACCELERATION;
+  profile.microsteps = MICROSTEPS;
+  pendingProfile = profile;
+  profilePending = false;
+  ramping = false;
+  lastRampMicros = 0;
 }
 
 void Elevator::init() {
-  motor.setMaxSpeed(ELEVATOR_MAX_SPEED);
-  motor.setAcceleration(ELEVATOR_ACCELERATION);
+  // Position sensors, read straight from the port register in the ISR
+  Pin<SENSOR_POS_ALTA_PIN>::input();
+  Pin<SENSOR_POS_BAJA_PIN>::input();
+  sensorsReady = true;
+  
+  // Timer0 drives millis(); its compare A interrupt gives a ~1 kHz sample tick
+  OCR0A = 0x80;
+  TIMSK0 |= _BV(OCIE0A);
   
   // Configure microstepping pins
   pinMode(MOTOR1_MS1_PIN, OUTPUT);
   pinMode(MOTOR1_MS2_PIN, OUTPUT);
-  digitalWrite(MOTOR1_MS1_PIN, HIGH);  // Half-stepping
-  digitalWrite(MOTOR1_MS2_PIN, LOW);
+  applyProfile();
 }
 
 void Elevator::moveUp() {
-  movingUp = true;
-  movingDown = false;
-  motor.setSpeed(ELEVATOR_SPEED);
-  moveStartTime = millis();
-  Serial.println("ACCION:ELEVADOR_SUBIENDO");
+  startMove(true);
+  EventBus::post(EVENT_ACTION, EV_ELEVATOR_UP);
 }
 
 void Elevator::moveDown() {
-  movingUp = false;
-  movingDown = true;
-  motor.setSpeed(-ELEVATOR_SPEED);
+  startMove(false);
+  EventBus::post(EVENT_ACTION, EV_ELEVATOR_DOWN);
+}
+
+void Elevator::startMove(bool up) {
+  if (profilePending) {
+    profile = pendingProfile;
+    profilePending = false;
+    applyProfile();
+  }
+  
+  // The sensor ISR compares trips against the start: no torn 32-bit value
+  unsigned long now = micros();
+  noInterrupts();
+  sensorHalt = false;
+  moveStartMicros = now;
+  interrupts();
   moveStartTime = millis();
-  Serial.println("ACCION:ELEVADOR_BAJANDO");
+  lastRampMicros = now;
+  
+  float speed = profile.speed;
+  ramping = profile.accel > 0 && profile.speed > MOTION_START_SPEED;
+  if (ramping) {
+    speed = MOTION_START_SPEED;
+  }
+  motor.setSpeed(up ? speed : -speed);
+  movingUp = up;
+  movingDown = !up;
+}
+
+void Elevator::ramp() {
+  // runSpeed() has no acceleration of its own: raise the speed once per ms
+  unsigned long now = micros();
+  if (!ramping || now - lastRampMicros < 1000) {
+    return;
+  }
+  lastRampMicros = now;
+  
+  // Only startMove() writes moveStartMicros, so loop() can read it directly
+  float speed = MOTION_START_SPEED + profile.accel * ((now - moveStartMicros) / 1000000.0);
+  if (speed >= profile.speed) {
+    speed = profile.speed;
+    ramping = false;
+  }
+  motor.setSpeed(movingDown ? -speed : speed);
+}
+
+void Elevator::applyProfile() {
+  motor.setMaxSpeed(profile.speed);  // setSpeed() clamps to this
+  writeMicrosteps(MOTOR1_MS1_PIN, MOTOR1_MS2_PIN, profile.microsteps);
+}
+
+bool Elevator::setProfile(const MotionProfile& p) {
+  if (isMoving()) {
+    pendingProfile = p;
+    profilePending = true;
+    return false;
+  }
+  profile = p;
+  profilePending = false;
+  applyProfile();
+  return true;
 }
 
 void Elevator::stop() {
   movingUp = false;
   movingDown = false;
+  ramping = false;
   motor.setSpeed(0);
-  Serial.println("ACCION:ELEVADOR_DETENIDO");
+  EventBus::post(EVENT_ACTION, EV_ELEVATOR_STOPPED);
 }
 
 void Elevator::run() {
   if (mode == MODE_REAL) {
-    // Real mode: check actual sensors
-    if (movingUp) {
+    // Real mode: the sensor ISR already halted the motor, finish the stop here
+    if (sensorHalt) {
+      noInterrupts();
+      unsigned long trip = tripMicros;
+      unsigned long halt = haltMicros;
+      sensorHalt = false;
+      interrupts();
+      
+      atTop = sensorTop;
+      atBottom = sensorBottom;
+      stop();
+      
+      // Sensor edge -> ISR halt, and sensor edge -> stop handled in loop()
+      unsigned long haltLatency = halt - trip;
+      unsigned long loopLatency = micros() - trip;
+      EventBus::post(EVENT_STATUS, EV_ELEVATOR_LATENCY,
+                     (long)(min(loopLatency, 0xFFFFUL) << 16 | min(haltLatency, 0xFFFFUL)));
+    } else if (movingUp) {
+      ramp();
       motor.runSpeed();
-      // Check real sensor or timeout
-      if (digitalRead(SENSOR_POS_ALTA_PIN) == HIGH || 
-          (millis() - moveStartTime > T_ELEV_UP)) {
+      // Fallback timeout if the sensor never trips
+      if (millis() - moveStartTime > T_ELEV_UP) {
         atTop = true;
         atBottom = false;
         stop();
       }
     } else if (movingDown) {
+      ramp();
       motor.runSpeed();
-      // Check real sensor or timeout
-      if (digitalRead(SENSOR_POS_BAJA_PIN) == HIGH || 
-          (millis() - moveStartTime > T_ELEV_DOWN)) {
+      if (millis() - moveStartTime > T_ELEV_DOWN) {
         atTop = false;
         atBottom = true;
         stop();
@@ -83,28 +195,22 @@ void Elevator::run() {
   } else {
     // Simulation/Test mode: use timers only
     if (movingUp) {
+      ramp();
       motor.runSpeed();
       if (millis() - moveStartTime > T_ELEV_UP) {
         atTop = true;
         atBottom = false;
         stop();
-        if (mode == MODE_TEST) {
-          Serial.println("TEST:ELEVATOR:UP");
-        } else {
-          Serial.println("ELEVADOR:ARRIBA");
-        }
+        EventBus::post(EVENT_STATUS, EV_ELEVATOR_TOP, mode == MODE_TEST);
       }
     } else if (movingDown) {
+      ramp();
       motor.runSpeed();
       if (millis() - moveStartTime > T_ELEV_DOWN) {
         atTop = false;
         atBottom = true;
         stop();
-        if (mode == MODE_TEST) {
-          Serial.println("TEST:ELEVATOR:DOWN");
-        } else {
-          Serial.println("ELEVADOR:ABAJO");
-        }
+        EventBus::post(EVENT_STATUS, EV_ELEVATOR_BOTTOM, mode == MODE_TEST);
       }
     }
   }
@@ -112,23 +218,89 @@ void Elevator::run() {
 
 bool Elevator::isAtTop() const {
   if (mode == MODE_REAL) {
-    return digitalRead(SENSOR_POS_ALTA_PIN) == HIGH;
+    return sensorTop;
   }
   return atTop;
 }
 
 bool Elevator::isAtBottom() const {
   if (mode == MODE_REAL) {
-    return digitalRead(SENSOR_POS_BAJA_PIN) == HIGH;
+    return sensorBottom;
   }
   return atBottom;
 }
 
+void Elevator::setMode(ControlMode m) {
+  // An enum is 16 bits on AVR and the sensor ISR reads it
+  noInterrupts();
+  mode = m;
+  interrupts();
+}
+
+void Elevator::sampleSensors() {
+  if (!sensorsReady) return;  // Not initialized yet
+  
+  unsigned long now = micros();
+  bool top = Pin<SENSOR_POS_ALTA_PIN>::read();
+  bool bottom = Pin<SENSOR_POS_BAJA_PIN>::read();
+  
+  // Debounce: accept a new level after SENSOR_DEBOUNCE_SAMPLES consecutive samples,
+  // remembering when the change was first seen
+  if (top != sensorTop) {
+    if (topCount == 0) topChangeMicros = now;
+    if (++topCount >= SENSOR_DEBOUNCE_SAMPLES) {
+      sensorTop = top;
+      topCount = 0;
+    }
+  } else {
+    topCount = 0;
+  }
+  
+  if (bottom != sensorBottom) {
+    if (bottomCount == 0) bottomChangeMicros = now;
+    if (++bottomCount >= SENSOR_DEBOUNCE_SAMPLES) {
+      sensorBottom = bottom;
+      bottomCount = 0;
+    }
+  } else {
+    bottomCount = 0;
+  }
+  
+  if (mode != MODE_REAL) return;
+  
+  // Halt immediately; run() only steps while a moving flag is set
+  if (movingUp && sensorTop) {
+    tripMicros = topChangeMicros;
+  } else if (movingDown && sensorBottom) {
+    tripMicros = bottomChangeMicros;
+  } else {
+    return;
+  }
+  if ((long)(tripMicros - moveStartMicros) < 0) {
+    tripMicros = now;  // Sensor was already active when the move started
+  }
+  movingUp = false;
+  movingDown = false;
+  haltMicros = now;
+  sensorHalt = true;
+}
+
+ISR(TIMER0_COMPA_vect) {
+#ifdef PROFILING
+  // Cycles since the compare match, Timer5 runs in step with Timer0 (Profiler::init)
+  Profiler::recordIsrLatency((TCNT5 - ((uint16_t)OCR0A << 6)) & (PROFILE_TIMER0_PERIOD - 1));
+#endif
+  elevator.sampleSensors();
+#ifdef HOST_RS485
+  host.poll();
+#endif
+}
+
 void Elevator::simulatePosition(bool top, bool bottom) {
   if (mode == MODE_SIMULATION) {
     // Prevent both positions being active at the same time
     if (top && bottom) {
-      Serial.println("ERROR:No se puede estar arriba y abajo simultaneamente");
+      host.println("ERROR:No se puede estar arriba y abajo simultaneamente");
       return;
     }
     atTop = top;
@@ -140,60 +312,242 @@ void Elevator::simulatePosition(bool top, bool bottom) {
 // DOSING WHEEL IMPLEMENTATION
 // =====================================================
 
-DosingWheel::DosingWheel() : motor(AccelStepper::DRIVER, MOTOR2_STEP_PIN, MOTOR2_DIR_PIN) {
+DosingWheel::DosingWheel() {
   dosingInProgress = false;
+  mode = MODE_SIMULATION;
+  homed = false;
+  homing = false;
+  dispenseAfterHome = false;
+  origin = 0;
+  homeLimit = 0;
+  indexLevel = false;
+  reindexCount = 0;
+  maxIndexError = 0;
+  lastIndexError = 0;
+  profile.speed = DOSING_MAX_SPEED;
+  profile.accel = DOSING_ACCELERATION;
+  profile.microsteps = MICROSTEPS;
+  pendingProfile = profile;
+  profilePending = false;
 }
 
 void DosingWheel::init() {
-  motor.setMaxSpeed(DOSING_MAX_SPEED);
-  motor.setAcceleration(DOSING_ACCELERATION);
+  Pin<DOSING_INDEX_PIN>::input();
+  indexLevel = readIndex();
   
   // Configure microstepping pins
   pinMode(MOTOR2_MS1_PIN, OUTPUT);
   pinMode(MOTOR2_MS2_PIN, OUTPUT);
-  digitalWrite(MOTOR2_MS1_PIN, HIGH);  // Half-stepping
-  digitalWrite(MOTOR2_MS2_PIN, LOW);
+  applyProfile();
+}
+
+void DosingWheel::applyProfile() {
+  motor.setMaxSpeed(profile.speed);
+  motor.setAcceleration(profile.accel);
+  writeMicrosteps(MOTOR2_MS1_PIN, MOTOR2_MS2_PIN, profile.microsteps);
+}
+
+bool DosingWheel::setProfile(const MotionProfile& p) {
+  if (dosingInProgress || motor.isRunning()) {
+    pendingProfile = p;
+    profilePending = true;
+    return false;
+  }
+  
+  // Keep the absolute model: positions are counted in microsteps
+  if (p.microsteps != profile.microsteps) {
+    motor.setCurrentPosition(motor.currentPosition() * p.microsteps / profile.microsteps);
+    origin = origin * p.microsteps / profile.microsteps;
+  }
+  profile = p;
+  profilePending = false;
+  applyProfile();
+  return true;
+}
+
+void DosingWheel::takePendingProfile() {
+  if (profilePending && !motor.isRunning()) {
+    setProfile(pendingProfile);
+  }
+}
+
+void DosingWheel::rotate(long steps) {
+  takePendingProfile();
+  startMove(motor.currentPosition() + steps);
+}
+
+// Floor modulo, motor positions can be negative
+static long wrapSteps(long steps, long period) {
+  long r = steps % period;
+  return r < 0 ? r + period : r;
+}
+
+long DosingWheel::pocketOffset(int pocket) const {
+  // Rounded per pocket so fractional pitches do not accumulate
+  return ((long)pocket * stepsPerRevolution() + wheel_divisions / 2) / wheel_divisions;
+}
+
+long DosingWheel::revolutionPosition() {
+  return wrapSteps(motor.currentPosition() - origin, stepsPerRevolution());
+}
+
+int DosingWheel::getPocket() {
+  long rev = stepsPerRevolution();
+  return ((revolutionPosition() * wheel_divisions + rev / 2) / rev) % wheel_divisions;
+}
+
+long DosingWheel::pocketTarget(int pocket, bool forwardOnly) {
+  long rev = stepsPerRevolution();
+  long delta = wrapSteps(pocketOffset(pocket) - revolutionPosition(), rev);
+  if (forwardOnly) {
+    if (delta == 0) delta = rev;
+  } else if (delta > rev / 2) {
+    delta -= rev;  // Shorter backwards
+  }
+  return motor.currentPosition() + delta;
+}
+
+bool DosingWheel::readIndex() const {
+  return Pin<DOSING_INDEX_PIN>::read() == (DOSING_INDEX_ACTIVE == HIGH);
+}
+
+void DosingWheel::startMove(long target) {
+  EventBus::post(EVENT_DEBUG, EV_DOSING_STEPS, target - motor.currentPosition());
+  motor.moveTo(target);
+  dosingInProgress = true;
 }
 
 void DosingWheel::dispenseOne() {
   // Only dispense if not already dispensing
   if (!dosingInProgress) {
-    // Calculate steps based on current wheel divisions
-    int stepsPerDivision = (STEPS_PER_REVOLUTION * MICROSTEPS) / wheel_divisions;
-    motor.move(stepsPerDivision);
-    dosingInProgress = true;
-    Serial.println("ACCION:DOSIFICANDO");
-    Serial.print("DEBUG:DOSING:STEPS:");
-    Serial.println(stepsPerDivision);
+    WeightTrace::trigger(TRACE_DOSING);
+    takePendingProfile();
+    EventBus::post(EVENT_ACTION, EV_DOSING_START);
+    if (!isReferenced()) {
+      dispenseAfterHome = true;
+      home();
+      return;
+    }
+    // Always forward, to the absolute position of the next pocket
+    startMove(pocketTarget((getPocket() + 1) % wheel_divisions, true));
   } else {
-    Serial.println("DEBUG:DOSING:ALREADY_IN_PROGRESS");
+    EventBus::post(EVENT_DEBUG, EV_DOSING_BUSY);
+  }
+}
+
+void DosingWheel::home() {
+  takePendingProfile();
+  if (mode != MODE_REAL) {
+    // No index sensor: take the current position as pocket 0
+    motor.stop();
+    origin = motor.currentPosition();
+    homed = true;
+    EventBus::post(EVENT_STATUS, EV_DOSING_REFERENCED);
+    return;
+  }
+  
+  // Slow forward search, at most 1.25 revolutions
+  homed = false;
+  homing = true;
+  indexLevel = readIndex();
+  homeLimit = motor.currentPosition() + stepsPerRevolution() + stepsPerRevolution() / 4;
+  motor.setMaxSpeed(min((unsigned int)DOSING_HOME_SPEED, profile.speed));
+  motor.moveTo(homeLimit);
+  dosingInProgress = true;
+  EventBus::post(EVENT_STATUS, EV_DOSING_SEARCHING);
+}
+
+bool DosingWheel::moveToPocket(int pocket) {
+  if (pocket < 0 || pocket >= wheel_divisions) {
+    return false;
+  }
+  takePendingProfile();
+  startMove(pocketTarget(pocket, false));
+  return true;
+}
+
+void DosingWheel::checkIndex() {
+  // Index edges only count on forward moves (the flag has width)
+  bool level = readIndex();
+  bool rising = level && !indexLevel;
+  indexLevel = level;
+  if (!rising || motor.distanceToGo() <= 0) {
+    return;
+  }
+  
+  long edge = motor.currentPosition();
+  if (homing) {
+    homing = false;
+    homed = true;
+    origin = edge + DOSING_INDEX_OFFSET;
+    motor.setMaxSpeed(profile.speed);
+    motor.moveTo(origin);  // Decelerate back onto pocket 0
+    EventBus::post(EVENT_STATUS, EV_DOSING_INDEX_FOUND, edge);
+    return;
+  }
+  
+  // Re-index on the fly: shift the model and the running target by the error
+  long rev = stepsPerRevolution();
+  long error = wrapSteps(edge + DOSING_INDEX_OFFSET - origin + rev / 2, rev) - rev / 2;
+  origin += error;
+  motor.moveTo(motor.targetPosition() + error);
+  lastIndexError = error;
+  reindexCount++;
+  if (abs(error) > maxIndexError) {
+    maxIndexError = abs(error);
+  }
+  if (abs(error) > DOSING_INDEX_TOLERANCE) {
+    EventBus::post(EVENT_STATUS, EV_DOSING_REINDEX, error);
   }
 }
 
 void DosingWheel::stop() {
   motor.stop();
   dosingInProgress = false;
+  dispenseAfterHome = false;
+  if (homing) {
+    homing = false;
+    motor.setMaxSpeed(profile.speed);
+  }
 }
 
 void DosingWheel::run() {
   motor.run();
+  if (mode == MODE_REAL && (homing || homed)) {
+    checkIndex();
+  }
+  
   if (dosingInProgress) {
     long remaining = motor.distanceToGo();
     if (remaining == 0) {
       dosingInProgress = false;
+      
+      if (homing) {
+        // Searched past a full revolution without seeing the flag
+        homing = false;
+        motor.setMaxSpeed(profile.speed);
+        dispenseAfterHome = false;
+        EventBus::post(EVENT_ERROR, EV_DOSING_NO_INDEX);
+        return;
+      }
+      if (dispenseAfterHome) {
+        dispenseAfterHome = false;
+        takePendingProfile();
+        startMove(pocketTarget((getPocket() + 1) % wheel_divisions, true));
+        return;
+      }
+      
       // Send completion message in test mode
       if (globalMode == MODE_TEST) {
-        Serial.println("TEST:DOSING:COMPLETE");
-        Serial.print("DEBUG:DOSING:POS:");
-        Serial.println(motor.currentPosition());
+        EventBus::post(EVENT_STATUS, EV_DOSING_COMPLETE);
+        EventBus::post(EVENT_DEBUG, EV_DOSING_POSITION, motor.currentPosition());
       }
     }
   }
 }
 
 void DosingWheel::updateStepsPerDivision() {
-  // This can be called when wheel_divisions changes
-  // No need to store it, we calculate on demand in dispenseOne()
+  // Pocket positions are derived from wheel_divisions on demand, nothing to cache
 }
 
 // =====================================================
@@ -208,31 +562,89 @@ LoadCell::LoadCell() {
   weightStableTime = 0;
   mode = MODE_SIMULATION;
   isReady = false;
+  sampleRate = HX711_SPS_DEFAULT;
+  gain = HX711_GAIN_DEFAULT;
+  calibrated = true;  // CALIBRATION_FACTOR_DEFAULT is for the default channel
+  streaming = false;
+  rawSum = 0;
+  rawIndex = 0;
+  rawFill = 0;
+  baseline = 0.0;
+  baselineSum = 0;
+  baselineCount = 0;
+  zeroBand = ZERO_TRACK_BAND_DEFAULT;
+  zeroCount = 0;
+  tareOffset = 0;
+  tareMillis = 0;
+  zeroCorrections = 0;
+  zeroLimitHit = false;
   simWeightStable = false;
+  simWeight = 0.0;
 }
 
 void LoadCell::init() {
+#if HX711_RATE_PIN >= 0
+  pinMode(HX711_RATE_PIN, OUTPUT);
+  digitalWrite(HX711_RATE_PIN, sampleRate == 80 ? HIGH : LOW);
+#endif
+
   // Commented out to prevent hanging
-  scale.begin(HX711_DOUT_PIN, HX711_SCK_PIN);
+  scale.begin(HX711_DOUT_PIN, HX711_SCK_PIN, gain);
   
   if (scale.is_ready()) {
     isReady = true;
     scale.set_scale(calibrationFactor);
     scale.tare();
-    Serial.println("ESCALA:ENCONTRADA");
+    resetZeroTracking();
+    host.println("ESCALA:ENCONTRADA");
   } else {
-    Serial.println("ESCALA:NO_ENCONTRADA");
+    host.println("ESCALA:NO_ENCONTRADA");
   }
   // isReady = false;
-  // Serial.println("ESCALA:DESHABILITADA");
+  // host.println("ESCALA:DESHABILITADA");
 }
 
 float LoadCell::readWeight() {
+  if (streaming) {
+    return (mode != MODE_SIMULATION && isReady) ? currentWeight : 0.0;
+  }
   if (mode == MODE_REAL && isReady) {
-    currentWeight = scale.get_units(10);  // Average of 10 readings
+    currentWeight = scale.get_units(WEIGHT_FILTER_SAMPLES);  // Averaged over the filter window
     return currentWeight;
   }
-  return 0.0;  // Simulation mode or not ready returns 0
+  if (mode == MODE_SIMULATION) {
+    currentWeight = simWeight;  // 0 unless a replay feeds samples
+    return simWeight;
+  }
+  return 0.0;  // Not ready returns 0
+}
+
+void LoadCell::setStreaming(bool on) {
+  streaming = on;
+  rawSum = 0;
+  rawIndex = 0;
+  rawFill = 0;
+}
+
+bool LoadCell::pollRaw(long& raw) {
+  // Test mode streams the real scale too (script WAIT WEIGHT STABLE)
+  if (mode == MODE_SIMULATION || !isReady || !scale.is_ready()) {
+    return false;
+  }
+  raw = scale.read();
+  
+  // Boxcar over the same window get_units() averages
+  if (rawFill == WEIGHT_FILTER_SAMPLES) {
+    rawSum -= rawWindow[rawIndex];
+  } else {
+    rawFill++;
+  }
+  rawWindow[rawIndex] = raw;
+  rawSum += raw;
+  rawIndex = (rawIndex + 1) % WEIGHT_FILTER_SAMPLES;
+  
+  currentWeight = ((float)rawSum / rawFill - scale.get_offset()) / scale.get_scale();
+  return true;
 }
 
 bool LoadCell::isWeightStable() {
@@ -245,7 +657,7 @@ bool LoadCell::isWeightStable() {
   float weightDiff = abs(currentWeight - lastStableWeight);
   
   if (weightDiff < WEIGHT_TOLERANCE) {
-    if (millis() - weightStableTime > WEIGHT_STABLE_TIME) {
+    if (millis() - weightStableTime > getStableWindow()) {
       return true;
     }
   } else {
@@ -256,71 +668,304 @@ bool LoadCell::isWeightStable() {
   return false;
 }
 
+void LoadCell::restartStability() {
+  lastStableWeight = currentWeight;
+  weightStableTime = millis();
+}
+
+void LoadCell::startBaseline() {
+  baseline = 0.0;  // Tared zero if no conversion arrives before the drop
+  baselineSum = 0;
+  baselineCount = 0;
+}
+
+void LoadCell::pollBaseline() {
+  if (mode != MODE_REAL || !isReady || baselineCount >= BASELINE_SAMPLES) return;
+  
+  if (streaming) {
+    // A dosing trace owns the conversions, take its mean while it is short
+    if (rawFill > 0 && rawFill <= BASELINE_SAMPLES) baseline = currentWeight;
+    return;
+  }
+  if (!scale.is_ready()) return;
+  
+  baselineSum += scale.read();
+  baselineCount++;
+  baseline = ((float)baselineSum / baselineCount - scale.get_offset()) / scale.get_scale();
+}
+
+bool LoadCell::isBaselineReady() const {
+  return mode != MODE_REAL || !isReady || streaming || baselineCount >= BASELINE_SAMPLES;
+}
+
 void LoadCell::tare() {
   if (isReady) {
     scale.tare();
-    Serial.println("ESCALA:TARA");
+    resetZeroTracking();
+    host.println("ESCALA:TARA");
   }
 }
 
 void LoadCell::calibrate(float knownWeight) {
   if (isReady && knownWeight > 0) {
-    float reading = scale.get_units(10);
+    float reading = scale.get_units(WEIGHT_FILTER_SAMPLES);
     calibrationFactor = reading / knownWeight;
     scale.set_scale(calibrationFactor);
-    Serial.print("ESCALA:CALIBRADA:");
-    Serial.println(calibrationFactor);
+    calibrated = true;
+    host.print("ESCALA:CALIBRADA:");
+    host.println(calibrationFactor);
+  }
+}
+
+bool LoadCell::setSampleRate(uint8_t sps) {
+  if (sps != 10 && sps != 80) return false;
+  
+#if HX711_RATE_PIN >= 0
+  digitalWrite(HX711_RATE_PIN, sps == 80 ? HIGH : LOW);
+#endif
+  // Without a RATE pin this only declares how the board is strapped
+  sampleRate = sps;
+  weightStableTime = millis();  // Restart stability window at the new rate
+  
+  if (isReady) {
+    scale.read();  // Discard the conversion taken at the old rate
   }
+  return true;
+}
+
+bool LoadCell::setGain(uint8_t g) {
+  if (g != 128 && g != 64 && g != 32) return false;
+  
+  // Counts per gram follow the gain, keep grams in grams. Channel B is a
+  // different input, the scaled factor is only a guess until recalibrated.
+  if ((gain == 32) != (g == 32)) {
+    calibrated = false;
+  }
+  calibrationFactor = calibrationFactor * g / gain;
+  gain = g;
+  weightStableTime = millis();
+  
+  if (isReady) {
+    // Gain/channel is latched on the next conversion, then re-zero
+    scale.set_scale(calibrationFactor);
+    scale.set_gain(gain);
+    scale.tare(WEIGHT_FILTER_SAMPLES);
+    resetZeroTracking();
+  }
+  return true;
+}
+
+void LoadCell::resetZeroTracking() {
+  tareOffset = scale.get_offset();
+  tareMillis = millis();
+  zeroCount = 0;
+  zeroCorrections = 0;
+  zeroLimitHit = false;
+}
+
+bool LoadCell::trackZero(bool idle) {
+  if (!isZeroTracking()) {
+    zeroCount = 0;
+    return false;
+  }
+  if (!idle || !scale.is_ready()) return false;
+  
+  long raw = scale.read();
+  if (zeroCount == 0) {
+    zeroSum = 0;
+    zeroMin = raw;
+    zeroMax = raw;
+  }
+  zeroSum += raw;
+  if (raw < zeroMin) zeroMin = raw;
+  if (raw > zeroMax) zeroMax = raw;
+  if (++zeroCount < ZERO_TRACK_SAMPLES) return true;
+  zeroCount = 0;
+  
+  // A window that moved more than the stability tolerance saw vibration,
+  // one outside the band has something on the pan
+  float countsPerGram = abs(scale.get_scale());
+  long error = zeroSum / ZERO_TRACK_SAMPLES - scale.get_offset();
+  if ((zeroMax - zeroMin) / countsPerGram > WEIGHT_TOLERANCE ||
+      abs(error) / countsPerGram > zeroBand) {
+    return true;
+  }
+  
+  long offset = scale.get_offset() + error / ZERO_TRACK_DIVISOR;
+  if (abs(offset - tareOffset) / countsPerGram > ZERO_TRACK_LIMIT) {
+    if (!zeroLimitHit) {
+      zeroLimitHit = true;
+      EventBus::post(EVENT_STATUS, EV_ZERO_LIMIT);
+    }
+    return true;
+  }
+  if (offset != scale.get_offset()) {
+    scale.set_offset(offset);
+    zeroCorrections++;
+  }
+  return true;
+}
+
+float LoadCell::getZeroDrift() {
+  return (scale.get_offset() - tareOffset) / scale.get_scale();
+}
+
+float LoadCell::getZeroDriftRate() {
+  unsigned long elapsed = millis() - tareMillis;
+  if (elapsed == 0) return 0.0;
+  return getZeroDrift() * 1000.0 * 3600000.0 / elapsed;
 }
 
 // =====================================================
 // GRINDER IMPLEMENTATION
 // =====================================================
 
-void Grinder::init() {
-  pinMode(MOTOR3_RELAY_PIN, OUTPUT);
-  digitalWrite(MOTOR3_RELAY_PIN, LOW);
+template <uint8_t RELAY_PIN>
+void Grinder<RELAY_PIN>::init() {
+  Pin<RELAY_PIN>::output();
+  Pin<RELAY_PIN>::clear();
   running = false;
 }
 
-void Grinder::start() {
-  digitalWrite(MOTOR3_RELAY_PIN, HIGH);
+template <uint8_t RELAY_PIN>
+void Grinder<RELAY_PIN>::start() {
+  Pin<RELAY_PIN>::set();
   running = true;
-  Serial.println("ACCION:MOLIENDO");
+  EventBus::post(EVENT_ACTION, EV_GRINDER_ON);
 }
 
-void Grinder::stop() {
-  digitalWrite(MOTOR3_RELAY_PIN, LOW);
+template <uint8_t RELAY_PIN>
+void Grinder<RELAY_PIN>::stop() {
+  Pin<RELAY_PIN>::clear();
   running = false;
-  Serial.println("ACCION:MOLEDOR_DETENIDO");
+  EventBus::post(EVENT_ACTION, EV_GRINDER_OFF);
 }
 
+template class Grinder<MOTOR3_RELAY_PIN>;
+
 // =====================================================
 // SOLENOID IMPLEMENTATION
 // =====================================================
 
-void Solenoid::init() {
-  pinMode(pin, OUTPUT);
-  digitalWrite(pin, LOW);
+template <uint8_t PIN>
+Solenoid<PIN>::Solenoid(const char* n) : name(n) {
+  active = false;
+  holding = false;
+  activeSince = 0;
+  pullInTime = SOLENOID_PULL_IN_DEFAULT;
+  holdDuty = (uint16_t)SOLENOID_HOLD_DUTY_DEFAULT * 255 / 100;
+  lastAccount = 0;
+  windowStart = 0;
+  windowEnergy = 0;
+  totalEnergy = 0;
+  lastWindowDuty = 0;
+}
+
+template <uint8_t PIN>
+void Solenoid<PIN>::init() {
+  Pin<PIN>::output();
+  Pin<PIN>::clear();
   active = false;
+  holding = false;
+  
+#if defined(__AVR_ATmega2560__)
+  // Prescaler 1 puts the hold PWM at ~31 kHz instead of an audible ~490 Hz.
+  // Timer2 drives pins 9/10 and Timer1 pins 11/12; Timer0 (millis) is untouched.
+  if (PIN == 9 || PIN == 10) {
+    TCCR2B = (TCCR2B & 0xF8) | 0x01;
+  } else if (PIN == 11 || PIN == 12) {
+    TCCR1B = (TCCR1B & 0xF8) | 0x01;
+  }
+#endif
+  
+  lastAccount = millis();
+  windowStart = lastAccount;
 }
 
-void Solenoid::activate() {
-  digitalWrite(pin, HIGH);
+template <uint8_t PIN>
+void Solenoid<PIN>::activate() {
+  account(millis());
+  // Strike at full current; PWM is only connected during the hold phase
+  if (holding) {
+    analogWrite(PIN, 255);
+  } else {
+    Pin<PIN>::set();
+  }
   active = true;
-  Serial.print("ACCION:");
-  Serial.print(name);
-  Serial.println("_ACTIVADO");
+  holding = false;
+  activeSince = millis();
+  EventBus::post(EVENT_ACTION, EV_SOLENOID_ON, PIN);
 }
 
-void Solenoid::deactivate() {
-  digitalWrite(pin, LOW);
+template <uint8_t PIN>
+void Solenoid<PIN>::deactivate() {
+  account(millis());
+  if (holding) {
+    analogWrite(PIN, 0);  // Also disconnects the timer output
+  } else {
+    Pin<PIN>::clear();
+  }
   active = false;
-  Serial.print("ACCION:");
-  Serial.print(name);
-  Serial.println("_DESACTIVADO");
+  holding = false;
+  EventBus::post(EVENT_ACTION, EV_SOLENOID_OFF, PIN);
+}
+
+template <uint8_t PIN>
+void Solenoid<PIN>::run() {
+  unsigned long now = millis();
+  
+  // Pull-in done: drop to the hold duty cycle
+  if (active && !holding && holdDuty < 255 && now - activeSince >= pullInTime) {
+    account(now);
+    analogWrite(PIN, holdDuty);
+    holding = true;
+  }
+  
+  account(now);
+}
+
+template <uint8_t PIN>
+void Solenoid<PIN>::setStrikeHold(unsigned long pullInMs, uint8_t holdPercent) {
+  if (holdPercent > 100) holdPercent = 100;
+  pullInTime = pullInMs;
+  holdDuty = (uint16_t)holdPercent * 255 / 100;
+  
+  // Apply to a coil that is already holding
+  if (holding) {
+    account(millis());
+    if (holdDuty == 255) {
+      analogWrite(PIN, 255);
+      holding = false;
+    } else {
+      analogWrite(PIN, holdDuty);
+    }
+  }
+}
+
+template <uint8_t PIN>
+uint16_t Solenoid<PIN>::currentPower() const {
+  if (!active) return 0;
+  if (!holding) return 1000;
+  // Coil current follows the duty cycle, so power follows its square
+  return (unsigned long)holdDuty * holdDuty * 1000 / (255UL * 255UL);
 }
 
+template <uint8_t PIN>
+void Solenoid<PIN>::account(unsigned long now) {
+  windowEnergy += (now - lastAccount) * currentPower();
+  lastAccount = now;
+  
+  if (now - windowStart >= SOLENOID_DUTY_WINDOW) {
+    lastWindowDuty = windowEnergy / (now - windowStart) / 10;
+    totalEnergy += windowEnergy / 1000;
+    windowEnergy = 0;
+    windowStart = now;
+  }
+}
+
+template class Solenoid<SOLENOID1_PIN>;
+template class Solenoid<SOLENOID2_PIN>;
+
 // =====================================================
 // INPUT SYSTEM IMPLEMENTATION
 // =====================================================
@@ -365,9 +1010,9 @@ bool InputSystem::isPastillasCargadas() const {
 void setGlobalMode(ControlMode mode) {
   globalMode = mode;
   elevator.setMode(mode);
+  dosingWheel.setMode(mode);
   loadCell.setMode(mode);
   inputs.setMode(mode);
   
-  Serial.print("MODO:");
-  Serial.println(mode == MODE_REAL ? "REAL" : "SIMULACION");
+  EventBus::post(EVENT_STATUS, EV_MODE, mode);
 }
\ No newline at end of file
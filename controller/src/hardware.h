@@ -5,6 +5,7 @@
 #include <AccelStepper.h>
 #include <HX711.h>
 #include "config.h"
+#include "fast_pin.h"
 
 // =====================================================
 // HARDWARE CONTROL MODES
@@ -16,20 +17,57 @@ enum ControlMode {
   MODE_TEST  // Test mode for manual hardware control
 };
 
+// =====================================================
+// MOTION PROFILES
+// =====================================================
+
+// Changes requested during a move are held and applied before the next one
+struct MotionProfile {
+  unsigned int speed;   // Cruise speed (steps/s)
+  unsigned int accel;   // Acceleration (steps/s^2), 0 = start at full speed (elevator)
+  uint8_t microsteps;   // Driver microstepping: 1, 2, 4 or 8 (MS1/MS2)
+};
+
+bool isValidMotionProfile(const MotionProfile& profile);
+
 // =====================================================
 // ELEVATOR MODULE
 // =====================================================
 
 class Elevator {
 private:
-  AccelStepper motor;
-  bool movingUp;
-  bool movingDown;
+  FastStepper<MOTOR1_STEP_PIN, MOTOR1_DIR_PIN> motor;
+  volatile bool movingUp;    // Cleared from the sensor ISR to halt the motor
+  volatile bool movingDown;
   bool atTop;
   bool atBottom;
-  ControlMode mode;
+  volatile ControlMode mode;     // Read by the sensor ISR
   unsigned long moveStartTime;
   
+  // Limit sensors, sampled from the Timer0 compare ISR (A2/A3 have no pin-change interrupt on the Mega)
+  bool sensorsReady;
+  volatile bool sensorTop;       // Debounced sensor levels
+  volatile bool sensorBottom;
+  volatile uint8_t topCount;
+  volatile uint8_t bottomCount;
+  unsigned long topChangeMicros;  // ISR-only: when the pending level change started
+  unsigned long bottomChangeMicros;
+  volatile bool sensorHalt;      // Set when the ISR halted a move
+  volatile unsigned long moveStartMicros;  // Written with interrupts off, read by the ISR
+  volatile unsigned long tripMicros;
+  volatile unsigned long haltMicros;
+  
+  // Motion profile (constant-speed moves with a linear start ramp)
+  MotionProfile profile;
+  MotionProfile pendingProfile;
+  bool profilePending;
+  bool ramping;
+  unsigned long lastRampMicros;
+  
+  void applyProfile();
+  void startMove(bool up);
+  void ramp();
+  
 public:
   Elevator();
   void init();
@@ -42,8 +80,13 @@ public:
   bool isAtBottom() const;
   bool isMoving() const { return movingUp || movingDown; }
   
-  void setMode(ControlMode m) { mode = m; }
+  void setMode(ControlMode m);
   void simulatePosition(bool top, bool bottom);
+  
+  void sampleSensors();  // Called from ISR
+  
+  bool setProfile(const MotionProfile& p);  // False if deferred until the move ends
+  const MotionProfile& getProfile() const { return profilePending ? pendingProfile : profile; }
 };
 
 // =====================================================
@@ -52,8 +95,34 @@ public:
 
 class DosingWheel {
 private:
-  AccelStepper motor;
+  FastStepper<MOTOR2_STEP_PIN, MOTOR2_DIR_PIN> motor;
   bool dosingInProgress;
+  ControlMode mode;
+  
+  // Absolute position: pocket p sits under the chute at
+  // origin + p * stepsPerRevolution / wheel_divisions (mod one revolution)
+  bool homed;
+  bool homing;
+  bool dispenseAfterHome;
+  long origin;          // Motor position of pocket 0
+  long homeLimit;       // Give up homing past this position
+  bool indexLevel;      // Last index sensor level, for edge detection
+  unsigned int reindexCount;
+  long maxIndexError;
+  long lastIndexError;
+  
+  MotionProfile profile;
+  MotionProfile pendingProfile;
+  bool profilePending;
+  
+  void applyProfile();
+  void takePendingProfile();
+  long pocketOffset(int pocket) const;
+  long revolutionPosition();  // Steps past pocket 0, 0..rev-1
+  long pocketTarget(int pocket, bool forwardOnly);
+  bool readIndex() const;
+  void startMove(long target);
+  void checkIndex();
   
 public:
   DosingWheel();
@@ -63,6 +132,22 @@ public:
   void run();  // Call in loop
   bool isDispensing() const { return dosingInProgress; }
   void updateStepsPerDivision();  // Recalculate steps based on wheel_divisions
+  
+  // Absolute positioning
+  void setMode(ControlMode m) { mode = m; }
+  void home();
+  bool moveToPocket(int pocket);  // Shortest path, false if out of range
+  bool isReferenced() const { return homed || mode != MODE_REAL; }
+  int getPocket();
+  long getStepInRevolution() { return revolutionPosition(); }
+  unsigned int getReindexCount() const { return reindexCount; }
+  long getMaxIndexError() const { return maxIndexError; }
+  long getLastIndexError() const { return lastIndexError; }
+  long stepsPerRevolution() const { return (long)STEPS_PER_REVOLUTION * profile.microsteps; }
+  void rotate(long steps);  // Relative move, used by the motion sweep
+  
+  bool setProfile(const MotionProfile& p);  // False if deferred until the move ends
+  const MotionProfile& getProfile() const { return profilePending ? pendingProfile : profile; }
 };
 
 // =====================================================
@@ -79,28 +164,103 @@ private:
   unsigned long weightStableTime;
   ControlMode mode;
   bool isReady;
+  uint8_t sampleRate;  // Samples per second (10 or 80)
+  uint8_t gain;        // 128/64 = channel A, 32 = channel B
+  bool calibrated;     // False after a channel switch until SCALE:CAL
+  
+  // Non-blocking sampling while a trace is captured
+  bool streaming;
+  long rawWindow[WEIGHT_FILTER_SAMPLES];
+  long rawSum;
+  uint8_t rawIndex;
+  uint8_t rawFill;
+  
+  // Empty-pan reading taken while the wheel turns, pills are weighed against it
+  float baseline;
+  long baselineSum;
+  uint8_t baselineCount;
+  
+  // Auto-zero tracking
+  float zeroBand;
+  long zeroSum;
+  long zeroMin;
+  long zeroMax;
+  uint8_t zeroCount;
+  long tareOffset;          // Offset at the last tare, drift is measured from it
+  unsigned long tareMillis;
+  unsigned int zeroCorrections;
+  bool zeroLimitHit;
+  
+  void resetZeroTracking();
   
   // Simulation variables
   bool simWeightStable;
+  float simWeight;  // Reading returned in simulation (replayed REC:P samples)
   
 public:
   LoadCell();
   void init();
   float readWeight();
+  float getWeight() const { return currentWeight; }  // Last readWeight() result
+  
+  // Raw access: while streaming, readWeight() returns the mean of the last
+  // WEIGHT_FILTER_SAMPLES conversions fed through pollRaw() instead of blocking
+  void setStreaming(bool on);
+  bool isStreaming() const { return streaming; }
+  bool pollRaw(long& raw);  // One conversion if the HX711 has one ready
+  long getOffset() { return scale.get_offset(); }
+  float getScale() { return scale.get_scale(); }
   bool isWeightStable();
+  void restartStability();  // Stability window starts again from the current reading
+  
+  // Differential weighing: the pill is the delta over the baseline
+  void startBaseline();
+  void pollBaseline();  // Call while the wheel turns, never blocks
+  bool isBaselineReady() const;  // All samples in, or none will come (no scale, simulation, trace)
+  float getBaseline() const { return baseline; }
+  float getDelta() const { return currentWeight - baseline; }
+  
   void tare();
   void calibrate(float knownWeight);
   
+  // Auto-zero: every ZERO_TRACK_SAMPLES conversions taken while idle (pan
+  // empty, nothing moving) the offset moves toward the measured zero, if the
+  // window was steady and within the band. Motion pauses the window, so it
+  // also fills from the short pauses between pills. Call in loop, it never
+  // blocks; true when it took a conversion.
+  bool trackZero(bool idle);
+  bool isZeroTracking() const { return mode == MODE_REAL && isReady && !streaming && zeroBand > 0; }
+  void setZeroBand(float band) { zeroBand = band; }
+  float getZeroBand() const { return zeroBand; }
+  float getZeroDrift();      // Offset change since the last tare (g)
+  float getZeroDriftRate();  // mg per hour since the last tare
+  unsigned int getZeroCorrections() const { return zeroCorrections; }
+  
+  // Sampling configuration
+  bool setSampleRate(uint8_t sps);
+  bool setGain(uint8_t g);
+  uint8_t getSampleRate() const { return sampleRate; }
+  uint8_t getGain() const { return gain; }
+  char getChannel() const { return gain == 32 ? 'B' : 'A'; }
+  bool isCalibrated() const { return calibrated; }
+  unsigned long getSamplePeriodMicros() const { return 1000000UL / sampleRate; }
+  // In us first: 1000 / 80 would truncate to 12 ms and give 120 ms instead of 125
+  unsigned long getStableWindow() const { return WEIGHT_STABLE_SAMPLES * getSamplePeriodMicros() / 1000; }
+  
   void setMode(ControlMode m) { mode = m; }
   void setThreshold(float t) { weightThreshold = t; }
+  float getThreshold() const { return weightThreshold; }
   void simulateWeight(bool stable) { simWeightStable = stable; }
+  void simulateReading(float weight) { simWeight = weight; currentWeight = weight; }
   bool isConnected() const { return isReady; }
+  bool isMeasuring() const { return mode == MODE_REAL && isReady; }  // Readings come from the HX711
 };
 
 // =====================================================
 // GRINDER MODULE
 // =====================================================
 
+template <uint8_t RELAY_PIN>
 class Grinder {
 private:
   bool running;
@@ -116,18 +276,41 @@ public:
 // SOLENOID MODULE
 // =====================================================
 
+template <uint8_t PIN>
 class Solenoid {
 private:
-  uint8_t pin;
   const char* name;
   bool active;
+  bool holding;
+  unsigned long activeSince;
+  unsigned long pullInTime;
+  uint8_t holdDuty;  // PWM value 0-255 for the hold phase
+  
+  // Energy/duty tracking, in ms x per-mille of full coil power
+  unsigned long lastAccount;
+  unsigned long windowStart;
+  unsigned long windowEnergy;
+  unsigned long totalEnergy;  // Full-power equivalent ms
+  uint8_t lastWindowDuty;     // % of full power over the last completed window
+  
+  uint16_t currentPower() const;
+  void account(unsigned long now);
   
 public:
-  Solenoid(uint8_t p, const char* n) : pin(p), name(n), active(false) {}
+  Solenoid(const char* n);
   void init();
   void activate();
   void deactivate();
+  void run();  // Call in loop
   bool isActive() const { return active; }
+  bool isHolding() const { return holding; }
+  
+  void setStrikeHold(unsigned long pullInMs, uint8_t holdPercent);
+  unsigned long getPullInTime() const { return pullInTime; }
+  uint8_t getHoldPercent() const { return (uint16_t)holdDuty * 100 / 255; }
+  uint8_t getDutyPercent() const { return lastWindowDuty; }
+  unsigned long getEnergy() const { return totalEnergy + windowEnergy / 1000; }
+  const char* getName() const { return name; }
 };
 
 // =====================================================
@@ -177,9 +360,9 @@ public:
 extern Elevator elevator;
 extern DosingWheel dosingWheel;
 extern LoadCell loadCell;
-extern Grinder grinder;
-extern Solenoid transferSolenoid;
-extern Solenoid capSolenoid;
+extern Grinder<MOTOR3_RELAY_PIN> grinder;
+extern Solenoid<SOLENOID1_PIN> transferSolenoid;
+extern Solenoid<SOLENOID2_PIN> capSolenoid;
 extern InputSystem inputs;
 
 // Global control mode
@@ -0,0 +1,383 @@
+#include "host_link.h"
+#include "mem_stats.h"
+#include <EEPROM.h>
+
+#ifdef HOST_RS485
+HostLink host(Serial1);
+#else
+HostLink host(Serial);
+#endif
+
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
+
+HostLink::HostLink(HardwareSerial& p) : port(p) {
+  deviceId = 0;
+  lineStart = true;
+  metaEnabled = EVENT_META_DEFAULT;
+  metaWritten = false;
+  sequence = 0;
+  lineMillis = 0;
+  muted = false;
+  watching = false;
+  headLen = 0;
+  reason[0] = '\0';
+#ifdef HOST_RS485
+  rxHead = 0;
+  rxTail = 0;
+  frameStart = 0;
+  queueHead = 0;
+  queueComplete = 0;
+  lineBegin = 0;
+  lineDropped = false;
+  dropped = 0;
+  sendPos = 0;
+  sendEnd = 0;
+  nextEnd = 0;
+  nextLength = 0;
+  driverOn = false;
+  releaseTicks = 0;
+#endif
+}
+
+void HostLink::begin(unsigned long baud) {
+#ifdef HOST_RS485
+  pinMode(RS485_DE_PIN, OUTPUT);
+  digitalWrite(RS485_DE_PIN, LOW);  // Listen
+#endif
+  port.begin(baud);
+}
+
+// =====================================================
+// ADDRESSING
+// =====================================================
+
+void HostLink::loadDeviceId() {
+  uint8_t id = EEPROM.read(DEVICE_ID_EEPROM_ADDR);
+  deviceId = (id == 0xFF) ? 0 : id;  // Erased EEPROM: addressing off
+}
+
+void HostLink::setDeviceId(uint8_t id) {
+  deviceId = id;
+  EEPROM.update(DEVICE_ID_EEPROM_ADDR, id);
+}
+
+bool HostLink::accept(String& command) {
+  if (!command.startsWith("@")) {
+    return true;  // Unaddressed: every node on the link takes it
+  }
+  
+  int colonIdx = command.indexOf(':');
+  if (colonIdx < 2) {
+    return false;
+  }
+  
+  String target = command.substring(1, colonIdx);
+  bool forUs = target == "*" || (deviceId != 0 && target.toInt() == deviceId);
+  command = command.substring(colonIdx + 1);
+  return forUs;
+}
+
+// =====================================================
+// STREAM
+// =====================================================
+
+#ifdef HOST_RS485
+
+int HostLink::available() {
+  return (uint8_t)(rxHead - rxTail + BUS_RX_BUFFER) % BUS_RX_BUFFER;
+}
+
+int HostLink::read() {
+  if (rxTail == rxHead) {
+    return -1;
+  }
+  uint8_t c = rxRing[rxTail];
+  rxTail = (rxTail + 1) % BUS_RX_BUFFER;
+  return c;
+}
+
+int HostLink::peek() {
+  return rxTail == rxHead ? -1 : rxRing[rxTail];
+}
+
+#else
+
+int HostLink::available() {
+  return port.available();
+}
+
+int HostLink::read() {
+  return port.read();
+}
+
+int HostLink::peek() {
+  return port.peek();
+}
+
+#endif
+
+void HostLink::flush() {
+  if (muted) {
+    return;
+  }
+  // On the bus queued lines still wait for the slot, only the UART is flushed
+  port.flush();
+}
+
+int HostLink::availableForWrite() {
+  return port.availableForWrite();
+}
+
+int HostLink::rxFree() {
+  // The ring buffers keep one slot empty
+#ifdef HOST_RS485
+  return BUS_RX_BUFFER - 1 - available() + SERIAL_RX_BUFFER_SIZE - 1 - port.available();
+#else
+  return SERIAL_RX_BUFFER_SIZE - 1 - port.available();
+#endif
+}
+
+// =====================================================
+// COMMAND REPLIES
+// =====================================================
+
+void HostLink::beginReply() {
+  watching = true;
+  headLen = 0;
+  reason[0] = '\0';
+}
+
+const char* HostLink::endReply() {
+  watching = false;
+  return reason;
+}
+
+void HostLink::checkErrorLine() {
+  if (reason[0] != '\0') {
+    return;  // Keep the first error
+  }
+  head[headLen] = '\0';
+  
+  const char* text;
+  if (strncmp(head, "ERROR:", 6) == 0) {
+    text = head + 6;
+  } else if (strncmp(head, "UNKNOWN:", 8) == 0) {
+    text = "COMANDO_DESCONOCIDO";
+  } else {
+    return;
+  }
+  
+  while (*text == ' ') text++;
+  strncpy(reason, text, REPLY_REASON_MAX);
+  reason[REPLY_REASON_MAX] = '\0';
+  if (reason[0] == '\0') {
+    strcpy(reason, "ERROR");
+  }
+}
+
+size_t HostLink::write(uint8_t c) {
+  if (muted) {
+    return 1;
+  }
+  if (lineStart) {
+    lineStart = false;
+    lineMillis = millis();
+    MemStats::sample();  // Catch heap peaks of the code that prints
+    headLen = 0;
+#ifdef HOST_RS485
+    lineBegin = queueHead;
+    lineDropped = false;
+#endif
+    if (deviceId != 0) {
+      emit('@');
+      if (deviceId >= 100) emit('0' + deviceId / 100);
+      if (deviceId >= 10) emit('0' + (deviceId / 10) % 10);
+      emit('0' + deviceId % 10);
+      emit(':');
+    }
+  }
+  
+  bool terminator = c == '\r' || c == '\n';
+  if (watching) {
+    if (!terminator && headLen < sizeof(head) - 1) {
+      head[headLen++] = c;
+    } else if (terminator && headLen > 0) {
+      checkErrorLine();
+      headLen = 0;
+    }
+  }
+  
+  // Metadata goes before the terminator, "\r\n" or a bare "\n"
+  if (terminator && metaEnabled && !metaWritten) {
+    emitMeta();
+    metaWritten = true;
+  }
+  
+  emit(c);
+  if (c == '\n') {
+    lineStart = true;
+    metaWritten = false;
+  }
+  return 1;
+}
+
+void HostLink::emitMeta() {
+  emit('|');
+  emitNumber(sequence++);
+  emit(',');
+  emitNumber(lineMillis);
+}
+
+void HostLink::emitNumber(unsigned long n) {
+  char digits[10];
+  uint8_t count = 0;
+  do {
+    digits[count++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  while (count > 0) {
+    emit(digits[--count]);
+  }
+}
+
+#ifdef HOST_RS485
+
+uint16_t HostLink::sendPosNow() {
+  noInterrupts();
+  uint16_t pos = sendPos;
+  interrupts();
+  return pos;
+}
+
+void HostLink::emit(uint8_t c) {
+  if (lineDropped) {
+    return;
+  }
+  uint16_t used = (queueHead + BUS_TX_QUEUE - sendPosNow()) % BUS_TX_QUEUE;
+  uint16_t length = (queueHead + BUS_TX_QUEUE - lineBegin) % BUS_TX_QUEUE;
+  if (used >= BUS_TX_QUEUE - 1 || length >= BUS_LINE_MAX) {
+    // No room, or too long for any slot: drop the whole line, never block
+    queueHead = lineBegin;
+    lineDropped = true;
+    dropped++;
+    return;
+  }
+  queue[queueHead] = c;
+  queueHead = (queueHead + 1) % BUS_TX_QUEUE;
+  if (c == '\n') {
+    // Whole line: poll() may send it from now on
+    noInterrupts();
+    queueComplete = queueHead;
+    interrupts();
+  }
+}
+
+void HostLink::run() {
+  // Lines lost since the last report, as soon as the report fits
+  uint16_t used = (queueHead + BUS_TX_QUEUE - sendPosNow()) % BUS_TX_QUEUE;
+  if (dropped > 0 && lineStart && BUS_TX_QUEUE - 1 - used >= BUS_REPORT_ROOM) {
+    uint16_t count = dropped;
+    dropped = 0;
+    print(F("BUS:DESCARTADAS:"));
+    println(count);
+  }
+}
+
+bool HostLink::fitsInSlot(uint16_t length) {
+  // The frame starts a slot after the host line: a node may still be
+  // finishing a line it started in the old frame
+  unsigned long age = millis() - frameStart;
+  if (age < BUS_SLOT_MS) {
+    return false;
+  }
+  unsigned long position = (age - BUS_SLOT_MS) % ((unsigned long)BUS_SLOT_MS * BUS_NODES);
+  unsigned long slotStart = (unsigned long)(deviceId % BUS_NODES) * BUS_SLOT_MS;
+  if (position < slotStart || position >= slotStart + BUS_SLOT_MS) {
+    return false;
+  }
+  
+  // Bytes still in the UART plus the line must be out before the guard
+  // time, which grows as this clock and the neighbours' drift apart since
+  // the host line; one extra ms covers the millis() resolution
+  unsigned long drift = age / (1000000UL / (2 * BUS_CLOCK_PPM));
+  unsigned long bytes = SERIAL_TX_BUFFER_SIZE - 1 - port.availableForWrite() + length;
+  unsigned long needed = (bytes * 10000UL + HOST_BAUD - 1) / HOST_BAUD + 1;
+  return position + needed + drift + BUS_GUARD_MS <= slotStart + BUS_SLOT_MS;
+}
+
+void HostLink::admitLine() {
+  // Length of the next whole line, found once
+  if (nextLength == 0) {
+    uint16_t end = sendEnd;
+    while (queue[end] != '\n') {
+      end = (end + 1) % BUS_TX_QUEUE;
+    }
+    nextEnd = (end + 1) % BUS_TX_QUEUE;
+    nextLength = (nextEnd + BUS_TX_QUEUE - sendEnd) % BUS_TX_QUEUE;
+  }
+  if (!fitsInSlot(nextLength)) {
+    return;
+  }
+  if (!driverOn) {
+    digitalWrite(RS485_DE_PIN, HIGH);
+    driverOn = true;
+  }
+  releaseTicks = 0;
+  sendEnd = nextEnd;
+  nextLength = 0;
+}
+
+void HostLink::poll() {
+  // Receive: time the end of each host line as it arrives
+  while (port.available() > 0) {
+    uint8_t next = (rxHead + 1) % BUS_RX_BUFFER;
+    if (next == rxTail) {
+      break;  // Full: the rest waits in the UART
+    }
+    uint8_t c = port.read();
+    rxRing[rxHead] = c;
+    rxHead = next;
+    if (c == '\n') {
+      frameStart = millis();
+    }
+  }
+  
+  // Admit: one whole line at a time, when it fits in what is left of the slot
+  if (sendPos == sendEnd && sendEnd != queueComplete) {
+    admitLine();
+  }
+  
+  // Transmit: top the UART up from the admitted line
+  for (uint8_t n = 0; n < BUS_TX_PER_TICK && sendPos != sendEnd && port.availableForWrite() > 0; n++) {
+    port.write(queue[sendPos]);
+    sendPos = (sendPos + 1) % BUS_TX_QUEUE;
+  }
+  
+  // Release the bus once the UART is empty: three ticks cover the two
+  // characters that may still be in its data and shift registers
+  if (driverOn && sendPos == sendEnd && port.availableForWrite() >= SERIAL_TX_BUFFER_SIZE - 1) {
+    if (++releaseTicks >= 3) {
+      digitalWrite(RS485_DE_PIN, LOW);
+      driverOn = false;
+      releaseTicks = 0;
+    }
+  } else {
+    releaseTicks = 0;
+  }
+}
+
+#else
+
+void HostLink::emit(uint8_t c) {
+  port.write(c);
+}
+
+void HostLink::run() {
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef HOST_LINK_H
+#define HOST_LINK_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// =====================================================
+// HOST LINK
+// =====================================================
+//
+// Stream to the host used for all protocol traffic. By default it is the
+// USB Serial port; with HOST_RS485 defined it drives a shared RS-485 bus
+// on Serial1 (driver enable on RS485_DE_PIN).
+//
+// Addressing (device ID != 0):
+//   - Inbound "@<id>:CMD" runs only on that node, "@*:CMD" on every node.
+//     Unprefixed commands are treated as broadcast.
+//   - Every outbound line is prefixed with "@<id>:".
+// On the RS-485 bus each node only transmits inside its own time slot of a
+// BUS_NODES x BUS_SLOT_MS frame. The frame restarts one slot after the end
+// of every host line, which all nodes hear at the same instant on the
+// host's pair (the slot lets a line of the old frame finish).
+// poll(), called from the ~1 kHz sensor tick, takes received bytes off the
+// UART and times each line end on arrival, however long loop() is busy.
+// Every line is queued; poll() admits it whole only if it finishes at
+// HOST_BAUD before the slot's guard time, feeds it to the UART and
+// releases the driver, so a blocked loop() neither stretches a line past
+// the slot nor misses the slot. Clocks drift apart after a host line: the guard grows by twice
+// BUS_CLOCK_PPM of the time since, and a slot is sized to hold the longest
+// line (BUS_LINE_MAX) BUS_SYNC_MS after one. Lines that do not fit in the
+// queue, or are longer than BUS_LINE_MAX, are dropped and show up as a
+// sequence gap; run() reports them as "BUS:DESCARTADAS:<n>" once there is
+// room again.
+//
+// Event metadata (on by default): every outbound line ends with
+// "|<seq>,<ms>" - a wrapping 16-bit sequence number, so the host can
+// detect dropped lines, and the millis() at which the line was started.
+// SYNC:<token> answers "SYNC:<token>,<millis>,<micros>" straight away so
+// the host can map device time to wall time (offset at half the RTT).
+//
+// While a tagged command runs, the first "ERROR:..." or "UNKNOWN:..." line
+// it prints is kept as the NAK reason (see CommandProcessor).
+
+class HostLink : public Stream {
+public:
+  HostLink(HardwareSerial& p);
+  void begin(unsigned long baud);
+  void run();  // Call in loop: reports lines the RS-485 queue dropped
+#ifdef HOST_RS485
+  void poll();  // Sensor tick ISR: receives, sends queued lines in the slot
+#endif
+  
+  // Addressing
+  void loadDeviceId();
+  void setDeviceId(uint8_t id);
+  uint8_t getDeviceId() const { return deviceId; }
+  bool accept(String& command);  // Strips the address prefix, false if not for this node
+  
+  // Event metadata
+  void setEventMeta(bool enabled) { metaEnabled = enabled; }
+  bool getEventMeta() const { return metaEnabled; }
+  uint16_t getSequence() const { return sequence; }
+  
+  // Flow control and command replies
+  int rxFree();                  // Free bytes in the UART receive buffer
+  void beginReply();             // Start watching output for an error line
+  const char* endReply();        // Error reason ("" if none), stops watching
+  
+  // Benchmarks: output is formatted as usual but discarded, never reaches the UART
+  void setMuted(bool on) { muted = on; }
+  
+  // Stream
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override;
+  size_t write(uint8_t c) override;
+  int availableForWrite() override;
+  using Print::write;
+  
+private:
+  HardwareSerial& port;
+  uint8_t deviceId;
+  bool lineStart;
+  bool metaEnabled;
+  bool metaWritten;    // Suffix already sent for the current line
+  uint16_t sequence;
+  unsigned long lineMillis;
+  
+  bool muted;
+  bool watching;
+  char head[REPLY_REASON_MAX + 8];  // Start of the current line while watching
+  uint8_t headLen;
+  char reason[REPLY_REASON_MAX + 1];
+  
+#ifdef HOST_RS485
+  // Received bytes, moved here by poll()
+  uint8_t rxRing[BUS_RX_BUFFER];
+  volatile uint8_t rxHead;  // Written by poll()
+  volatile uint8_t rxTail;  // Written by read()
+  unsigned long frameStart;  // millis() at the end of the last host line (poll() only)
+  
+  // Ring of outbound lines: written by emit(), sent by poll()
+  uint8_t queue[BUS_TX_QUEUE];
+  uint16_t queueHead;  // Next byte written
+  volatile uint16_t queueComplete;  // End of the last whole line
+  uint16_t lineBegin;  // Index where the line being written starts
+  bool lineDropped;    // Current line did not fit, discard the rest of it
+  uint16_t dropped;    // Lines dropped since the last report
+  volatile uint16_t sendPos;  // Next byte to hand to the UART
+  uint16_t sendEnd;    // End of the admitted line, sendPos when none (poll() only)
+  uint16_t nextEnd;    // Next line to admit, once its length is known
+  uint16_t nextLength;
+  bool driverOn;
+  uint8_t releaseTicks;
+  
+  uint16_t sendPosNow();
+  void admitLine();
+  bool fitsInSlot(uint16_t length);
+#endif
+  
+  void emit(uint8_t c);
+  void emitNumber(unsigned long n);
+  void emitMeta();
+  void checkErrorLine();
+};
+
+extern HostLink host;
+
+#endif
@@ -3,19 +3,30 @@
 #include "hardware.h"
 #include "state_machine.h"
 #include "commands.h"
+#include "motion_sweep.h"
+#include "weight_trace.h"
 #include "serial_protocol.h"
 #include "test_mode.h"
+#include "test_script.h"
+#include "session.h"
+#include "profiler.h"
+#include "mem_stats.h"
+#include "checkpoint.h"
+#include "host_link.h"
+#include "event_bus.h"
+#include <avr/wdt.h>
 
 unsigned long lastHeartbeat = 0;
 
 void setup() {
-  Serial.begin(9600);
+  host.loadDeviceId();
+  host.begin(HOST_BAUD);
   while (!Serial) {
     ;
   }
 
   // Initialize all hardware modules
-  Serial.println("Inicializando");
+  host.println("Inicializando");
   
   elevator.init();
   dosingWheel.init();
@@ -26,22 +37,44 @@ void setup() {
   
   // Initialize test mode
   TestMode::init();
+  TestScript::init();
+  Session::init();
+  
+#ifdef PROFILING
+  Profiler::init();
+#endif
   
   // Set default mode
   setGlobalMode(MODE_SIMULATION);
   
-  Serial.println("Escribe HELP para listar los comandos");
+  host.println("Escribe HELP para listar los comandos");
 
-  Serial.print("Estado actual: ");
-  Serial.println(stateMachine.getStateName());
+  host.print("Estado actual: ");
+  host.println(stateMachine.getStateName());
+  
+  // Report reset cause and offer to resume an interrupted lot
+  Checkpoint::init();
+  
+  wdt_enable(WATCHDOG_TIMEOUT);
 }
 
 void loop() {
+  PROFILE_SECTION(PROF_LOOP);
+  wdt_reset();
+  
   // Process serial commands
-  commands.processSerialInput();
+  {
+    PROFILE_SECTION(PROF_COMMANDS);
+    commands.processSerialInput();
+    
+    // Feed due commands from a session replay
+    Session::run();
+  }
   
   // Only process state machine if not in test mode
   if (!TestMode::isActive()) {
+    PROFILE_SECTION(PROF_STATE);
+    
     // Process state machine
     if (stateMachine.hasStateChanged()) {
       stateMachine.clearStateChange();
@@ -53,14 +86,41 @@ void loop() {
     
     // Check for state transitions
     stateMachine.processTransitions();
+    
+    // Follow zero drift while the pan is empty and still
+    loadCell.trackZero(stateMachine.isScaleIdle());
   } else {
+    PROFILE_SECTION(PROF_TEST);
+    
     // In test mode, run hardware updates
     elevator.run();
-    dosingWheel.run();
+    TestScript::run();
+  }
+  
+  // Dosing wheel moves (homing, pocket moves) can start from any state
+  dosingWheel.run();
+  MotionSweep::run();
+  
+  // Raw scale samples for an armed trace capture
+  WeightTrace::run();
+  
+  // Hardware events become protocol lines here, never in the motion path
+  EventBus::drain(EVENT_DRAIN_PER_PASS);
+  
+  // Queued bus output and RS-485 driver release
+  host.run();
+  
+  // Solenoid strike/hold timing and duty tracking run in every mode
+  {
+    PROFILE_SECTION(PROF_SOLENOIDS);
+    transferSolenoid.run();
+    capSolenoid.run();
   }
   
   // Send heartbeat
   if (millis() - lastHeartbeat >= HEARTBEAT_INTERVAL) {
+    PROFILE_SECTION(PROF_HEARTBEAT);
+    
     if (TestMode::isActive()) {
       // In test mode, send detailed hardware status
       SerialProtocol::sendTestHeartbeat();
@@ -70,4 +130,10 @@ void loop() {
     }
     lastHeartbeat = millis();
   }
-}
\ No newline at end of file
+  
+  MemStats::sample();
+  
+#ifdef PROFILING
+  Profiler::sampleTxBacklog();
+#endif
+}
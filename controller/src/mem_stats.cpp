@@ -0,0 +1,129 @@
+#include "mem_stats.h"
+#include "host_link.h"
+
+uint16_t MemStats::heapMax = 0;
+
+#ifdef __AVR__
+
+extern uint8_t _end;
+extern uint8_t __stack;
+extern uint8_t __heap_start;
+extern char* __brkval;
+extern size_t __malloc_margin;
+
+// avr-libc's free-list node (stdlib_private.h)
+struct __freelist {
+  size_t sz;
+  struct __freelist* nx;
+};
+extern struct __freelist* __flp;
+
+// Runs before the stack pointer is used: fill _end..__stack with the canary
+void paintStack() __attribute__((naked, used, section(".init1")));
+void paintStack() {
+  __asm volatile (
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, %0\n"
+    "    ldi r25, hi8(__stack)\n"
+    "    rjmp 2f\n"
+    "1:\n"
+    "    st Z+, r24\n"
+    "2:\n"
+    "    cpi r30, lo8(__stack)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n"
+    :: "i" (STACK_CANARY));
+}
+
+static uint8_t* heapTop() {
+  return __brkval ? (uint8_t*)__brkval : &__heap_start;
+}
+
+void MemStats::sample() {
+  uint16_t heap = heapTop() - &__heap_start;
+  if (heap > heapMax) {
+    heapMax = heap;
+  }
+}
+
+uint16_t MemStats::freeMin() {
+  // Canaries left above the highest heap top were never touched by the
+  // stack. Start from the peak: below it free() may have left heap data.
+  sample();
+  uint8_t* p = &__heap_start + heapMax;
+  uint16_t count = 0;
+  while (p <= &__stack && *p == STACK_CANARY) {
+    p++;
+    count++;
+  }
+  return count;
+}
+
+void MemStats::read(MemReport& r) {
+  sample();
+  
+  uint8_t* top = heapTop();
+  uint8_t* sp = (uint8_t*)SP;
+  
+  r.freeNow = sp - top;
+  r.freeMin = freeMin();
+  r.stackMax = &__stack - (&__heap_start + heapMax + r.freeMin) + 1;
+  r.heapNow = top - &__heap_start;
+  r.heapMax = heapMax;
+  
+  r.freeListBytes = 0;
+  r.freeListBlocks = 0;
+  r.largestBlock = 0;
+  for (struct __freelist* fp = __flp; fp; fp = fp->nx) {
+    r.freeListBytes += fp->sz + sizeof(size_t);
+    r.freeListBlocks++;
+    if (fp->sz > r.largestBlock) {
+      r.largestBlock = fp->sz;
+    }
+  }
+  
+  // malloc can also extend the heap up to __malloc_margin below the stack
+  if (r.freeNow > __malloc_margin && r.freeNow - __malloc_margin > r.largestBlock) {
+    r.largestBlock = r.freeNow - __malloc_margin;
+  }
+}
+
+#else
+
+void MemStats::sample() {}
+uint16_t MemStats::freeMin() { return 0; }
+void MemStats::read(MemReport& r) { memset(&r, 0, sizeof(r)); }
+
+#endif
+
+void MemStats::report() {
+  MemReport r;
+  read(r);
+  
+  // Fragmentation: share of free-list memory not usable as one block
+  uint8_t fragmentation = 0;
+  if (r.freeListBytes > 0 && r.largestBlock < r.freeListBytes) {
+    fragmentation = 100 - (uint32_t)r.largestBlock * 100 / r.freeListBytes;
+  }
+  
+  host.print(F("MEM:LIBRE:"));
+  host.print(r.freeNow);
+  host.print(F(",LIBRE_MIN:"));
+  host.print(r.freeMin);
+  host.print(F(",STACK_MAX:"));
+  host.print(r.stackMax);
+  host.print(F(",HEAP:"));
+  host.print(r.heapNow);
+  host.print(F(",HEAP_MAX:"));
+  host.print(r.heapMax);
+  host.print(F(",LISTA_LIBRE:"));
+  host.print(r.freeListBytes);
+  host.print(F(",BLOQUES:"));
+  host.print(r.freeListBlocks);
+  host.print(F(",MAYOR_BLOQUE:"));
+  host.print(r.largestBlock);
+  host.print(F(",FRAG:"));
+  host.println(fragmentation);
+}
@@ -0,0 +1,40 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <Arduino.h>
+
+// =====================================================
+// RAM / STACK WATERMARKS
+// =====================================================
+//
+// RAM between the end of .bss and the top of RAM is painted with a canary
+// before main() runs. The stack high-water mark is the lowest overwritten
+// byte above the heap peak; the heap is tracked through avr-libc's
+// __brkval and free list, sampled each loop() and at the start of every
+// output line (so Strings live while a command prints are counted).
+
+#define STACK_CANARY 0xC5
+
+struct MemReport {
+  uint16_t freeNow;       // Gap between heap top and stack pointer
+  uint16_t freeMin;       // Smallest that gap has ever been (canary scan)
+  uint16_t stackMax;      // Deepest stack use since boot
+  uint16_t heapNow;       // Heap size including free-list chunks
+  uint16_t heapMax;       // Largest heap size sampled
+  uint16_t freeListBytes; // Bytes sitting in the malloc free list
+  uint8_t freeListBlocks;
+  uint16_t largestBlock;  // Largest allocation that would succeed
+};
+
+class MemStats {
+public:
+  static void sample();  // Tracks the heap high-water mark: loop, every output line, reports
+  static void read(MemReport& r);
+  static void report();  // MEM command
+  static uint16_t freeMin();
+  
+private:
+  static uint16_t heapMax;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "motion_sweep.h"
+#include "host_link.h"
+#include "state_machine.h"
+
+MotionSweep::Phase MotionSweep::phase = MotionSweep::PHASE_IDLE;
+SweepAxis MotionSweep::axis = SWEEP_ELEVATOR;
+MotionProfile MotionSweep::original;
+unsigned int MotionSweep::speedFrom = 0;
+unsigned int MotionSweep::speedTo = 0;
+unsigned int MotionSweep::speedStep = 0;
+unsigned int MotionSweep::accelFrom = 0;
+unsigned int MotionSweep::accelTo = 0;
+unsigned int MotionSweep::accelStep = 0;
+unsigned int MotionSweep::speed = 0;
+unsigned int MotionSweep::accel = 0;
+unsigned int MotionSweep::runs = 0;
+unsigned long MotionSweep::phaseStart = 0;
+unsigned long MotionSweep::upTime = 0;
+bool MotionSweep::timedOut = false;
+
+bool MotionSweep::start(SweepAxis a, unsigned int sFrom, unsigned int sTo, unsigned int sStep,
+                        unsigned int aFrom, unsigned int aTo, unsigned int aStep) {
+  if (isActive()) {
+    host.println("ERROR:SWEEP_EN_CURSO");
+    return false;
+  }
+  if (stateMachine.getCurrentState() != ESTADO0_INICIO) {
+    host.println("ERROR:SWEEP_SOLO_EN_INICIO");
+    return false;
+  }
+  
+  // A zero step sweeps a single value
+  unsigned long speedCount = sStep > 0 && sTo >= sFrom ? (sTo - sFrom) / sStep + 1 : 1;
+  unsigned long accelCount = aStep > 0 && aTo >= aFrom ? (aTo - aFrom) / aStep + 1 : 1;
+  if (sFrom == 0 || sTo > MOTION_SPEED_LIMIT || speedCount * accelCount > SWEEP_MAX_RUNS) {
+    host.println("ERROR:SWEEP_RANGO_INVALIDO");
+    return false;
+  }
+  
+  axis = a;
+  speedFrom = sFrom;
+  speedTo = sStep > 0 ? sTo : sFrom;
+  speedStep = sStep;
+  accelFrom = aFrom;
+  accelTo = aStep > 0 ? aTo : aFrom;
+  accelStep = aStep;
+  speed = speedFrom;
+  accel = accelFrom;
+  runs = 0;
+  original = axis == SWEEP_ELEVATOR ? elevator.getProfile() : dosingWheel.getProfile();
+  
+  host.print("SWEEP:INICIO,N:");
+  host.println(speedCount * accelCount);
+  
+  if (axis == SWEEP_ELEVATOR && !elevator.isAtBottom()) {
+    phase = PHASE_PREPARE;
+    phaseStart = millis();
+    elevator.moveDown();
+  } else {
+    startRun();
+  }
+  return true;
+}
+
+void MotionSweep::stop(bool haltMotors) {
+  if (!isActive()) return;
+  
+  if (haltMotors && axis == SWEEP_ELEVATOR) {
+    elevator.stop();
+  } else if (haltMotors) {
+    dosingWheel.stop();
+  }
+  setProfile(original);  // Deferred to the next move if one is running
+  phase = PHASE_IDLE;
+  host.print("SWEEP:FIN,N:");
+  host.println(runs);
+}
+
+void MotionSweep::setProfile(const MotionProfile& profile) {
+  if (axis == SWEEP_ELEVATOR) {
+    elevator.setProfile(profile);
+  } else {
+    dosingWheel.setProfile(profile);
+  }
+}
+
+void MotionSweep::startRun() {
+  MotionProfile profile = original;
+  profile.speed = speed;
+  profile.accel = accel;
+  setProfile(profile);
+  
+  timedOut = false;
+  phaseStart = millis();
+  if (axis == SWEEP_ELEVATOR) {
+    phase = PHASE_UP;
+    elevator.moveUp();
+  } else {
+    phase = PHASE_ROTATE;
+    dosingWheel.rotate(dosingWheel.stepsPerRevolution());
+  }
+}
+
+void MotionSweep::finishRun(unsigned long elapsed) {
+  runs++;
+  host.print(axis == SWEEP_ELEVATOR ? "SWEEP:ELEV,V:" : "SWEEP:DOSING,V:");
+  host.print(speed);
+  host.print(",A:");
+  host.print(accel);
+  host.print(",MS:");
+  host.print(original.microsteps);
+  if (axis == SWEEP_ELEVATOR) {
+    host.print(",SUBIDA:");
+    host.print(upTime);
+    host.print(",BAJADA:");
+    host.print(elapsed);
+    host.println(timedOut ? ",TIMEOUT" : "");
+  } else {
+    host.print(",VUELTA:");
+    host.print(elapsed);
+    host.print(",ERR:");
+    host.println(dosingWheel.getLastIndexError());
+  }
+  
+  // Next combination, acceleration in the inner loop
+  if (accelStep > 0 && (unsigned long)accel + accelStep <= accelTo) {
+    accel += accelStep;
+  } else if (speedStep > 0 && (unsigned long)speed + speedStep <= speedTo) {
+    accel = accelFrom;
+    speed += speedStep;
+  } else {
+    stop();
+    return;
+  }
+  startRun();
+}
+
+void MotionSweep::run() {
+  if (!isActive()) return;
+  
+  // The lot owns the motors once it starts
+  if (stateMachine.getCurrentState() != ESTADO0_INICIO) {
+    stop(false);
+    return;
+  }
+  
+  unsigned long elapsed = millis() - phaseStart;
+  switch (phase) {
+    case PHASE_PREPARE:
+      elevator.run();
+      if (!elevator.isMoving()) {
+        startRun();
+      }
+      break;
+      
+    case PHASE_UP:
+      elevator.run();
+      if (!elevator.isMoving()) {
+        upTime = elapsed;
+        timedOut = !elevator.isAtTop();
+        phase = PHASE_DOWN;
+        phaseStart = millis();
+        elevator.moveDown();
+      }
+      break;
+      
+    case PHASE_DOWN:
+      elevator.run();
+      if (!elevator.isMoving()) {
+        timedOut = timedOut || !elevator.isAtBottom();
+        finishRun(elapsed);
+      }
+      break;
+      
+    case PHASE_ROTATE:
+      // DosingWheel::run() is already called from loop()
+      if (!dosingWheel.isDispensing()) {
+        finishRun(elapsed);
+      }
+      break;
+      
+    default:
+      break;
+  }
+}
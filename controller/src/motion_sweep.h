@@ -0,0 +1,61 @@
+#ifndef MOTION_SWEEP_H
+#define MOTION_SWEEP_H
+
+#include <Arduino.h>
+#include "hardware.h"
+
+// =====================================================
+// MOTION PROFILE SWEEP
+// =====================================================
+//
+// Steps one axis through every speed x acceleration combination (speed in
+// the outer loop, microstepping kept) and times a reference move for each:
+//   Elevator: bottom -> top -> bottom, one line per combination
+//     SWEEP:ELEV,V:<speed>,A:<accel>,MS:<microsteps>,SUBIDA:<ms>,BAJADA:<ms>[,TIMEOUT]
+//     TIMEOUT means a limit sensor never tripped (fallback timer ended the move)
+//   Dosing wheel: one forward revolution per combination
+//     SWEEP:DOSING,V:<speed>,A:<accel>,MS:<microsteps>,VUELTA:<ms>,ERR:<steps>
+//     ERR is the last re-index error, non-zero after missed steps
+// Only runs in 0_INICIO; START and RESUME are refused until it ends (the
+// lot would move with the sweep profile). The original profile
+// is restored at the end (SWEEP:FIN,N:<runs>).
+
+enum SweepAxis {
+  SWEEP_ELEVATOR,
+  SWEEP_DOSING
+};
+
+class MotionSweep {
+public:
+  static bool start(SweepAxis axis, unsigned int speedFrom, unsigned int speedTo, unsigned int speedStep,
+                    unsigned int accelFrom, unsigned int accelTo, unsigned int accelStep);
+  static void stop(bool haltMotors = true);
+  static void run();  // Call in loop
+  static bool isActive() { return phase != PHASE_IDLE; }
+  
+private:
+  enum Phase {
+    PHASE_IDLE,
+    PHASE_PREPARE,   // Elevator back to the bottom before the first run
+    PHASE_UP,
+    PHASE_DOWN,
+    PHASE_ROTATE
+  };
+  
+  static Phase phase;
+  static SweepAxis axis;
+  static MotionProfile original;
+  static unsigned int speedFrom, speedTo, speedStep;
+  static unsigned int accelFrom, accelTo, accelStep;
+  static unsigned int speed, accel;
+  static unsigned int runs;
+  static unsigned long phaseStart;
+  static unsigned long upTime;
+  static bool timedOut;
+  
+  static void startRun();
+  static void finishRun(unsigned long elapsed);
+  static void setProfile(const MotionProfile& profile);
+};
+
+#endif
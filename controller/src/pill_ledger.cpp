@@ -0,0 +1,101 @@
+#include "pill_ledger.h"
+#include "host_link.h"
+
+PillLedger::Record PillLedger::records[LEDGER_SIZE];
+uint8_t PillLedger::head = 0;
+uint8_t PillLedger::count = 0;
+uint16_t PillLedger::total = 0;
+PillLedger::Record PillLedger::pending;
+bool PillLedger::hasPending = false;
+bool PillLedger::resumed = false;
+
+void PillLedger::clear() {
+  head = 0;
+  count = 0;
+  total = 0;
+  hasPending = false;
+  resumed = false;
+}
+
+void PillLedger::recordWeight(float weight, unsigned long settleMs, uint8_t flags) {
+  if (resumed) {
+    flags |= LEDGER_REANUDADO;
+    resumed = false;
+  }
+  pending.weight = weight;
+  pending.settleMs = clampMs(settleMs);
+  pending.flags = flags;
+  hasPending = true;
+}
+
+void PillLedger::commit(int pill, unsigned long transferMs) {
+  if (!hasPending) {
+    return;  // Resumed straight into 4_TRASPASO, the weight was never taken
+  }
+  hasPending = false;
+  
+  pending.pill = pill;
+  pending.transferMs = clampMs(transferMs);
+  
+  if (count < LEDGER_SIZE) {
+    records[(head + count) % LEDGER_SIZE] = pending;
+    count++;
+  } else {
+    // Full: keep the most recent pills
+    records[head] = pending;
+    head = (head + 1) % LEDGER_SIZE;
+  }
+  total++;
+}
+
+void PillLedger::report() {
+  // Welford's running mean/variance, pills without a measured weight excluded
+  float mean = 0;
+  float m2 = 0;
+  float minWeight = 0;
+  float maxWeight = 0;
+  uint8_t weighed = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    const Record& r = records[(head + i) % LEDGER_SIZE];
+    if (r.flags & LEDGER_SIN_BALANZA) continue;
+    
+    weighed++;
+    float delta = r.weight - mean;
+    mean += delta / weighed;
+    m2 += delta * (r.weight - mean);
+    if (weighed == 1 || r.weight < minWeight) minWeight = r.weight;
+    if (weighed == 1 || r.weight > maxWeight) maxWeight = r.weight;
+  }
+  float stdev = weighed > 1 ? sqrt(m2 / (weighed - 1)) : 0;
+  
+  host.print(F("LOT:REPORTE:N:"));
+  host.print(total);
+  host.print(F(",PERDIDOS:"));
+  host.print(total - count);
+  host.print(F(",MEDIA:"));
+  host.print(mean, 3);
+  host.print(F(",DESV:"));
+  host.print(stdev, 3);
+  host.print(F(",MIN:"));
+  host.print(minWeight, 3);
+  host.print(F(",MAX:"));
+  host.println(maxWeight, 3);
+  
+  for (uint8_t i = 0; i < count; i++) {
+    const Record& r = records[(head + i) % LEDGER_SIZE];
+    host.print(i % LEDGER_RECORDS_PER_LINE == 0 ? F("LOT:DATOS:") : F(";"));
+    host.print(r.pill);
+    host.print(',');
+    host.print(r.weight, 3);
+    host.print(',');
+    host.print(r.settleMs);
+    host.print(',');
+    host.print(r.transferMs);
+    host.print(',');
+    host.print(r.flags);
+    if (i % LEDGER_RECORDS_PER_LINE == LEDGER_RECORDS_PER_LINE - 1 || i == count - 1) {
+      host.println();
+    }
+  }
+  host.println(F("LOT:FIN"));
+}
@@ -0,0 +1,60 @@
+#ifndef PILL_LEDGER_H
+#define PILL_LEDGER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// =====================================================
+// PER-PILL WEIGHT LEDGER
+// =====================================================
+//
+// One record per transferred pill, kept in a RAM ring (the last
+// LEDGER_SIZE pills of the lot). Dumped on LOT:REPORT and automatically
+// when the lot reaches 8_RETIRO:
+//   LOT:REPORTE:N:<pills>,PERDIDOS:<overwritten>,MEDIA:<g>,DESV:<g>,MIN:<g>,MAX:<g>
+//   LOT:DATOS:<pill>,<weight_g>,<settle_ms>,<transfer_ms>,<flags>;...   (8 records per line)
+//   LOT:FIN
+// Weights are net: the delta over the empty-pan baseline of the drop.
+// Flags are the LEDGER_* bits below.
+
+#define LEDGER_SIN_BALANZA 0x01   // No HX711, weight not measured
+#define LEDGER_SIMULADO 0x02      // Recorded in simulation mode
+#define LEDGER_REANUDADO 0x04     // First pill after a checkpoint resume
+#define LEDGER_PESAJE_LENTO 0x08  // Weight took more than twice t_weight_settle to settle
+#define LEDGER_VACIO 0x10         // Reserved, never set: empty drops are re-dosed (older firmware logged them)
+#define LEDGER_MULTIPLE 0x20      // More than one pill in the drop (pill is the last one counted)
+#define LEDGER_REDOSIS 0x40       // Dosed again after one or more empty pockets
+
+class PillLedger {
+public:
+  static void clear();
+  static void markResumed() { resumed = true; }
+  
+  // Weight accepted at the end of 3_PESAJE, committed when the transfer ends
+  static void recordWeight(float weight, unsigned long settleMs, uint8_t flags);
+  static void commit(int pill, unsigned long transferMs);
+  
+  static void report();
+  static uint16_t getCount() { return total; }
+  
+private:
+  struct Record {
+    uint16_t pill;
+    float weight;
+    uint16_t settleMs;
+    uint16_t transferMs;
+    uint8_t flags;
+  };
+  
+  static Record records[LEDGER_SIZE];
+  static uint8_t head;      // Oldest record
+  static uint8_t count;
+  static uint16_t total;    // Pills recorded this lot, including overwritten ones
+  static Record pending;
+  static bool hasPending;
+  static bool resumed;
+  
+  static uint16_t clampMs(unsigned long ms) { return ms > 0xFFFF ? 0xFFFF : ms; }
+};
+
+#endif
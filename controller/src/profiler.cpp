@@ -0,0 +1,106 @@
+#include "profiler.h"
+#include "host_link.h"
+
+#ifdef PROFILING
+
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+
+static volatile uint16_t timer5Overflows = 0;
+
+Profiler::Stats Profiler::stats[PROF_COUNT];
+uint16_t Profiler::maxIsrLatency = 0;
+uint8_t Profiler::maxTxBacklog = 0;
+
+static const char* const sectionNames[PROF_COUNT] = {
+  "COMANDOS", "ESTADOS", "TEST", "SOLENOIDES", "HEARTBEAT", "LOOP", "PASO"
+};
+
+ISR(TIMER5_OVF_vect) {
+  timer5Overflows++;
+}
+
+void Profiler::init() {
+  // Hold the shared prescaler in reset so Timer0 stops, clear both counters,
+  // then release it: Timer5 (prescaler 1, one count per CPU cycle, overflow
+  // every 4.096 ms) and Timer0 restart a fixed few cycles apart. 65536 is a
+  // multiple of Timer0's period, so they stay in step.
+  uint8_t sreg = SREG;
+  cli();
+  GTCCR = _BV(TSM) | _BV(PSRSYNC);
+  TCCR5A = 0;
+  TCCR5B = _BV(CS50);
+  TCNT0 = 0;
+  TCNT5 = 0;
+  GTCCR = 0;
+  SREG = sreg;
+  TIMSK5 |= _BV(TOIE5);
+  memset(stats, 0, sizeof(stats));
+}
+
+uint32_t Profiler::cycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t count = TCNT5;
+  uint16_t overflows = timer5Overflows;
+  // Overflow pending but not yet serviced
+  if ((TIFR5 & _BV(TOV5)) && count < 0x8000) {
+    overflows++;
+  }
+  SREG = sreg;
+  return ((uint32_t)overflows << 16) | count;
+}
+
+void Profiler::record(uint8_t section, uint32_t elapsed) {
+  Stats& s = stats[section];
+  s.count++;
+  s.total += elapsed;
+  if (elapsed > s.max) {
+    s.max = elapsed;
+  }
+}
+
+void Profiler::recordIsrLatency(uint16_t latency) {
+  if (latency > maxIsrLatency) {
+    maxIsrLatency = latency;
+  }
+}
+
+void Profiler::sampleTxBacklog() {
+  uint8_t backlog = SERIAL_TX_BUFFER_SIZE - 1 - host.availableForWrite();
+  if (backlog > maxTxBacklog) {
+    maxTxBacklog = backlog;
+  }
+}
+
+void Profiler::report() {
+  // Snapshot first so the report's own output is not measured
+  Stats snapshot[PROF_COUNT];
+  uint8_t sreg = SREG;
+  cli();
+  memcpy(snapshot, stats, sizeof(stats));
+  memset(stats, 0, sizeof(stats));
+  uint16_t isrLatency = maxIsrLatency;
+  maxIsrLatency = 0;
+  SREG = sreg;
+  uint8_t txBacklog = maxTxBacklog;
+  maxTxBacklog = 0;
+  
+  for (uint8_t i = 0; i < PROF_COUNT; i++) {
+    host.print(F("PROF:"));
+    host.print(sectionNames[i]);
+    host.print(F(":N:"));
+    host.print(snapshot[i].count);
+    host.print(F(",AVG:"));
+    host.print(snapshot[i].count ? snapshot[i].total / snapshot[i].count : 0);
+    host.print(F(",MAX:"));
+    host.println(snapshot[i].max);
+  }
+  host.print(F("PROF:ISR_LATENCIA_MAX:"));
+  host.println(isrLatency);
+  host.print(F("PROF:TX_BACKLOG_MAX:"));
+  host.println(txBacklog);
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+// =====================================================
+// CYCLE PROFILER (build with -D PROFILING)
+// =====================================================
+//
+// Timer5 (unused by the firmware) runs free at F_CPU and counts overflows,
+// giving an exact 32-bit cycle counter on hardware and under simavr.
+// PROFILE_SECTION(id) times the enclosing scope; without PROFILING every
+// hook compiles away.
+//
+// Init restarts Timer0 and Timer5 together, so TCNT5 modulo Timer0's period
+// is the position in that period in single cycles. The latency of the
+// production sensor tick (Timer0 compare A, compare match to the first
+// statement of the handler, prologue included) is then
+// TCNT5 - 64 * OCR0A modulo the period, not just Timer0's 64-cycle ticks.
+
+#define PROFILE_TIMER0_PERIOD 16384U  // Cycles per Timer0 period: prescaler 64, 256 counts
+
+enum ProfileSection {
+  PROF_COMMANDS,   // Serial input + command dispatch
+  PROF_STATE,      // State machine entry/continuous/transitions
+  PROF_TEST,       // Test-mode hardware updates
+  PROF_SOLENOIDS,  // Strike/hold timing
+  PROF_HEARTBEAT,  // Heartbeat output
+  PROF_LOOP,       // Whole loop() iteration
+  PROF_STEP,       // One step pulse (both steppers)
+  PROF_COUNT
+};
+
+#ifdef PROFILING
+
+class Profiler {
+public:
+  static void init();
+  static uint32_t cycles();
+  static void record(uint8_t section, uint32_t elapsed);
+  static void recordIsrLatency(uint16_t latency);
+  static void sampleTxBacklog();
+  static void report();  // Prints and resets all counters
+  
+private:
+  struct Stats {
+    uint32_t count;
+    uint32_t total;
+    uint32_t max;
+  };
+  static Stats stats[PROF_COUNT];
+  static uint16_t maxIsrLatency;
+  static uint8_t maxTxBacklog;
+};
+
+class ProfileScope {
+public:
+  ProfileScope(uint8_t s) : section(s), start(Profiler::cycles()) {}
+  ~ProfileScope() { Profiler::record(section, Profiler::cycles() - start); }
+  
+private:
+  uint8_t section;
+  uint32_t start;
+};
+
+#define PROFILE_SECTION(id) ProfileScope _profileScope(id)
+
+#else
+
+#define PROFILE_SECTION(id)
+
+#endif
+
+#endif
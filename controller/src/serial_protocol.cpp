@@ -1,127 +1,135 @@
 #include "serial_protocol.h"
+#include "host_link.h"
 #include "hardware.h"
+#include "mem_stats.h"
 
 void SerialProtocol::sendState(const char* state) {
-  Serial.print(F("ESTADO:"));
-  Serial.println(state);
-  Serial.flush();
+  host.print(F("ESTADO:"));
+  host.println(state);
+  host.flush();
 }
 
 void SerialProtocol::sendPillCount(int count, int target) {
-  Serial.print(F("PASTILLAS:"));
-  Serial.print(count);
-  Serial.print(F("/"));
-  Serial.println(target);
-  Serial.flush();
+  host.print(F("PASTILLAS:"));
+  host.print(count);
+  host.print(F("/"));
+  host.println(target);
+  host.flush();
 }
 
 void SerialProtocol::sendWeight(float weight) {
-  Serial.print(F("PESO:"));
-  Serial.println(weight, 2);
-  Serial.flush();
+  host.print(F("PESO:"));
+  host.println(weight, 2);
+  host.flush();
 }
 
 void SerialProtocol::sendElevatorPosition(bool isUp) {
-  Serial.print(F("ELEVADOR:"));
-  Serial.println(isUp ? F("ARRIBA") : F("ABAJO"));
-  Serial.flush();
+  host.print(F("ELEVADOR:"));
+  host.println(isUp ? F("ARRIBA") : F("ABAJO"));
+  host.flush();
 }
 
 void SerialProtocol::sendSimSensor(const char* sensor, bool state) {
-  Serial.print(F("SIM:"));
-  Serial.print(sensor);
-  Serial.print(F(":"));
-  Serial.println(state ? F("ON") : F("OFF"));
-  Serial.flush();
+  host.print(F("SIM:"));
+  host.print(sensor);
+  host.print(F(":"));
+  host.println(state ? F("ON") : F("OFF"));
+  host.flush();
 }
 
 void SerialProtocol::sendSensor(const char* sensor, bool state) {
-  Serial.print(F("SENSORES:"));
-  Serial.print(sensor);
-  Serial.print(F(":"));
-  Serial.println(state ? F("1") : F("0"));
-  Serial.flush();
+  host.print(F("SENSORES:"));
+  host.print(sensor);
+  host.print(F(":"));
+  host.println(state ? F("1") : F("0"));
+  host.flush();
 }
 
 void SerialProtocol::sendProgress(const char* state, unsigned long duration) {
-  Serial.print(F("PROGRESO:"));
-  Serial.print(state);
-  Serial.print(F(","));
-  Serial.println(duration);
-  Serial.flush();
+  host.print(F("PROGRESO:"));
+  host.print(state);
+  host.print(F(","));
+  host.println(duration);
+  host.flush();
 }
 
 void SerialProtocol::sendHeartbeat(const char* state, unsigned long timestamp) {
-  Serial.print(F("HB:"));
-  Serial.print(state);
-  Serial.print(F(","));
-  Serial.println(timestamp);
-  Serial.flush();
+  host.print(F("HB:"));
+  host.print(state);
+  host.print(F(","));
+  host.print(timestamp);
+  host.print(F(",MEM:"));
+  host.println(MemStats::freeMin());
+  host.flush();
 }
 
 void SerialProtocol::sendError(const char* error) {
-  Serial.print(F("ERROR:"));
-  Serial.println(error);
-  Serial.flush();
+  host.print(F("ERROR:"));
+  host.println(error);
+  host.flush();
 }
 
 void SerialProtocol::sendButton(const char* button, const char* action) {
-  Serial.print(F("BTN:"));
-  Serial.print(button);
-  Serial.print(F(":"));
-  Serial.println(action);
-  Serial.flush();
+  host.print(F("BTN:"));
+  host.print(button);
+  host.print(F(":"));
+  host.println(action);
+  host.flush();
 }
 
 void SerialProtocol::sendAction(const char* action) {
-  Serial.print(F("ACCION:"));
-  Serial.println(action);
-  Serial.flush();
+  host.print(F("ACCION:"));
+  host.println(action);
+  host.flush();
 }
 
 void SerialProtocol::sendInfo(const char* info) {
-  Serial.println(info);
-  Serial.flush();
+  host.println(info);
+  host.flush();
 }
 
 void SerialProtocol::sendTestHeartbeat() {
-  Serial.print(F("HB:TEST,"));
+  host.print(F("HB:TEST,"));
   
   // Elevator status
-  Serial.print(F("E:"));
+  host.print(F("E:"));
   if (elevator.isMoving()) {
-    Serial.print(F("MOV"));
+    host.print(F("MOV"));
   } else if (elevator.isAtTop()) {
-    Serial.print(F("UP"));
+    host.print(F("UP"));
   } else if (elevator.isAtBottom()) {
-    Serial.print(F("DOWN"));
+    host.print(F("DOWN"));
   } else {
-    Serial.print(F("MID"));
+    host.print(F("MID"));
   }
   
   // Dosing status
-  Serial.print(F(",D:"));
-  Serial.print(dosingWheel.isDispensing() ? F("ACT") : F("IDLE"));
+  host.print(F(",D:"));
+  host.print(dosingWheel.isDispensing() ? F("ACT") : F("IDLE"));
   
   // Grinder status
-  Serial.print(F(",G:"));
-  Serial.print(grinder.isRunning() ? F("ON") : F("OFF"));
+  host.print(F(",G:"));
+  host.print(grinder.isRunning() ? F("ON") : F("OFF"));
   
   // Transfer solenoid
-  Serial.print(F(",T:"));
-  Serial.print(transferSolenoid.isActive() ? F("OPEN") : F("CLOSED"));
+  host.print(F(",T:"));
+  host.print(transferSolenoid.isActive() ? F("OPEN") : F("CLOSED"));
   
   // Cap solenoid
-  Serial.print(F(",C:"));
-  Serial.print(capSolenoid.isActive() ? F("PUSH") : F("RET"));
+  host.print(F(",C:"));
+  host.print(capSolenoid.isActive() ? F("PUSH") : F("RET"));
   
   // Weight
-  Serial.print(F(",W:"));
-  Serial.print(loadCell.readWeight(), 1);
+  host.print(F(",W:"));
+  host.print(loadCell.readWeight(), 1);
+  
+  // Lowest free RAM since boot
+  host.print(F(",MEM:"));
+  host.print(MemStats::freeMin());
   
   // Timestamp
-  Serial.print(F(",MS:"));
-  Serial.println(millis());
+  host.print(F(",MS:"));
+  host.println(millis());
   
-  Serial.flush();
+  host.flush();
 }
\ No newline at end of file
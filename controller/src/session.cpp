@@ -0,0 +1,133 @@
+#include "session.h"
+#include "host_link.h"
+#include "commands.h"
+#include "hardware.h"
+
+bool Session::recording = false;
+bool Session::replaying = false;
+unsigned long Session::replayStart = 0;
+Session::ReplayEntry Session::queue[REPLAY_QUEUE_SIZE];
+uint8_t Session::queueHead = 0;
+uint8_t Session::queueCount = 0;
+
+void Session::init() {
+  recording = false;
+  replaying = false;
+  clearQueue();
+}
+
+void Session::setRecording(bool on) {
+  recording = on;
+  host.print(F("REC:"));
+  host.println(on ? F("ON") : F("OFF"));
+  if (on) {
+    // Reference point so the host can align the recording
+    host.print(F("REC:T0:"));
+    host.println(millis());
+  }
+}
+
+void Session::recordCommand(const String& command) {
+  if (!recording) return;
+  host.print(F("REC:C:"));
+  host.print(millis());
+  host.print(F(","));
+  host.println(command);
+}
+
+void Session::recordState(const char* state) {
+  if (!recording) return;
+  host.print(F("REC:E:"));
+  host.print(millis());
+  host.print(F(","));
+  host.println(state);
+}
+
+void Session::recordWeight(float weight) {
+  if (!recording) return;
+  host.print(F("REC:P:"));
+  host.print(millis());
+  host.print(F(","));
+  host.println(weight, 2);
+}
+
+bool Session::processCommand(const String& command) {
+  if (command == "REC:ON") {
+    setRecording(true);
+  } else if (command == "REC:OFF") {
+    setRecording(false);
+  } else if (command == "PLAY:START") {
+    replaying = true;
+    replayStart = millis();
+    host.print(F("PLAY:STARTED:"));
+    host.print(queueCount);
+    host.print(F(","));
+    host.println(replayStart);  // Aligns the REC:E timestamps of the replay
+  } else if (command == "PLAY:STOP") {
+    replaying = false;
+    clearQueue();
+    host.println(F("PLAY:STOPPED"));
+  } else if (command.startsWith("PLAY:")) {
+    // PLAY:<offset_ms>,<command>
+    int commaIdx = command.indexOf(',');
+    if (commaIdx < 0 || command.length() - commaIdx > REPLAY_CMD_LEN) {
+      host.println(F("ERROR:PLAY_FORMATO"));
+    } else if (!enqueue(command.substring(5, commaIdx).toInt(), command.substring(commaIdx + 1))) {
+      host.println(F("PLAY:FULL"));
+    } else {
+      // Free slots let the host stream the session ahead of the replay clock
+      host.print(F("PLAY:QUEUED:"));
+      host.println(REPLAY_QUEUE_SIZE - queueCount);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void Session::run() {
+  if (!replaying || queueCount == 0) return;
+  
+  ReplayEntry& entry = queue[queueHead];
+  unsigned long elapsed = millis() - replayStart;
+  if (elapsed < entry.offset) return;
+  
+  // Copy out before executing, the command may queue or stop the replay
+  String command = entry.command;
+  unsigned long offset = entry.offset;
+  queueHead = (queueHead + 1) % REPLAY_QUEUE_SIZE;
+  queueCount--;
+  
+  host.print(F("PLAY:EXEC:"));
+  host.print(offset);
+  host.print(F(","));
+  host.print(elapsed);
+  host.print(F(","));
+  host.println(command);
+  
+  if (command.startsWith("P:")) {
+    // Recorded weight sample, only meaningful against the simulated scale
+    if (globalMode == MODE_SIMULATION) {
+      loadCell.simulateReading(command.substring(2).toFloat());
+    }
+    return;
+  }
+  commands.processCommand(command);
+}
+
+bool Session::enqueue(unsigned long offset, const String& command) {
+  if (queueCount >= REPLAY_QUEUE_SIZE) {
+    return false;
+  }
+  ReplayEntry& entry = queue[(queueHead + queueCount) % REPLAY_QUEUE_SIZE];
+  entry.offset = offset;
+  strncpy(entry.command, command.c_str(), REPLAY_CMD_LEN - 1);
+  entry.command[REPLAY_CMD_LEN - 1] = '\0';
+  queueCount++;
+  return true;
+}
+
+void Session::clearQueue() {
+  queueHead = 0;
+  queueCount = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <Arduino.h>
+
+// =====================================================
+// SESSION RECORD / REPLAY
+// =====================================================
+//
+// Recording echoes every inbound command, state change and weight sample
+// with its millis() timestamp:
+//   REC:C:<ms>,<command>   REC:E:<ms>,<state>   REC:P:<ms>,<weight>
+//
+// Replay takes the recorded commands back as PLAY:<offset_ms>,<command>
+// and weight samples as PLAY:<offset_ms>,P:<weight> (offsets relative to
+// the start of the recording), queues them and runs each at its offset
+// after PLAY:START (reply PLAY:STARTED:<queued>,<millis>). A sample becomes
+// the simulated scale reading. Every executed entry reports
+// PLAY:EXEC:<offset>,<actual>,<entry>.
+//
+// tools/replay_session.py streams a recorded log through this queue and
+// diffs the REC:E timeline of the replay against the recording. Replay
+// runs on the controller's own clock, so timings are compared within a
+// tolerance rather than bit for bit. tools/native/replay replays the same
+// log on a native build of the firmware on a simulated clock, repeatably.
+
+#define REPLAY_QUEUE_SIZE 8
+#define REPLAY_CMD_LEN 40
+
+class Session {
+public:
+  static void init();
+  static void run();  // Call in loop
+  
+  // Recording
+  static void setRecording(bool on);
+  static bool isRecording() { return recording; }
+  static void recordCommand(const String& command);
+  static void recordState(const char* state);
+  static void recordWeight(float weight);
+  
+  // Replay
+  static bool processCommand(const String& command);  // Handles REC:/PLAY: commands
+  static bool isReplaying() { return replaying; }
+  
+private:
+  static bool recording;
+  static bool replaying;
+  static unsigned long replayStart;
+  
+  struct ReplayEntry {
+    unsigned long offset;
+    char command[REPLAY_CMD_LEN];
+  };
+  static ReplayEntry queue[REPLAY_QUEUE_SIZE];
+  static uint8_t queueHead;
+  static uint8_t queueCount;
+  
+  static bool enqueue(unsigned long offset, const String& command);
+  static void clearQueue();
+};
+
+#endif
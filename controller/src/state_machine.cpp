@@ -1,6 +1,12 @@
 #include "state_machine.h"
+#include "host_link.h"
 #include "hardware.h"
 #include "config.h"
+#include "session.h"
+#include "checkpoint.h"
+#include "pill_ledger.h"
+#include "weight_trace.h"
+#include "motion_sweep.h"
 
 // Global instance
 StateMachine stateMachine;
@@ -17,47 +23,220 @@ unsigned long t_elev_down = T_ELEV_DOWN_DEFAULT;
 // Global dosing parameters
 int wheel_divisions = WHEEL_DIVISIONS_DEFAULT;
 int lot_size = LOT_SIZE_DEFAULT;
+float pill_weight = PILL_WEIGHT_DEFAULT;
 
 StateMachine::StateMachine() {
   currentState = ESTADO0_INICIO;
   previousState = ESTADO0_INICIO;
   stateJustChanged = false;
   stateTimer = 0;
+  resumeTarget = ESTADO0_INICIO;
   pastillasCount = 0;
+  weightStream = WEIGHT_STREAM_DEFAULT;
+  dosePills = 1;
+  doseRetries = 0;
+  lotRetries = 0;
+  lotMultiples = 0;
+  prestage = PRESTAGE_DEFAULT;
+  prestaged = false;
+  prestageHold = false;
+  prestageDrop = 0;
+  zeroWindow = false;
+  zeroSamples = 0;
+  dropStart = 0;
+  for (int i = 0; i <= ESTADO8_RETIRO; i++) {
+    learnedDuration[i] = 0;
+  }
 }
 
 void StateMachine::changeState(State newState) {
   if (currentState != newState) {
+    // Only natural exits are samples; aborts to INICIO (RESET:ALL) are not
+    if (newState != ESTADO0_INICIO) {
+      learnDuration(currentState, millis() - stateTimer);
+    }
+    
     previousState = currentState;
     currentState = newState;
+    if (newState == ESTADO0_INICIO) {
+      resumeTarget = ESTADO0_INICIO;  // A re-homing cut short does not carry into the next lot
+    }
     stateTimer = millis();
     stateJustChanged = true;
     
-    Serial.print("ESTADO:");
-    Serial.println(getStateName(newState));
-    Serial.flush();  // Ensure complete transmission
+    host.print("ESTADO:");
+    host.println(getStateName(newState));
+    host.flush();  // Ensure complete transmission
+    Session::recordState(getStateName(newState).c_str());
+    
+    // Journal the transition so a reset mid-lot can resume here; while
+    // re-homing after a resume, the state the lot is really in. A lot
+    // paused in ESTADO0 with pills resumes into dosing, as START would
+    State journaled = resumeTarget != ESTADO0_INICIO ? resumeTarget : newState;
+    if (journaled == ESTADO0_INICIO && pastillasCount > 0) {
+      journaled = ESTADO2_DOSIFICACION;
+    }
+    Checkpoint::save(journaled, pastillasCount);
     
     // Send pill count for relevant states
     if (newState == ESTADO2_DOSIFICACION || newState == ESTADO4_TRASPASO || newState == ESTADO3_PESAJE) {
-      Serial.print("PASTILLAS:");
-      Serial.print(pastillasCount);
-      Serial.print("/");
-      Serial.println(lot_size);
-      Serial.flush();
+      host.print("PASTILLAS:");
+      host.print(pastillasCount);
+      host.print("/");
+      host.println(lot_size);
+      host.flush();
     }
     
-    // Report expected delay for new state (for loading animation)
-    unsigned long expectedDelay = getExpectedStateDelay(newState);
+    // Report predicted duration for new state (for loading animation)
+    unsigned long expectedDelay = getPredictedDuration(newState);
     if (expectedDelay > 0) {
-      Serial.print("PROGRESO:");
-      Serial.print(getStateName(newState));
-      Serial.print(",");
-      Serial.println(expectedDelay);
-      Serial.flush();
+      host.print("PROGRESO:");
+      host.print(getStateName(newState));
+      host.print(",");
+      host.println(expectedDelay);
+      
+      host.print("ETA:");
+      host.println(getLotEta());
+      host.flush();
     }
   }
 }
 
+void StateMachine::learnDuration(State state, unsigned long elapsed) {
+  if (getExpectedStateDelay(state) == 0) {
+    return;  // Waiting states (INICIO, RETIRO) depend on the operator
+  }
+  
+  unsigned long& learned = learnedDuration[state];
+  if (learned == 0) {
+    learned = elapsed;
+  } else if (elapsed >= learned) {
+    learned += (elapsed - learned) >> DURATION_EWMA_SHIFT;
+  } else {
+    learned -= (learned - elapsed) >> DURATION_EWMA_SHIFT;
+  }
+}
+
+unsigned long StateMachine::getPredictedDuration(State state) const {
+  // Configured delay until the state has been timed at least once
+  unsigned long learned = learnedDuration[state];
+  return learned > 0 ? learned : getExpectedStateDelay(state);
+}
+
+unsigned long StateMachine::getLotEta() const {
+  unsigned long perPill = getPredictedDuration(ESTADO2_DOSIFICACION) +
+                          getPredictedDuration(ESTADO3_PESAJE) +
+                          getPredictedDuration(ESTADO4_TRASPASO);
+  unsigned long tail = getPredictedDuration(ESTADO5_MOLIENDA) +
+                       getPredictedDuration(ESTADO6_DESCARGA) +
+                       getPredictedDuration(ESTADO7_CIERRE);
+  long pillsLeft = lot_size - pastillasCount;  // Including the pill in progress
+  if (pillsLeft < 0) pillsLeft = 0;
+  long pillsAfter = pillsLeft > 0 ? pillsLeft - 1 : 0;
+  
+  // From the start of the current state
+  switch (currentState) {
+    case ESTADO1_ASCENSOR:
+      return getPredictedDuration(ESTADO1_ASCENSOR) + pillsLeft * perPill + tail;
+    case ESTADO2_DOSIFICACION:
+      return pillsLeft * perPill + tail;
+    case ESTADO3_PESAJE:
+      return getPredictedDuration(ESTADO3_PESAJE) + getPredictedDuration(ESTADO4_TRASPASO) +
+             pillsAfter * perPill + tail;
+    case ESTADO4_TRASPASO:
+      return getPredictedDuration(ESTADO4_TRASPASO) + pillsAfter * perPill + tail;
+    case ESTADO5_MOLIENDA:
+      return tail;
+    case ESTADO6_DESCARGA:
+      return getPredictedDuration(ESTADO6_DESCARGA) + getPredictedDuration(ESTADO7_CIERRE);
+    case ESTADO7_CIERRE:
+      return getPredictedDuration(ESTADO7_CIERRE);
+    default:
+      return 0;
+  }
+}
+
+void StateMachine::printDurations() {
+  host.print("DURACIONES:");
+  for (int i = ESTADO1_ASCENSOR; i <= ESTADO7_CIERRE; i++) {
+    if (i > ESTADO1_ASCENSOR) host.print(",");
+    host.print(getStateName((State)i));
+    host.print(":");
+    host.print(getPredictedDuration((State)i));
+  }
+  host.print(",ETA:");
+  host.println(getLotEta());
+}
+
+bool StateMachine::isScaleIdle() const {
+  // Empty before the lot and after the last transfer. Between pills
+  // 2_DOSIFICACION feeds its own window before the drop (see startDrop)
+  bool empty = currentState == ESTADO0_INICIO || currentState >= ESTADO5_MOLIENDA;
+  return empty && !elevator.isMoving() && !dosingWheel.isDispensing() &&
+         !grinder.isRunning() && !transferSolenoid.isActive() && !capSolenoid.isActive();
+}
+
+uint8_t StateMachine::classifyDose(float delta) const {
+  if (delta < loadCell.getThreshold()) return 0;
+  if (pill_weight <= 0) return 1;
+  
+  // Something above the threshold is at least one pill, even a chipped one
+  long pills = (long)(delta / pill_weight + 0.5);
+  return pills < 1 ? 1 : pills > 255 ? 255 : pills;
+}
+
+void StateMachine::printDoseStats() {
+  host.print("DOSIS:PESO:");
+  host.print(pill_weight, 3);
+  host.print(",REINTENTOS:");
+  host.print(lotRetries);
+  host.print(",MULTIPLES:");
+  host.println(lotMultiples);
+}
+
+void StateMachine::abortLot() {
+  host.print("LOTE:ABORTADO:");
+  host.print(pastillasCount);
+  host.print("/");
+  host.println(lot_size);
+  PillLedger::report();  // What went into the jar that is being discarded
+  
+  pastillasCount = 0;
+  doseRetries = 0;
+  lotRetries = 0;
+  lotMultiples = 0;
+  PillLedger::clear();
+  Checkpoint::save(ESTADO0_INICIO, 0);
+  host.print("PASTILLAS:0/");
+  host.println(lot_size);
+}
+
+void StateMachine::resetPillCount() {
+  if (isLotPaused()) {
+    Checkpoint::save(ESTADO0_INICIO, 0);  // The paused lot is dropped, nothing left to resume
+  }
+  pastillasCount = 0;
+}
+
+void StateMachine::resume(State target, int pills) {
+  pastillasCount = pills;
+  dosePills = 1;
+  doseRetries = 0;
+  PillLedger::markResumed();
+  
+  // Actuators come up in their rest state; put the jar back where the target state expects it
+  if (target >= ESTADO2_DOSIFICACION && target <= ESTADO5_MOLIENDA && !elevator.isAtTop()) {
+    resumeTarget = target;
+    changeState(ESTADO1_ASCENSOR);
+  } else if (target >= ESTADO7_CIERRE && !elevator.isAtBottom()) {
+    // Lowered straight to the target: through ESTADO7 a closed jar would get the cap pushed again
+    resumeTarget = target;
+    changeState(ESTADO6_DESCARGA);
+  } else {
+    changeState(target);
+  }
+}
+
 unsigned long StateMachine::getExpectedStateDelay(State state) const {
   switch(state) {
     case ESTADO1_ASCENSOR: return t_elev_up;
@@ -90,6 +269,13 @@ String StateMachine::getStateName(State state) const {
   }
 }
 
+void StateMachine::startDrop() {
+  // Dispense one pill, sampling the empty pan while the wheel turns
+  dropStart = millis();
+  loadCell.startBaseline();
+  dosingWheel.dispenseOne();
+}
+
 bool StateMachine::stateTimeout(unsigned long timeout) const {
   return (millis() - stateTimer) >= timeout;
 }
@@ -108,38 +294,57 @@ void StateMachine::executeStateEntry() {
       if (previousState == ESTADO8_RETIRO) {
         inputs.simulateFrasco(true);  // Container empty for new cycle
         inputs.simulatePastillas(true);  // Pills loaded for new cycle
-        Serial.println("SENSORES:FRASCO_VACIO:1");
-        Serial.println("SENSORES:PASTILLAS_CARGADAS:1");
+        host.println("SENSORES:FRASCO_VACIO:1");
+        host.println("SENSORES:PASTILLAS_CARGADAS:1");
       }
       break;
       
     case ESTADO1_ASCENSOR:
-      // Start elevator going up
-      elevator.moveUp();
+      // On a lot start the wheel can dose the first pill during the ascent;
+      // re-entries (resume, transfer interlock) may already have one on the pan
+      prestaged = prestage && previousState == ESTADO0_INICIO &&
+                  resumeTarget == ESTADO0_INICIO && pastillasCount < lot_size;
+      prestageDrop = 0;
+      prestageHold = prestaged;
+      if (prestaged) {
+        // The moving elevator shakes the pan: take the baseline first, then
+        // start both axes (see executeStateContinuous)
+        loadCell.startBaseline();
+      } else {
+        elevator.moveUp();
+      }
       break;
       
     case ESTADO2_DOSIFICACION:
-      // Dispense one pill
-      dosingWheel.dispenseOne();
+      // The pan is empty and still after the transfer: give zero tracking a
+      // few conversions before the wheel moves. Only at 80 SPS: at 10 they
+      // would add 400 ms to every pill, and idle tracking covers the drift
+      zeroWindow = loadCell.isZeroTracking() && loadCell.getSampleRate() >= ZERO_TRACK_PREDROP_MIN_SPS;
+      zeroSamples = 0;
+      if (!zeroWindow) {
+        startDrop();
+      }
       break;
       
     case ESTADO3_PESAJE:
       // Start weight monitoring
       if (loadCell.isConnected()) {
         loadCell.readWeight();  // Get initial reading
+        loadCell.restartStability();
       }
       break;
       
     case ESTADO4_TRASPASO:
       // Only activate transfer solenoid if elevator is up
       if (!elevator.isAtTop()) {
-        Serial.println("ERROR:ELEVADOR_DEBE_ESTAR_ARRIBA");
+        host.println("ERROR:ELEVADOR_DEBE_ESTAR_ARRIBA");
         changeState(ESTADO1_ASCENSOR);  // Go back to elevating
       } else {
+        WeightTrace::trigger(TRACE_TRANSFER);
         transferSolenoid.activate();
         // Clear weight stable since pill is being removed
         // loadCell.simulateWeight(false);
-        // Serial.println("SIM:WEIGHT_STABLE:OFF");
+        // host.println("SIM:WEIGHT_STABLE:OFF");
       }
       break;
       
@@ -164,6 +369,10 @@ void StateMachine::executeStateEntry() {
       grinder.stop();
       transferSolenoid.deactivate();
       capSolenoid.deactivate();
+      
+      // One block with every pill of the lot
+      printDoseStats();
+      PillLedger::report();
       break;
   }
 }
@@ -172,25 +381,51 @@ void StateMachine::executeStateContinuous() {
   // Continuous actions - executed every cycle while in state
   switch(currentState) {
     case ESTADO1_ASCENSOR:
+      if (prestageHold) {
+        loadCell.pollBaseline();
+        if (loadCell.isBaselineReady() || stateTimeout(PRESTAGE_BASELINE_TIMEOUT)) {
+          prestageHold = false;
+          elevator.moveUp();
+          dosingWheel.dispenseOne();
+        }
+        break;
+      }
+      
       // Keep elevator running
       elevator.run();
+      
+      // The wheel is serviced from loop(); time the drop of a pre-staged dose
+      if (prestaged && !dosingWheel.isDispensing() && prestageDrop == 0) {
+        prestageDrop = millis();
+      }
       break;
       
     case ESTADO2_DOSIFICACION:
-      // Keep dosing motor running
-      dosingWheel.run();
+      if (zeroWindow) {
+        if (loadCell.trackZero(!elevator.isMoving() && !transferSolenoid.isActive())) {
+          zeroSamples++;
+        }
+        if (zeroSamples >= ZERO_TRACK_PREDROP_SAMPLES || stateTimeout(ZERO_TRACK_PREDROP_TIMEOUT)) {
+          zeroWindow = false;
+          startDrop();
+        }
+      } else if (dosingWheel.isDispensing()) {
+        // Baseline until the pocket reaches the chute
+        loadCell.pollBaseline();
+      }
       break;
       
     case ESTADO3_PESAJE:
       // Continuously monitor weight
       if (loadCell.isConnected()) {
         float weight = loadCell.readWeight();
+        Session::recordWeight(weight);
         
         // Print significant weight changes
         static float lastPrintedWeight = 0;
-        if (abs(weight - lastPrintedWeight) > WEIGHT_PRINT_THRESHOLD) {
-          Serial.print("PESO:");
-          Serial.println(weight, 2);
+        if (weightStream && abs(weight - lastPrintedWeight) > WEIGHT_PRINT_THRESHOLD) {
+          host.print("PESO:");
+          host.println(weight, 2);
           lastPrintedWeight = weight;
         }
       }
@@ -211,31 +446,107 @@ void StateMachine::processTransitions() {
   // Check transition conditions and change state if needed
   switch(currentState) {
     case ESTADO0_INICIO:
-      // Wait for START button with all conditions met
+      // Wait for START button with all conditions met. A lot paused for
+      // lack of pills continues into its own jar, which is no longer empty
       if (inputs.isStartPressed() && 
-          inputs.isFrascoVacio() && 
+          (isLotPaused() || inputs.isFrascoVacio()) && 
           inputs.isPastillasCargadas()) {
-        changeState(ESTADO1_ASCENSOR);
+        if (MotionSweep::isActive()) {
+          // The sweep owns the motors and their profiles until SWEEP:FIN
+          host.println("ERROR:SWEEP_EN_CURSO");
+        } else {
+          if (pastillasCount == 0) {
+            PillLedger::clear();
+            lotRetries = 0;
+            lotMultiples = 0;
+          } else {
+            host.print("LOTE:CONTINUANDO:");
+            host.print(pastillasCount);
+            host.print("/");
+            host.println(lot_size);
+          }
+          doseRetries = 0;
+          changeState(ESTADO1_ASCENSOR);
+        }
       }
       break;
       
     case ESTADO1_ASCENSOR:
       // Wait for elevator to reach top (must be moving and then arrive)
       if (elevator.isAtTop() && !elevator.isMoving()) {
-        changeState(ESTADO2_DOSIFICACION);
+        if (resumeTarget != ESTADO0_INICIO) {
+          // Re-homed after a resume, continue where the lot stopped
+          State target = resumeTarget;
+          resumeTarget = ESTADO0_INICIO;
+          changeState(target);
+        } else if (prestaged) {
+          // Pill dosed on the way up: weigh it once it has settled. Weighing
+          // (and so the transfer) only starts with the jar at the top
+          if (prestageDrop != 0 && millis() - prestageDrop >= T_STEP_SETTLE) {
+            prestaged = false;
+            changeState(ESTADO3_PESAJE);
+          }
+        } else {
+          changeState(ESTADO2_DOSIFICACION);
+        }
       }
       break;
       
     case ESTADO2_DOSIFICACION:
       // Wait for dosing to complete and settle
-      if (!dosingWheel.isDispensing() && stateTimeout(T_STEP_SETTLE)) {
+      if (!zeroWindow && !dosingWheel.isDispensing() && millis() - dropStart >= T_STEP_SETTLE) {
         changeState(ESTADO3_PESAJE);
       }
       break;
       
     case ESTADO3_PESAJE:
-      // Wait for weight to stabilize
-      if (stateTimeout(T_WEIGHT_SETTLE) && loadCell.isWeightStable()) {
+      if (loadCell.isMeasuring()) {
+        // Differential: done as soon as the reading settles, with the pill
+        // (delta over the baseline) or without it
+        if (loadCell.isWeightStable()) {
+          float delta = loadCell.getDelta();
+          uint8_t pills = classifyDose(delta);
+          
+          if (pills == 0) {
+            // Empty pocket, nothing to transfer: dose from the next one
+            lotRetries++;
+            doseRetries++;
+            host.print("DOSIS:VACIA,REINTENTO:");
+            host.println(doseRetries);
+            if (doseRetries > DOSE_MAX_RETRIES) {
+              // Paused: START continues the lot after refilling, LOT:ABORT drops it
+              host.println("ERROR:SIN_PASTILLAS");
+              host.print("LOTE:PAUSADO:");
+              host.print(pastillasCount);
+              host.print("/");
+              host.println(lot_size);
+              changeState(ESTADO0_INICIO);
+            } else {
+              changeState(ESTADO2_DOSIFICACION);
+            }
+            break;
+          }
+          
+          uint8_t flags = 0;
+          if (doseRetries > 0) flags |= LEDGER_REDOSIS;
+          if (pills > 1) {
+            flags |= LEDGER_MULTIPLE;
+            lotMultiples++;
+            host.print("DOSIS:MULTIPLE:");
+            host.println(pills);
+          }
+          if (getStateTime() > 2 * T_WEIGHT_SETTLE) flags |= LEDGER_PESAJE_LENTO;
+          dosePills = pills;
+          PillLedger::recordWeight(delta, getStateTime(), flags);
+          changeState(ESTADO4_TRASPASO);
+        }
+      } else if (stateTimeout(T_WEIGHT_SETTLE) && loadCell.isWeightStable()) {
+        // Simulation or no scale: wait out the settle time
+        uint8_t flags = 0;
+        if (!loadCell.isConnected()) flags |= LEDGER_SIN_BALANZA;
+        if (globalMode == MODE_SIMULATION) flags |= LEDGER_SIMULADO;
+        dosePills = 1;
+        PillLedger::recordWeight(loadCell.getWeight(), getStateTime(), flags);
         changeState(ESTADO4_TRASPASO);
       }
       break;
@@ -244,12 +555,21 @@ void StateMachine::processTransitions() {
       // Wait for transfer time
       if (stateTimeout(T_TRANSFER)) {
         transferSolenoid.deactivate();
-        pastillasCount++;
+        pastillasCount += dosePills;
+        dosePills = 1;
+        doseRetries = 0;
+        PillLedger::commit(pastillasCount, getStateTime());
         
-        Serial.print("PASTILLAS:");
-        Serial.print(pastillasCount);
-        Serial.print("/");
-        Serial.println(lot_size);
+        if (pastillasCount > lot_size) {
+          // A multiple drop overfilled the jar; nothing can divert it
+          host.print("ERROR:LOTE_EXCEDIDO:");
+          host.println(pastillasCount - lot_size);
+        }
+        
+        host.print("PASTILLAS:");
+        host.print(pastillasCount);
+        host.print("/");
+        host.println(lot_size);
         
         if (pastillasCount < lot_size) {
           // Continue with next pill
@@ -272,7 +592,14 @@ void StateMachine::processTransitions() {
     case ESTADO6_DESCARGA:
       // Wait for elevator to reach bottom
       if (elevator.isAtBottom()) {
-        changeState(ESTADO7_CIERRE);
+        if (resumeTarget != ESTADO0_INICIO) {
+          // Re-homed after a resume, continue where the lot stopped
+          State target = resumeTarget;
+          resumeTarget = ESTADO0_INICIO;
+          changeState(target);
+        } else {
+          changeState(ESTADO7_CIERRE);
+        }
       }
       break;
       
@@ -288,7 +615,7 @@ void StateMachine::processTransitions() {
       // Wait for RESET button
       if (inputs.isResetPressed()) {
         pastillasCount = 0;
-        Serial.println("PASTILLAS:0/0");
+        host.println("PASTILLAS:0/0");
         changeState(ESTADO0_INICIO);
       }
       break;
@@ -31,6 +31,7 @@ extern unsigned long t_elev_down;
 // Global dosing parameters (extern declarations)
 extern int wheel_divisions;
 extern int lot_size;
+extern float pill_weight;
 
 // State machine class
 class StateMachine {
@@ -39,10 +40,36 @@ private:
   State previousState;
   bool stateJustChanged;
   unsigned long stateTimer;
+  State resumeTarget;  // State to enter once the elevator is re-homed (top or bottom)
   
   // Process variables
   int pastillasCount;
   
+  // Learned state durations (ms), 0 until the state has completed once
+  unsigned long learnedDuration[ESTADO8_RETIRO + 1];
+  
+  bool weightStream;  // PESO: lines while weighing
+  
+  // Weight-verified dosing
+  uint8_t dosePills;         // Pills seen by 3_PESAJE, counted when the transfer ends
+  uint8_t doseRetries;       // Empty drops in a row for the current pill
+  unsigned int lotRetries;   // Empty drops re-dosed this lot
+  unsigned int lotMultiples; // Drops with more than one pill this lot
+  
+  // Zero tracking window between the transfer and the next drop
+  bool zeroWindow;
+  uint8_t zeroSamples;
+  unsigned long dropStart;
+  void startDrop();
+  
+  // First pill dosed during the ascent
+  bool prestage;
+  bool prestaged;            // This ascent carries a dose
+  bool prestageHold;         // Elevator and wheel wait for the still-pan baseline
+  unsigned long prestageDrop; // When the wheel stopped, 0 while it turns
+  
+  void learnDuration(State state, unsigned long elapsed);
+  
 public:
   StateMachine();
   
@@ -60,7 +87,14 @@ public:
   int getPillCount() const { return pastillasCount; }
   int getLotSize() const { return lot_size; }  // Use global lot_size directly
   void incrementPillCount() { pastillasCount++; }
-  void resetPillCount() { pastillasCount = 0; }
+  void resetPillCount();  // Also drops a paused lot from the checkpoint
+  void resume(State target, int pills);
+  bool isLotPaused() const { return currentState == ESTADO0_INICIO && pastillasCount > 0; }
+  void abortLot();  // Drops a paused lot: reports its ledger, count back to 0
+  void setWeightStream(bool on) { weightStream = on; }
+  bool getWeightStream() const { return weightStream; }
+  void setPrestage(bool on) { prestage = on; }
+  bool getPrestage() const { return prestage; }
   
   // State transitions
   void processTransitions();
@@ -69,6 +103,19 @@ public:
   
   // Helper functions
   unsigned long getExpectedStateDelay(State state) const;
+  
+  // Duration prediction
+  unsigned long getPredictedDuration(State state) const;
+  unsigned long getLotEta() const;  // ms until the lot reaches ESTADO8_RETIRO
+  void printDurations();
+  
+  // Pills in a drop from its weight delta: 0 below the threshold, otherwise
+  // the nearest multiple of pill_weight (1 if no nominal weight is set)
+  uint8_t classifyDose(float delta) const;
+  void printDoseStats();
+  
+  // Pan empty and nothing moving, the load cell may track its zero
+  bool isScaleIdle() const;
 };
 
 extern StateMachine stateMachine;
@@ -1,4 +1,5 @@
 #include "test_mode.h"
+#include "host_link.h"
 #include "hardware.h"
 #include "serial_protocol.h"
 
@@ -7,9 +8,9 @@ bool TestMode::testModeActive = false;
 extern Elevator elevator;
 extern DosingWheel dosingWheel;
 extern LoadCell loadCell;
-extern Grinder grinder;
-extern Solenoid transferSolenoid;
-extern Solenoid capSolenoid;
+extern Grinder<MOTOR3_RELAY_PIN> grinder;
+extern Solenoid<SOLENOID1_PIN> transferSolenoid;
+extern Solenoid<SOLENOID2_PIN> capSolenoid;
 
 void TestMode::init() {
   testModeActive = false;
@@ -23,33 +24,36 @@ void TestMode::setActive(bool active) {
   testModeActive = active;
   if (active) {
     setGlobalMode(MODE_TEST);
-    Serial.println(F("TEST_MODE:ENABLED"));
-    Serial.println(F("Test mode enabled - Manual control active"));
-    Serial.println(F("Available test commands:"));
-    Serial.println(F("  ELEVATOR_UP    - Move elevator up"));
-    Serial.println(F("  ELEVATOR_DOWN  - Move elevator down"));
-    Serial.println(F("  ELEVATOR_STOP  - Stop elevator"));
-    Serial.println(F("  DOSING_STEP    - Dispense one pill"));
-    Serial.println(F("  DOSING_STOP    - Stop dosing wheel"));
-    Serial.println(F("  GRINDER_ON     - Turn grinder on"));
-    Serial.println(F("  GRINDER_OFF    - Turn grinder off"));
-    Serial.println(F("  TRANSFER_ON    - Open transfer solenoid"));
-    Serial.println(F("  TRANSFER_OFF   - Close transfer solenoid"));
-    Serial.println(F("  CAP_ON         - Push cap solenoid"));
-    Serial.println(F("  CAP_OFF        - Retract cap solenoid"));
-    Serial.println(F("  WEIGHT         - Read current weight"));
-    Serial.println(F("  TEST_STATUS    - Get all hardware status"));
-    Serial.println(F("  EXIT_TEST      - Exit test mode"));
+    host.println(F("TEST_MODE:ENABLED"));
+    host.println(F("Test mode enabled - Manual control active"));
+    host.println(F("Available test commands:"));
+    host.println(F("  ELEVATOR_UP    - Move elevator up"));
+    host.println(F("  ELEVATOR_DOWN  - Move elevator down"));
+    host.println(F("  ELEVATOR_STOP  - Stop elevator"));
+    host.println(F("  DOSING_STEP    - Dispense one pill"));
+    host.println(F("  DOSING_STOP    - Stop dosing wheel"));
+    host.println(F("  GRINDER_ON     - Turn grinder on"));
+    host.println(F("  GRINDER_OFF    - Turn grinder off"));
+    host.println(F("  TRANSFER_ON    - Open transfer solenoid"));
+    host.println(F("  TRANSFER_OFF   - Close transfer solenoid"));
+    host.println(F("  CAP_ON         - Push cap solenoid"));
+    host.println(F("  CAP_OFF        - Retract cap solenoid"));
+    host.println(F("  WEIGHT         - Read current weight"));
+    host.println(F("  TEST_STATUS    - Get all hardware status"));
+    host.println(F("  SCRIPT:ADD:<step>[;<step>] - Append script steps (WAIT, REPEAT n, END)"));
+    host.println(F("  SCRIPT:RUN     - Run the script on the controller"));
+    host.println(F("  SCRIPT:STOP    - Abort the script and stop actuators"));
+    host.println(F("  EXIT_TEST      - Exit test mode"));
   } else {
     setGlobalMode(MODE_SIMULATION);
-    Serial.println(F("TEST_MODE:DISABLED"));
-    Serial.println(F("Test mode disabled - Returning to normal mode"));
+    host.println(F("TEST_MODE:DISABLED"));
+    host.println(F("Test mode disabled - Returning to normal mode"));
   }
 }
 
 void TestMode::processCommand(const String& command) {
   if (!testModeActive) {
-    Serial.println(F("ERROR: Test mode not active"));
+    host.println(F("ERROR: Test mode not active"));
     return;
   }
   
@@ -85,111 +89,111 @@ void TestMode::processCommand(const String& command) {
   } else if (cmd == "EXIT_TEST") {
     setActive(false);
   } else {
-    Serial.print(F("ERROR: Unknown test command: "));
-    Serial.println(cmd);
+    host.print(F("ERROR: Unknown test command: "));
+    host.println(cmd);
   }
 }
 
 void TestMode::elevatorUp() {
   elevator.moveUp();
-  Serial.println(F("TEST:ELEVATOR:MOVING_UP"));
+  host.println(F("TEST:ELEVATOR:MOVING_UP"));
 }
 
 void TestMode::elevatorDown() {
   elevator.moveDown();
-  Serial.println(F("TEST:ELEVATOR:MOVING_DOWN"));
+  host.println(F("TEST:ELEVATOR:MOVING_DOWN"));
 }
 
 void TestMode::elevatorStop() {
   elevator.stop();
-  Serial.println(F("TEST:ELEVATOR:IDLE"));
+  host.println(F("TEST:ELEVATOR:IDLE"));
 }
 
 void TestMode::dosingWheelStep() {
   if (!dosingWheel.isDispensing()) {
     dosingWheel.dispenseOne();
-    Serial.println(F("TEST:DOSING:STEP"));
+    host.println(F("TEST:DOSING:STEP"));
   } else {
-    Serial.println(F("TEST:DOSING:BUSY"));
+    host.println(F("TEST:DOSING:BUSY"));
   }
 }
 
 void TestMode::dosingWheelStop() {
   dosingWheel.stop();
-  Serial.println(F("TEST:DOSING:STOP"));
+  host.println(F("TEST:DOSING:STOP"));
 }
 
 void TestMode::grinderOn() {
   grinder.start();
-  Serial.println(F("TEST:GRINDER:ON"));
+  host.println(F("TEST:GRINDER:ON"));
 }
 
 void TestMode::grinderOff() {
   grinder.stop();
-  Serial.println(F("TEST:GRINDER:OFF"));
+  host.println(F("TEST:GRINDER:OFF"));
 }
 
 void TestMode::transferSolenoidOn() {
   transferSolenoid.activate();
-  Serial.println(F("TEST:TRANSFER:ON"));
+  host.println(F("TEST:TRANSFER:ON"));
 }
 
 void TestMode::transferSolenoidOff() {
   transferSolenoid.deactivate();
-  Serial.println(F("TEST:TRANSFER:OFF"));
+  host.println(F("TEST:TRANSFER:OFF"));
 }
 
 void TestMode::capSolenoidOn() {
   capSolenoid.activate();
-  Serial.println(F("TEST:CAP:ON"));
+  host.println(F("TEST:CAP:ON"));
 }
 
 void TestMode::capSolenoidOff() {
   capSolenoid.deactivate();
-  Serial.println(F("TEST:CAP:OFF"));
+  host.println(F("TEST:CAP:OFF"));
 }
 
 void TestMode::readWeight() {
   float weight = loadCell.readWeight();
-  Serial.print(F("TEST:WEIGHT:"));
-  Serial.println(weight);
+  host.print(F("TEST:WEIGHT:"));
+  host.println(weight);
 }
 
 void TestMode::getStatus() {
-  Serial.println(F("TEST:STATUS:START"));
+  host.println(F("TEST:STATUS:START"));
   
   // Elevator status
-  Serial.print(F("  Elevator: "));
+  host.print(F("  Elevator: "));
   if (elevator.isMoving()) {
-    Serial.println(F("MOVING"));
+    host.println(F("MOVING"));
   } else if (elevator.isAtTop()) {
-    Serial.println(F("TOP"));
+    host.println(F("TOP"));
   } else if (elevator.isAtBottom()) {
-    Serial.println(F("BOTTOM"));
+    host.println(F("BOTTOM"));
   } else {
-    Serial.println(F("MIDDLE"));
+    host.println(F("MIDDLE"));
   }
   
   // Dosing wheel status
-  Serial.print(F("  Dosing: "));
-  Serial.println(dosingWheel.isDispensing() ? F("ACTIVE") : F("IDLE"));
+  host.print(F("  Dosing: "));
+  host.println(dosingWheel.isDispensing() ? F("ACTIVE") : F("IDLE"));
   
   // Grinder status
-  Serial.print(F("  Grinder: "));
-  Serial.println(grinder.isRunning() ? F("ON") : F("OFF"));
+  host.print(F("  Grinder: "));
+  host.println(grinder.isRunning() ? F("ON") : F("OFF"));
   
   // Transfer solenoid status
-  Serial.print(F("  Transfer: "));
-  Serial.println(transferSolenoid.isActive() ? F("OPEN") : F("CLOSED"));
+  host.print(F("  Transfer: "));
+  host.println(transferSolenoid.isActive() ? F("OPEN") : F("CLOSED"));
   
   // Cap solenoid status
-  Serial.print(F("  Cap: "));
-  Serial.println(capSolenoid.isActive() ? F("PUSHED") : F("RETRACTED"));
+  host.print(F("  Cap: "));
+  host.println(capSolenoid.isActive() ? F("PUSHED") : F("RETRACTED"));
   
   // Weight
-  Serial.print(F("  Weight: "));
-  Serial.print(loadCell.readWeight());
-  Serial.println(F(" mg"));
+  host.print(F("  Weight: "));
+  host.print(loadCell.readWeight());
+  host.println(F(" mg"));
   
-  Serial.println(F("TEST:STATUS:END"));
+  host.println(F("TEST:STATUS:END"));
 }
\ No newline at end of file
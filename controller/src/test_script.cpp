@@ -0,0 +1,500 @@
+#include "test_script.h"
+#include "test_mode.h"
+#include "host_link.h"
+#include "hardware.h"
+#include "crc8.h"
+#include <EEPROM.h>
+
+#define SCRIPT_MAGIC 0x5C
+
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+
+extern Elevator elevator;
+extern DosingWheel dosingWheel;
+extern LoadCell loadCell;
+extern Grinder<MOTOR3_RELAY_PIN> grinder;
+extern Solenoid<SOLENOID1_PIN> transferSolenoid;
+extern Solenoid<SOLENOID2_PIN> capSolenoid;
+
+// TestMode commands a script may call, indexed by OP_ACTION's arg. The
+// readings come last: only they print during a run (see run())
+static const char* const ACTIONS[] = {
+  "ELEVATOR_UP", "ELEVATOR_DOWN", "ELEVATOR_STOP",
+  "DOSING_STEP", "DOSING_STOP",
+  "GRINDER_ON", "GRINDER_OFF",
+  "TRANSFER_ON", "TRANSFER_OFF",
+  "CAP_ON", "CAP_OFF",
+  "WEIGHT", "TEST_STATUS"
+};
+static const uint8_t ACTION_COUNT = sizeof(ACTIONS) / sizeof(ACTIONS[0]);
+static const uint8_t ACTION_READINGS = 2;  // WEIGHT, TEST_STATUS
+
+TestScript::Step TestScript::steps[SCRIPT_MAX_STEPS];
+uint8_t TestScript::count = 0;
+TestScript::Loop TestScript::loops[SCRIPT_MAX_DEPTH];
+uint8_t TestScript::depth = 0;
+uint8_t TestScript::pc = 0;
+bool TestScript::running = false;
+bool TestScript::waiting = false;
+unsigned long TestScript::waitMicros = 0;
+unsigned long TestScript::waitMillis = 0;
+unsigned long TestScript::runMicros = 0;
+unsigned long TestScript::runMillis = 0;
+TestScript::Report TestScript::reports[SCRIPT_REPORTS];
+uint8_t TestScript::reportHead = 0;
+uint8_t TestScript::reportCount = 0;
+bool TestScript::streamingScale = false;
+
+static bool isNumber(const String& text) {
+  if (text.length() == 0) return false;
+  for (unsigned int i = 0; i < text.length(); i++) {
+    if (!isDigit(text[i])) return false;
+  }
+  return true;
+}
+
+void TestScript::init() {
+  running = false;
+  if (!load()) {
+    count = 0;
+  }
+}
+
+bool TestScript::processCommand(const String& command) {
+  if (!command.startsWith("SCRIPT:")) {
+    return false;
+  }
+
+  if (command == "SCRIPT:STOP") {
+    if (running) {
+      stop("STOP");
+    } else {
+      host.println(F("SCRIPT:INACTIVO"));
+    }
+    return true;
+  }
+  if (command == "SCRIPT:LIST") {
+    host.print(F("SCRIPT:PASOS:"));
+    host.println(count);
+    for (uint8_t i = 0; i < count; i++) {
+      printStep(i);
+    }
+    return true;
+  }
+
+  // Everything below changes or starts the script
+  if (running) {
+    host.println(F("ERROR:SCRIPT_EN_CURSO"));
+    return true;
+  }
+
+  if (command == "SCRIPT:CLEAR") {
+    count = 0;
+    host.println(F("SCRIPT:VACIO"));
+  } else if (command.startsWith("SCRIPT:ADD:")) {
+    // Several steps per line, separated by ';'
+    String rest = command.substring(11);
+    while (rest.length() > 0) {
+      int sep = rest.indexOf(';');
+      String text = sep < 0 ? rest : rest.substring(0, sep);
+      rest = sep < 0 ? String("") : rest.substring(sep + 1);
+      if (!add(text)) return true;
+    }
+    host.print(F("SCRIPT:PASOS:"));
+    host.println(count);
+  } else if (command == "SCRIPT:RUN") {
+    if (!TestMode::isActive()) {
+      host.println(F("ERROR:SCRIPT_REQUIERE_TEST"));
+    } else if (count == 0) {
+      host.println(F("ERROR:SCRIPT_VACIO"));
+    } else if (!isBalanced()) {
+      host.println(F("ERROR:SCRIPT_ESTRUCTURA"));
+    } else {
+      start();
+    }
+  } else if (command == "SCRIPT:SAVE") {
+    if (save()) {
+      host.print(F("SCRIPT:GUARDADO,PASOS:"));
+      host.println(count);
+    } else {
+      host.println(F("ERROR:SCRIPT_VACIO"));
+    }
+  } else if (command == "SCRIPT:LOAD") {
+    if (load()) {
+      host.print(F("SCRIPT:CARGADO,PASOS:"));
+      host.println(count);
+    } else {
+      host.println(F("ERROR:SCRIPT_EEPROM"));
+    }
+  } else {
+    host.print(F("UNKNOWN:"));
+    host.println(command);
+  }
+  return true;
+}
+
+bool TestScript::add(String text) {
+  if (count >= SCRIPT_MAX_STEPS) {
+    host.println(F("ERROR:SCRIPT_LLENO"));
+    return false;
+  }
+  if (!parseStep(text, steps[count])) {
+    host.print(F("ERROR:SCRIPT_PASO:"));
+    host.println(text);
+    return false;
+  }
+  count++;
+  return true;
+}
+
+bool TestScript::parseStep(String text, Step& step) {
+  text.trim();
+  text.toUpperCase();
+
+  if (text == "END") {
+    step.op = OP_END;
+    step.arg = 0;
+    return true;
+  }
+  if (text.startsWith("REPEAT ")) {
+    String n = text.substring(7);
+    n.trim();
+    if (!isNumber(n)) return false;
+    step.op = OP_REPEAT;
+    step.arg = n.toInt();
+    return true;
+  }
+  if (text.startsWith("WAIT ")) {
+    String rest = text.substring(5);
+    rest.trim();
+    if (isNumber(rest)) {
+      step.op = OP_WAIT_MS;
+      step.arg = rest.toInt();
+      return true;
+    }
+
+    if (rest.startsWith("ELEVATOR TOP")) {
+      step.op = OP_WAIT_TOP;
+      rest = rest.substring(12);
+    } else if (rest.startsWith("ELEVATOR BOTTOM")) {
+      step.op = OP_WAIT_BOTTOM;
+      rest = rest.substring(15);
+    } else if (rest.startsWith("WEIGHT STABLE")) {
+      step.op = OP_WAIT_STABLE;
+      rest = rest.substring(13);
+    } else if (rest.startsWith("DOSING IDLE")) {
+      step.op = OP_WAIT_DOSING;
+      rest = rest.substring(11);
+    } else {
+      return false;
+    }
+
+    // Optional timeout in ms
+    rest.trim();
+    if (rest.length() == 0) {
+      step.arg = SCRIPT_WAIT_TIMEOUT;
+    } else if (isNumber(rest)) {
+      step.arg = rest.toInt();
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  for (uint8_t i = 0; i < ACTION_COUNT; i++) {
+    if (text == ACTIONS[i]) {
+      step.op = OP_ACTION;
+      step.arg = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TestScript::isBalanced() {
+  uint8_t open = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (steps[i].op == OP_REPEAT) {
+      if (++open > SCRIPT_MAX_DEPTH) return false;
+    } else if (steps[i].op == OP_END) {
+      if (open == 0) return false;
+      open--;
+    }
+  }
+  return open == 0;
+}
+
+void TestScript::start() {
+  running = true;
+  waiting = false;
+  depth = 0;
+  pc = 0;
+  reportHead = 0;
+  reportCount = 0;
+  runMillis = millis();
+  runMicros = micros();
+  host.print(F("SCRIPT:INICIO,PASOS:"));
+  host.println(count);
+}
+
+void TestScript::stop(const char* reason) {
+  haltActuators();
+  releaseScale();
+  running = false;
+  printReports(true);
+  host.print(F("SCRIPT:ABORTADO:"));
+  host.print(pc);
+  host.print(F(","));
+  host.println(reason);
+}
+
+void TestScript::haltActuators() {
+  elevator.stop();
+  dosingWheel.stop();
+  grinder.stop();
+  transferSolenoid.deactivate();
+  capSolenoid.deactivate();
+}
+
+void TestScript::releaseScale() {
+  if (streamingScale) {
+    loadCell.setStreaming(false);
+    streamingScale = false;
+  }
+}
+
+void TestScript::report(uint8_t kind, uint8_t step, uint32_t us, uint32_t value) {
+  if (reportCount == SCRIPT_REPORTS) {
+    printReport();  // Full: block, as the print would have without the queue
+  }
+  Report& r = reports[(reportHead + reportCount++) % SCRIPT_REPORTS];
+  r.kind = kind;
+  r.step = step;
+  r.us = us;
+  r.value = value;
+}
+
+void TestScript::printReport() {
+  const Report& r = reports[reportHead];
+  reportHead = (reportHead + 1) % SCRIPT_REPORTS;
+  reportCount--;
+  host.print(r.kind == REPORT_ITER ? F("SCRIPT:ITER:") : F("SCRIPT:P:"));
+  host.print(r.step);
+  if (r.kind == REPORT_ITER) {
+    host.print(F(",N:"));
+    host.print(r.value);
+  }
+  host.print(F(",US:"));
+  if (r.kind == REPORT_WAIT) {
+    host.print(r.us);
+    host.print(F(",ESPERA:"));
+    host.println(r.value);
+  } else {
+    host.println(r.us);
+  }
+}
+
+void TestScript::printReports(bool all) {
+  while (reportCount > 0) {
+    // A line into an empty UART buffer never waits for the wire
+    if (!all && host.availableForWrite() < SERIAL_TX_BUFFER_SIZE - 1) return;
+    printReport();
+    if (!all) return;
+  }
+}
+
+// Microseconds since the current loop iteration (or the run) started
+unsigned long TestScript::elapsed() {
+  return micros() - (depth > 0 ? loops[depth - 1].startMicros : runMicros);
+}
+
+bool TestScript::conditionMet(const Step& step) {
+  switch (step.op) {
+    case OP_WAIT_MS:
+      return millis() - waitMillis >= step.arg;
+    case OP_WAIT_TOP:
+      return elevator.isAtTop() && !elevator.isMoving();
+    case OP_WAIT_BOTTOM:
+      return elevator.isAtBottom() && !elevator.isMoving();
+    case OP_WAIT_STABLE: {
+      // Boxcar over the conversions as they come, never waits for one; a
+      // trace that owns the stream updates the weight itself
+      long raw;
+      if (streamingScale) loadCell.pollRaw(raw);
+      return loadCell.isWeightStable();
+    }
+    case OP_WAIT_DOSING:
+      return !dosingWheel.isDispensing();
+  }
+  return true;
+}
+
+void TestScript::run() {
+  if (!running) return;
+
+  if (!TestMode::isActive()) {
+    stop("MODO");
+    return;
+  }
+
+  // Run steps back to back until a wait blocks; the budget keeps a loop
+  // without waits from starving the rest of loop()
+  for (uint8_t budget = SCRIPT_MAX_STEPS; budget > 0; budget--) {
+    if (pc >= count) {
+      running = false;
+      printReports(true);
+      host.print(F("SCRIPT:FIN,MS:"));
+      host.println(millis() - runMillis);
+      return;
+    }
+
+    const Step& step = steps[pc];
+    switch (step.op) {
+      case OP_ACTION:
+        report(REPORT_STEP, pc, elapsed());
+        // The actuator's "TEST:..." acknowledgement would be a blocking write
+        // between two timed steps, and SCRIPT:P already reports the step
+        if (step.arg < ACTION_COUNT - ACTION_READINGS) host.setMuted(true);
+        TestMode::processCommand(ACTIONS[step.arg]);
+        host.setMuted(false);
+        pc++;
+        break;
+
+      case OP_REPEAT: {
+        Loop& loop = loops[depth++];
+        loop.start = pc + 1;
+        loop.iteration = 0;
+        loop.startMicros = micros();
+        pc++;
+        break;
+      }
+
+      case OP_END: {
+        Loop& loop = loops[depth - 1];
+        uint8_t repeatStep = loop.start - 1;
+        unsigned long now = micros();
+        loop.iteration++;
+        report(REPORT_ITER, repeatStep, now - loop.startMicros, loop.iteration);
+
+        if (steps[repeatStep].arg == 0 || loop.iteration < steps[repeatStep].arg) {
+          loop.startMicros = now;
+          pc = loop.start;
+        } else {
+          depth--;
+          pc++;
+        }
+        break;
+      }
+
+      default:  // Waits
+        if (!waiting) {
+          waiting = true;
+          waitMicros = micros();
+          waitMillis = millis();
+          if (step.op == OP_WAIT_STABLE && !loadCell.isStreaming()) {
+            loadCell.setStreaming(true);
+            streamingScale = true;
+          }
+        }
+        if (!conditionMet(step)) {
+          if (step.op != OP_WAIT_MS && millis() - waitMillis >= step.arg) {
+            stop("TIMEOUT");
+            return;
+          }
+          printReports(false);
+          return;
+        }
+        waiting = false;
+        releaseScale();
+        report(REPORT_WAIT, pc, elapsed(), micros() - waitMicros);
+        pc++;
+        break;
+    }
+  }
+}
+
+void TestScript::printStep(uint8_t index) {
+  const Step& step = steps[index];
+  host.print(F("SCRIPT:PASO:"));
+  host.print(index);
+  host.print(F(":"));
+  switch (step.op) {
+    case OP_ACTION:
+      host.println(ACTIONS[step.arg]);
+      return;
+    case OP_WAIT_MS:
+      host.print(F("WAIT "));
+      break;
+    case OP_WAIT_TOP:
+      host.print(F("WAIT ELEVATOR TOP "));
+      break;
+    case OP_WAIT_BOTTOM:
+      host.print(F("WAIT ELEVATOR BOTTOM "));
+      break;
+    case OP_WAIT_STABLE:
+      host.print(F("WAIT WEIGHT STABLE "));
+      break;
+    case OP_WAIT_DOSING:
+      host.print(F("WAIT DOSING IDLE "));
+      break;
+    case OP_REPEAT:
+      host.print(F("REPEAT "));
+      break;
+    case OP_END:
+      host.println(F("END"));
+      return;
+  }
+  host.println(step.arg);
+}
+
+// =====================================================
+// EEPROM STORAGE
+// =====================================================
+//
+// magic, step count, steps, crc8 over count and steps
+
+bool TestScript::save() {
+  if (count == 0) return false;
+
+  int addr = SCRIPT_EEPROM_BASE;
+  EEPROM.update(addr++, SCRIPT_MAGIC);
+  EEPROM.update(addr++, count);
+  uint8_t crc = crc8Update(0, count);
+  const uint8_t* data = (const uint8_t*)steps;
+  for (uint16_t i = 0; i < count * sizeof(Step); i++) {
+    EEPROM.update(addr++, data[i]);  // Only rewrites bytes that changed
+    crc = crc8Update(crc, data[i]);
+  }
+  EEPROM.update(addr, crc);
+  return true;
+}
+
+bool TestScript::load() {
+  int addr = SCRIPT_EEPROM_BASE;
+  if (EEPROM.read(addr++) != SCRIPT_MAGIC) return false;
+  uint8_t stored = EEPROM.read(addr++);
+  if (stored == 0 || stored > SCRIPT_MAX_STEPS) return false;
+
+  // Check before touching the script in RAM
+  uint8_t crc = crc8Update(0, stored);
+  for (uint16_t i = 0; i < stored * sizeof(Step); i++) {
+    crc = crc8Update(crc, EEPROM.read(addr + i));
+  }
+  if (crc != EEPROM.read(addr + stored * sizeof(Step))) return false;
+
+  // A script saved by another firmware build may name unknown steps
+  for (uint8_t i = 0; i < stored; i++) {
+    Step step;
+    EEPROM.get(addr + i * sizeof(Step), step);
+    if (step.op > OP_END || (step.op == OP_ACTION && step.arg >= ACTION_COUNT)) return false;
+  }
+
+  uint8_t* data = (uint8_t*)steps;
+  for (uint16_t i = 0; i < stored * sizeof(Step); i++) {
+    data[i] = EEPROM.read(addr + i);
+  }
+  count = stored;
+  return true;
+}
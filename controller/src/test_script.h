@@ -0,0 +1,112 @@
+#ifndef TEST_SCRIPT_H
+#define TEST_SCRIPT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// =====================================================
+// TEST MODE SCRIPTS
+// =====================================================
+//
+// A short actuation sequence uploaded line by line and run on the
+// controller, so endurance and timing tests are not paced by the serial
+// round-trip. SCRIPT:ADD:<step>[;<step>...] appends steps:
+//   ELEVATOR_UP, DOSING_STEP, ...       any TestMode actuator command
+//   WAIT <ms>                           fixed delay
+//   WAIT ELEVATOR TOP|BOTTOM [timeout]  elevator at the end stop
+//   WAIT WEIGHT STABLE [timeout]        load cell settled
+//   WAIT DOSING IDLE [timeout]          dosing wheel move finished
+//   REPEAT <n> ... END                  loop, n = 0 repeats until SCRIPT:STOP
+//
+// SCRIPT:RUN (test mode only) reports every step with microseconds since
+// the start of the run or of the current loop iteration:
+//   SCRIPT:INICIO,PASOS:<n>
+//   SCRIPT:P:<step>,US:<t>[,ESPERA:<wait us>]
+//   SCRIPT:ITER:<repeat step>,N:<iteration>,US:<iteration us>
+//   SCRIPT:FIN,MS:<total>   or   SCRIPT:ABORTADO:<step>,<reason>
+// Step and iteration reports are queued (SCRIPT_REPORTS) and printed while
+// a wait blocks, one per pass and only into an empty UART buffer, so no
+// write stalls between two timed steps; the rest is printed at the end.
+// Actuator steps print nothing else (no TEST:... acknowledgement).
+// WAIT WEIGHT STABLE streams conversions instead of blocking on them.
+// A wait past its timeout aborts the run and stops every actuator.
+// SCRIPT:SAVE/LOAD keep the script in EEPROM; a saved script is loaded
+// at boot.
+
+class TestScript {
+public:
+  static void init();
+  static void run();  // Call in loop while test mode is active
+  static bool processCommand(const String& command);  // Handles SCRIPT: commands
+  static bool isRunning() { return running; }
+
+private:
+  enum Op : uint8_t {
+    OP_ACTION,        // arg = index into the action table
+    OP_WAIT_MS,       // arg = delay
+    OP_WAIT_TOP,      // arg = timeout for the wait ops below
+    OP_WAIT_BOTTOM,
+    OP_WAIT_STABLE,
+    OP_WAIT_DOSING,
+    OP_REPEAT,        // arg = iterations, 0 = forever
+    OP_END
+  };
+
+  struct Step {
+    uint8_t op;
+    uint32_t arg;
+  };
+
+  enum ReportKind : uint8_t {
+    REPORT_STEP,   // SCRIPT:P:<step>,US:<us>
+    REPORT_WAIT,   // SCRIPT:P:<step>,US:<us>,ESPERA:<value>
+    REPORT_ITER    // SCRIPT:ITER:<step>,N:<value>,US:<us>
+  };
+
+  struct Report {
+    uint8_t kind;
+    uint8_t step;
+    uint32_t us;
+    uint32_t value;
+  };
+
+  struct Loop {
+    uint8_t start;            // Step after the REPEAT
+    uint32_t iteration;
+    unsigned long startMicros;
+  };
+
+  static Step steps[SCRIPT_MAX_STEPS];
+  static uint8_t count;
+  static Loop loops[SCRIPT_MAX_DEPTH];
+  static uint8_t depth;
+  static uint8_t pc;
+  static bool running;
+  static bool waiting;
+  static unsigned long waitMicros;
+  static unsigned long waitMillis;
+  static unsigned long runMicros;
+  static unsigned long runMillis;
+  static Report reports[SCRIPT_REPORTS];
+  static uint8_t reportHead;
+  static uint8_t reportCount;
+  static bool streamingScale;  // WAIT WEIGHT STABLE turned streaming on
+
+  static bool add(String text);
+  static bool parseStep(String text, Step& step);
+  static bool isBalanced();
+  static void start();
+  static void stop(const char* reason);
+  static void haltActuators();
+  static bool conditionMet(const Step& step);
+  static unsigned long elapsed();
+  static void report(uint8_t kind, uint8_t step, uint32_t us, uint32_t value = 0);
+  static void printReport();  // Oldest queued report
+  static void printReports(bool all);  // all = false: at most one, and only if it will not block
+  static void releaseScale();
+  static void printStep(uint8_t index);
+  static bool save();
+  static bool load();
+};
+
+#endif
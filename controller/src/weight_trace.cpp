@@ -0,0 +1,135 @@
+#include "weight_trace.h"
+#include <avr/wdt.h>
+#include "host_link.h"
+#include "hardware.h"
+#include "state_machine.h"
+#include "crc8.h"
+
+WeightTrace::Sample WeightTrace::samples[TRACE_SAMPLES];
+uint16_t WeightTrace::target = 0;
+uint16_t WeightTrace::count = 0;
+TraceTrigger WeightTrace::armedFor = TRACE_NONE;
+TraceTrigger WeightTrace::source = TRACE_NONE;
+bool WeightTrace::capturing = false;
+unsigned long WeightTrace::startMillis = 0;
+
+static void printHexByte(uint8_t b) {
+  const char digits[] = "0123456789ABCDEF";
+  host.write(digits[b >> 4]);
+  host.write(digits[b & 0x0F]);
+}
+
+const char* WeightTrace::sourceName(TraceTrigger t) {
+  switch (t) {
+    case TRACE_DOSING: return "DOSIFICACION";
+    case TRACE_TRANSFER: return "TRASPASO";
+    default: return "NINGUNA";
+  }
+}
+
+bool WeightTrace::arm(TraceTrigger t, uint16_t n) {
+  if (capturing || t == TRACE_NONE || n == 0 || n > TRACE_SAMPLES) {
+    return false;
+  }
+  armedFor = t;
+  target = n;
+  host.print("TRACE:ARMADO:");
+  host.print(sourceName(t));
+  host.print(",N:");
+  host.println(n);
+  return true;
+}
+
+void WeightTrace::disarm() {
+  if (capturing) {
+    loadCell.setStreaming(false);
+  }
+  armedFor = TRACE_NONE;
+  capturing = false;
+  host.println("TRACE:DESARMADO");
+}
+
+void WeightTrace::trigger(TraceTrigger t) {
+  if (armedFor != t || capturing) {
+    return;
+  }
+  
+  armedFor = TRACE_NONE;
+  source = t;
+  count = 0;
+  capturing = true;
+  startMillis = millis();
+  loadCell.setStreaming(true);
+}
+
+void WeightTrace::run() {
+  if (!capturing) return;
+  
+  long raw;
+  if (!loadCell.pollRaw(raw)) {
+    return;
+  }
+  
+  Sample& s = samples[count++];
+  unsigned long elapsed = millis() - startMillis;
+  s.ms = elapsed > 0xFFFF ? 0xFFFF : elapsed;
+  s.raw[0] = raw & 0xFF;
+  s.raw[1] = (raw >> 8) & 0xFF;
+  s.raw[2] = (raw >> 16) & 0xFF;
+  
+  if (count >= target) {
+    capturing = false;
+    loadCell.setStreaming(false);
+    host.print("TRACE:LISTO,N:");
+    host.println(count);
+  }
+}
+
+void WeightTrace::dump() {
+  if (capturing) {
+    host.println("ERROR:TRACE_EN_CURSO");
+    return;
+  }
+  // The dump blocks loop() for seconds at 9600 baud: only with the machine
+  // at rest, never while a lot, sweep or script runs the motors
+  if (stateMachine.getCurrentState() != ESTADO0_INICIO || elevator.isMoving() ||
+      dosingWheel.isDispensing()) {
+    host.println("ERROR:TRACE_SOLO_EN_REPOSO");
+    return;
+  }
+  
+  host.print("TRACE:INICIO,N:");
+  host.print(count);
+  host.print(",SPS:");
+  host.print(loadCell.getSampleRate());
+  host.print(",FUENTE:");
+  host.print(sourceName(source));
+  host.print(",OFFSET:");
+  host.print(loadCell.getOffset());
+  host.print(",ESCALA:");
+  host.println(loadCell.getScale(), 4);
+  
+  uint8_t crc = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    if (i % TRACE_SAMPLES_PER_LINE == 0) {
+      host.print("TRACE:D:");
+      host.print(i);
+      host.print(":");
+    }
+    
+    const Sample& s = samples[i];
+    uint8_t packed[5] = {(uint8_t)(s.ms & 0xFF), (uint8_t)(s.ms >> 8), s.raw[0], s.raw[1], s.raw[2]};
+    for (uint8_t b = 0; b < sizeof(packed); b++) {
+      printHexByte(packed[b]);
+      crc = crc8Update(crc, packed[b]);
+    }
+    
+    if (i % TRACE_SAMPLES_PER_LINE == TRACE_SAMPLES_PER_LINE - 1 || i == count - 1) {
+      host.println();
+      wdt_reset();  // A long dump at 9600 baud blocks for a few seconds
+    }
+  }
+  
+  host.print("TRACE:FIN,CRC:");
+  host.println(crc);
+}
@@ -0,0 +1,59 @@
+#ifndef WEIGHT_TRACE_H
+#define WEIGHT_TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// =====================================================
+// WEIGHT TRACE CAPTURE
+// =====================================================
+//
+// Single-shot capture of raw HX711 conversions around a pill drop.
+// TRACE:ARM:DOSING|TRANSFER[,n] arms it; the next dispenseOne() or
+// transfer start triggers it and every conversion is stored (ms since the
+// trigger + 24-bit raw value) until n samples are taken, then
+// TRACE:LISTO,N:<n> is printed. While capturing, the load cell is read
+// without blocking so no conversion is lost and weighing still works.
+//
+// TRACE:DUMP prints the buffer as packed hex, 5 bytes per sample
+// (ms little-endian 16 bit, raw little-endian 24 bit two's complement):
+//   TRACE:INICIO,N:<n>,SPS:<sps>,FUENTE:<source>,OFFSET:<raw>,ESCALA:<counts/g>
+//   TRACE:D:<first sample>:<hex>        (TRACE_SAMPLES_PER_LINE samples)
+//   TRACE:FIN,CRC:<crc8 of all packed bytes>
+// The dump blocks for seconds, so it is refused (ERROR:TRACE_SOLO_EN_REPOSO)
+// outside 0_INICIO or while a motor moves; the capture waits for it.
+// controller/tools/trace_to_csv.py turns a captured log into CSV.
+
+enum TraceTrigger {
+  TRACE_NONE,
+  TRACE_DOSING,
+  TRACE_TRANSFER
+};
+
+class WeightTrace {
+public:
+  static bool arm(TraceTrigger source, uint16_t samples);
+  static void disarm();
+  static void trigger(TraceTrigger source);  // Called where a drop starts
+  static void run();  // Call in loop
+  static void dump();
+  static bool isCapturing() { return capturing; }
+  
+private:
+  struct Sample {
+    uint16_t ms;
+    uint8_t raw[3];
+  };
+  
+  static Sample samples[TRACE_SAMPLES];
+  static uint16_t target;
+  static uint16_t count;
+  static TraceTrigger armedFor;
+  static TraceTrigger source;
+  static bool capturing;
+  static unsigned long startMillis;
+  
+  static const char* sourceName(TraceTrigger t);
+};
+
+#endif
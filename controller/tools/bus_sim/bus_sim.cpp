@@ -0,0 +1,332 @@
+/*
+ * Several controller host links on one simulated RS-485 bus.
+ *
+ *   ./bus_sim [-n nodes] [-r lines_per_s] [-t seconds] [-s seed] [-k ppm] [-y sync_s]
+ *
+ * Each node is a HostLink built from controller/src/host_link.cpp (with
+ * HOST_RS485) on its own simulated UART at HOST_BAUD, with its own clock:
+ * started at a random offset and running fast or slow by up to -k ppm
+ * (default BUS_CLOCK_PPM). Its sensor tick calls HostLink::poll() every
+ * 1024 us of that clock, like the Timer0 ISR, whatever loop() is doing.
+ * Only loop() itself is modelled: it reads the link, prints test lines at
+ * a random rate and calls HostLink::run(). Most passes take 0.2-2 ms;
+ * 2.5% wait for an HX711 conversion at 10 SPS (100 ms) and 0.5% for a
+ * filtered readWeight() (1 s).
+ *
+ * The host talks on its own pair: "@*:SYNC:<n>" at 10 ms and then every
+ * -y seconds (default BUS_SYNC_MS, 0 for only the first). The nodes share
+ * the other pair: a byte started while another is still on it is a
+ * collision; a byte written with the driver off never reaches it. Every
+ * received line is checked (address, payload length, "|seq,ms"), sequence
+ * gaps count the lines a node dropped and BUS:DESCARTADAS lines the drops
+ * it reported. Prints per-node and aggregate throughput and exits with 1
+ * if there was any collision, undriven byte or corrupt line.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+
+#include "host_link.h"
+
+#define STEP_US 10
+#define SYNC_AT_US 10000UL
+#define TICK_US 1024  // Timer0 compare A period
+#define LONG_LINE (BUS_LINE_MAX - 24)  // Payload of a full-length line with "@255:" and the widest metadata
+
+static const unsigned long BYTE_US = 10000000UL / HOST_BAUD;
+
+static unsigned long simUs;
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+// ---- Nodes ---------------------------------------------------------
+
+struct Node {
+  HardwareSerial port;
+  SimPins pins;  // The node's own DE pin
+  HostLink* link;
+  unsigned long offsetUs;  // Clock at simulation start
+  long ppm;                // Clock error
+  unsigned long nextTick;  // Node clock
+  unsigned long nextLoop;
+  unsigned long nextLine;
+  unsigned long sent;
+  // Host side
+  unsigned long received;
+  unsigned long bytes;
+  unsigned long dropped;
+  unsigned long reported;
+  uint16_t expectedSeq;
+  unsigned long maxLatency;
+};
+
+static Node nodes[BUS_NODES];
+static Node* current;  // Node whose code is running: millis() is its clock
+
+static unsigned long localUs(const Node& node) {
+  return node.offsetUs + simUs + (long long)simUs * node.ppm / 1000000;
+}
+
+unsigned long millis() { return (current ? localUs(*current) : simUs) / 1000; }
+unsigned long micros() { return current ? localUs(*current) : simUs; }
+static int nodeCount = 4;
+static double lineRate = 1.0;
+static unsigned long seed = 1;
+
+static unsigned long nextRandom() {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 16) & 0x7FFF;
+}
+
+static unsigned long randomBetween(unsigned long low, unsigned long high) {
+  return low + nextRandom() % (high - low + 1);
+}
+
+static long randomPpm(long range) {
+  return range ? (long)(nextRandom() % (2 * range + 1)) - range : 0;
+}
+
+static unsigned long loopTime() {
+  unsigned long r = nextRandom() % 1000;
+  if (r < 5) {
+    return 1000000;  // readWeight(): the filter's 10 conversions at 10 SPS
+  }
+  if (r < 30) {
+    return 100000;  // One HX711 conversion at 10 SPS
+  }
+  return randomBetween(200, 2000);
+}
+
+static unsigned long lineInterval() {
+  // Exponential, mean 1 / lineRate: lines arrive as a Poisson process
+  double u = (nextRandom() + 1) / 32769.0;
+  return (unsigned long)(-log(u) * 1000000.0 / lineRate);
+}
+
+// ---- Bus -----------------------------------------------------------
+
+static unsigned long busyUntil;
+static int busOwner = -1;
+static unsigned long busBytes;
+static unsigned long collisions;
+static unsigned long undriven;
+static unsigned long corruptLines;
+
+static std::string hostLine;
+static bool hostLineCorrupt;
+static std::string syncLine;
+static unsigned syncPos;
+static unsigned syncCount;
+static unsigned long syncNext = SYNC_AT_US;
+static unsigned long syncInterval = BUS_SYNC_MS * 1000;
+
+static void hostCheckLine() {
+  std::string line = hostLine;
+  bool corrupt = hostLineCorrupt;
+  hostLine.clear();
+  hostLineCorrupt = false;
+  if (!line.empty() && line[line.size() - 1] == '\r') {
+    line.erase(line.size() - 1);
+  }
+
+  // @<id>:T:<n>,<len>,xxx|<seq>,<ms> or @<id>:BUS:DESCARTADAS:<n>|<seq>,<ms>
+  int id = -1;
+  unsigned long n, length, seq, ms;
+  int headEnd = 0;
+  size_t bar = line.rfind('|');
+  if (!corrupt && bar != std::string::npos &&
+      sscanf(line.c_str(), "@%d:BUS:DESCARTADAS:%lu|%lu,%lu", &id, &n, &seq, &ms) == 4 &&
+      id >= 1 && id <= nodeCount) {
+    Node& node = nodes[id - 1];
+    node.reported += n;
+    node.dropped += (uint16_t)(seq - node.expectedSeq);
+    node.expectedSeq = seq + 1;
+    return;
+  }
+  if (corrupt || bar == std::string::npos ||
+      sscanf(line.c_str(), "@%d:T:%lu,%lu,%n", &id, &n, &length, &headEnd) != 3 ||
+      sscanf(line.c_str() + bar, "|%lu,%lu", &seq, &ms) != 2 ||
+      id < 1 || id > nodeCount || bar - (line.find(':') + 1) != length ||
+      line.find_first_not_of('x', headEnd) != bar) {
+    corruptLines++;
+    fprintf(stderr, "[%8lu] corrupt: %s\n", millis(), line.c_str());
+    return;
+  }
+
+  Node& node = nodes[id - 1];
+  node.dropped += (uint16_t)(seq - node.expectedSeq);
+  node.expectedSeq = seq + 1;
+  node.received++;
+  node.bytes += line.size() + 2;
+  unsigned long latency = localUs(node) / 1000 - ms;
+  if (latency > node.maxLatency) {
+    node.maxLatency = latency;
+  }
+}
+
+static void busByte(int source, uint8_t c, bool driven) {
+  if (!driven) {
+    undriven++;
+    return;
+  }
+  if (simUs < busyUntil && busOwner != source) {
+    collisions++;
+    hostLineCorrupt = true;
+  }
+  busyUntil = simUs + BYTE_US;
+  busOwner = source;
+  busBytes++;
+
+  if (c == '\n') {
+    hostCheckLine();
+  } else {
+    hostLine += (char)c;
+  }
+}
+
+static void hostByte(uint8_t c) {
+  // Host pair: every node receives it
+  for (int i = 0; i < nodeCount; i++) {
+    nodes[i].port.receive(c);
+  }
+}
+
+void simStep() {
+  simUs += STEP_US;
+
+  // Sensor ticks, also while a node's loop() waits
+  Node* running = current;
+  SimPins* runningPins = simPins;
+  for (int i = 0; i < nodeCount; i++) {
+    Node& node = nodes[i];
+    if (localUs(node) >= node.nextTick) {
+      node.nextTick += TICK_US;
+      current = &node;
+      simPins = &node.pins;
+      node.link->poll();
+    }
+  }
+  current = running;
+  simPins = runningPins;
+
+  for (int i = 0; i < nodeCount; i++) {
+    HardwareSerial& p = nodes[i].port;
+    if (p.shifting && simUs >= p.shiftEnd) {
+      p.shifting = false;
+    }
+    if (!p.shifting && p.txCount > 0) {
+      uint8_t c = p.txBuf[p.txHead];
+      p.txHead = (p.txHead + 1) % SERIAL_TX_BUFFER_SIZE;
+      p.txCount--;
+      p.shifting = true;
+      p.shiftEnd = simUs + BYTE_US;
+      busByte(i, c, nodes[i].pins.level[RS485_DE_PIN] == HIGH);
+    }
+  }
+  if (simUs >= syncNext) {
+    if (syncPos == 0) {
+      syncLine = "@*:SYNC:" + std::to_string(++syncCount) + "\n";
+    }
+    hostByte(syncLine[syncPos++]);
+    syncNext += BYTE_US;
+    if (syncPos == syncLine.size()) {
+      syncPos = 0;
+      syncNext = syncInterval ? syncNext - syncLine.size() * BYTE_US + syncInterval : (unsigned long)-1;
+    }
+  }
+}
+
+// ---- Main ----------------------------------------------------------
+
+static void nodeLoop(Node& node) {
+  current = &node;
+  simPins = &node.pins;
+  while (node.link->available()) {
+    node.link->read();
+  }
+  if (simUs >= node.nextLine) {
+    unsigned long length = nextRandom() % 20 == 0 ? LONG_LINE : randomBetween(20, 80);
+    std::string payload = "T:" + std::to_string(node.sent) + "," + std::to_string(length) + ",";
+    payload.append(length > payload.size() ? length - payload.size() : 0, 'x');
+    node.link->println(payload.c_str());
+    node.sent++;
+    node.nextLine = simUs + lineInterval();
+  }
+  node.link->run();
+  current = NULL;
+  node.nextLoop = simUs + loopTime();
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = 60;
+  int opt;
+  long skew = BUS_CLOCK_PPM;
+  while ((opt = getopt(argc, argv, "n:r:t:s:k:y:")) != -1) {
+    switch (opt) {
+      case 'n': nodeCount = atoi(optarg); break;
+      case 'r': lineRate = atof(optarg); break;
+      case 't': seconds = atof(optarg); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      case 'k': skew = atol(optarg); break;
+      case 'y': syncInterval = (unsigned long)(atof(optarg) * 1000000); break;
+      default:
+        fprintf(stderr, "usage: %s [-n nodes] [-r lines_per_s] [-t seconds] [-s seed] [-k ppm] [-y sync_s]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  if (nodeCount < 1 || nodeCount > BUS_NODES || lineRate <= 0 || seconds <= 0 || skew < 0) {
+    fprintf(stderr, "need 1-%d nodes and a positive rate and duration\n", BUS_NODES);
+    return 2;
+  }
+
+  for (int i = 0; i < nodeCount; i++) {
+    Node& node = nodes[i];
+    node.offsetUs = randomBetween(0, 5000) * 1000;  // Booted at different times
+    node.ppm = randomPpm(skew);
+    node.nextTick = node.offsetUs + TICK_US;
+    current = &node;
+    simPins = &node.pins;
+    node.link = new HostLink(node.port);
+    node.link->begin(HOST_BAUD);
+    node.link->setDeviceId(i + 1);
+    current = NULL;
+    node.nextLoop = randomBetween(0, 2000);
+    node.nextLine = SYNC_AT_US + 100000 + lineInterval();
+  }
+
+  unsigned long endUs = (unsigned long)(seconds * 1000000);
+  while (simUs < endUs) {
+    for (int i = 0; i < nodeCount; i++) {
+      if (simUs >= nodes[i].nextLoop) {
+        nodeLoop(nodes[i]);
+      }
+    }
+    simStep();
+  }
+
+  printf("%d nodes, %u baud, slot %lu ms, frame %lu ms, %.1f s, clocks within %ld ppm, SYNC every %.0f s\n",
+         nodeCount, HOST_BAUD, (unsigned long)BUS_SLOT_MS, (unsigned long)BUS_SLOT_MS * BUS_NODES, seconds,
+         skew, syncInterval / 1e6);
+  printf("node   ppm      sent  received   dropped  reported  bytes/s  max latency ms\n");
+  unsigned long totalLines = 0, totalBytes = 0, totalDropped = 0, totalReported = 0;
+  for (int i = 0; i < nodeCount; i++) {
+    Node& node = nodes[i];
+    printf("%4d %5ld %9lu %9lu %9lu %9lu %8.1f %15lu\n", i + 1, node.ppm, node.sent, node.received,
+           node.dropped, node.reported, node.bytes / seconds, node.maxLatency);
+    totalLines += node.received;
+    totalBytes += node.bytes;
+    totalDropped += node.dropped;
+    totalReported += node.reported;
+  }
+  double capacity = HOST_BAUD / 10.0;
+  printf("aggregate: %.2f lines/s, %.1f bytes/s (%.1f%% of the line rate), bus busy %.1f%%\n",
+         totalLines / seconds, totalBytes / seconds, 100 * totalBytes / seconds / capacity,
+         100 * busBytes / seconds / capacity);
+  printf("dropped %lu (reported %lu), collisions %lu, undriven bytes %lu, corrupt lines %lu\n",
+         totalDropped, totalReported, collisions, undriven, corruptLines);
+  return collisions || undriven || corruptLines ? 1 : 0;
+}
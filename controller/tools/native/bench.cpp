@@ -0,0 +1,104 @@
+/*
+ * The BENCH:ALL cases on the native build, including the ones that drive
+ * outputs and never run on the board.
+ *
+ *   ./bench [-m min_ms] [-s suite]
+ *
+ * Each case runs against the simulated core in tools/shim with the host
+ * link muted, doubling its iterations until it takes at least min_ms
+ * (default 50) of host CPU time. The state suite runs one continuous tick
+ * in every state, after that state's entry. One line per case:
+ *   BENCH:{"suite":"state","case":"3_PESAJE","iter":64,"ns":812,"sim_us":100000}
+ * "ns" is host CPU time per iteration: it ranks cases and shows regressions
+ * between two builds, not AVR time (use BENCH:ALL on the board for that).
+ * "sim_us" is the simulated time per iteration, i.e. what the case waits
+ * for on the board: HX711 conversions, delays, a full UART buffer. Those
+ * waits are simulated step by step, so "ns" of a case that waits is mostly
+ * the simulator's.
+ *
+ * The firmware is put in real mode with a scale present, as on the line.
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "native.h"
+#include <HX711.h>
+#include <avr/wdt.h>
+#include "benchmark.h"
+#include "hardware.h"
+#include "host_link.h"
+#include "state_machine.h"
+
+#define MAX_ITERATIONS (1UL << 20)
+#define MAX_SIM_US 10000000UL  // Stop doubling once a case waits this long
+
+static void run(const BenchCase& c, const char* name, unsigned long minNs) {
+  typedef std::chrono::steady_clock Clock;
+  unsigned long iterations = 1;
+  while (true) {
+    host.setMuted(true);
+    unsigned long sim0 = micros();
+    Clock::time_point t0 = Clock::now();
+    for (unsigned long i = 0; i < iterations; i++) {
+      c.kernel();
+      wdt_reset();
+    }
+    unsigned long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+    unsigned long simUs = micros() - sim0;
+    host.setMuted(false);
+
+    if (ns >= minNs || simUs >= MAX_SIM_US || iterations >= MAX_ITERATIONS) {
+      printf("BENCH:{\"suite\":\"%s\",\"case\":\"%s\",\"iter\":%lu,\"ns\":%lu,\"sim_us\":%lu}\n", c.suite,
+             name, iterations, ns / iterations, simUs / iterations);
+      return;
+    }
+    iterations *= 2;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  unsigned long minMs = 50;
+  const char* suite = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:s:")) != -1) {
+    switch (opt) {
+      case 'm': minMs = strtoul(optarg, NULL, 10); break;
+      case 's': suite = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-m min_ms] [-s suite]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  HX711::present = true;  // Real mode with a scale: reads wait for conversions
+  Native::boot();
+  Native::runUntil(1000);  // Boot output drained
+  setGlobalMode(MODE_REAL);
+  Benchmark::prepare();
+
+  for (uint8_t i = 0; i < Benchmark::caseCount; i++) {
+    const BenchCase& c = Benchmark::cases[i];
+    if (suite && strcmp(suite, c.suite) != 0) continue;
+    if (strcmp(c.suite, "state") != 0) {
+      run(c, c.name, minMs * 1000000UL);
+      continue;
+    }
+    for (int s = ESTADO0_INICIO; s <= ESTADO8_RETIRO; s++) {
+      host.setMuted(true);
+      stateMachine.changeState((State)s);
+      stateMachine.executeStateEntry();
+      stateMachine.clearStateChange();
+      host.setMuted(false);
+      run(c, stateMachine.getStateName((State)s).c_str(), minMs * 1000000UL);
+    }
+    host.setMuted(true);
+    stateMachine.changeState(ESTADO0_INICIO);
+    host.setMuted(false);
+  }
+
+  const Native::Stats& stats = Native::stats;
+  return stats.watchdogResets == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+#include "native.h"
+
+#include <Arduino.h>
+#include <HX711.h>
+#include <avr/wdt.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+
+#include "config.h"
+#include "hardware.h"
+
+void setup();
+void loop();
+extern "C" void TIMER0_COMPA_vect(void);
+
+#define STEP_US 10
+#define TIMER0_TICK_US 1024  // Compare A once per Timer0 overflow period
+
+static const unsigned long BYTE_US = 10000000UL / HOST_BAUD;
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+namespace Native {
+unsigned long loopMicros = 200;
+void (*onLine)(unsigned long ms, const char* line) = NULL;
+Stats stats;
+}
+
+static unsigned long simUs;
+static unsigned long nextTick = TIMER0_TICK_US;
+static bool tickPending;
+static std::deque<uint8_t> rxPending;
+static unsigned long nextRx;
+static std::string outLine;
+
+#ifdef HOST_RS485
+static HardwareSerial& port = Serial1;
+#else
+static HardwareSerial& port = Serial;
+#endif
+
+unsigned long millis() { return simUs / 1000; }
+unsigned long micros() { return simUs; }
+
+static void output(uint8_t c) {
+  if (c == '\r') return;
+  if (c != '\n') {
+    outLine += (char)c;
+    return;
+  }
+  if (Native::onLine) {
+    Native::onLine(millis(), outLine.c_str());
+  }
+  outLine.clear();
+}
+
+void simStep() {
+  simUs += STEP_US;
+
+  // UART TX: one byte per character time
+  if (port.shifting && simUs >= port.shiftEnd) {
+    port.shifting = false;
+  }
+  if (!port.shifting && port.txCount > 0) {
+    uint8_t c = port.txBuf[port.txHead];
+    port.txHead = (port.txHead + 1) % SERIAL_TX_BUFFER_SIZE;
+    port.txCount--;
+    port.shifting = true;
+    port.shiftEnd = simUs + BYTE_US;
+    output(c);
+  }
+
+  // UART RX: the host's bytes arrive one per character time
+  if (!rxPending.empty() && simUs >= nextRx) {
+    if (!port.receive(rxPending.front())) {
+      Native::stats.rxDropped++;
+    }
+    rxPending.pop_front();
+    nextRx = simUs + BYTE_US;
+  }
+
+  // Sensor ISR, held while interrupts are off
+  if (simUs >= nextTick) {
+    nextTick += TIMER0_TICK_US;
+    tickPending = (TIMSK0 & _BV(OCIE0A)) != 0;
+  }
+  if (tickPending && simInterruptsEnabled) {
+    tickPending = false;
+    TIMER0_COMPA_vect();
+  }
+
+  HX711::conversionMicros = 1000000UL / loadCell.getSampleRate();
+
+  if (simWatchdog.expired()) {
+    Native::stats.watchdogResets++;
+    fprintf(stderr, "[%8lu] watchdog: %lu ms without wdt_reset()\n", millis(),
+            millis() - simWatchdog.lastReset);
+    simWatchdog.lastReset = millis();  // Count each stall once
+  }
+}
+
+void Native::boot() {
+  setup();
+}
+
+void Native::loopOnce() {
+  unsigned long start = simUs;
+  loop();
+  while (simUs - start < loopMicros) {
+    simStep();
+  }
+  stats.loops++;
+  if (simUs - start > stats.maxLoopMicros) {
+    stats.maxLoopMicros = simUs - start;
+  }
+}
+
+void Native::runUntil(unsigned long ms) {
+  while (millis() < ms) {
+    loopOnce();
+  }
+}
+
+void Native::send(const char* line) {
+  if (rxPending.empty() && nextRx < simUs) {
+    nextRx = simUs;
+  }
+  for (const char* p = line; *p; p++) {
+    rxPending.push_back(*p);
+  }
+  rxPending.push_back('\n');
+}
+
+unsigned long Native::sendMicros(const char* line) {
+  return (strlen(line) + 1) * BYTE_US;
+}
@@ -0,0 +1,34 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+// One controller built from src/ on the host, on a simulated clock.
+//
+// The firmware's own setup()/loop() run unchanged against tools/shim.
+// Each loop() pass costs loopMicros plus whatever it waits for (delays,
+// a full UART TX buffer, HX711 conversions). Host lines arrive at
+// HOST_BAUD into the 64-byte RX ring, output leaves at HOST_BAUD, and the
+// Timer0 compare ISR runs every 1024 us. Runs are deterministic: the same
+// input gives the same output, byte for byte and ms for ms.
+
+namespace Native {
+
+struct Stats {
+  unsigned long loops;
+  unsigned long maxLoopMicros;   // Longest loop() pass, waits included
+  unsigned long rxDropped;       // Host bytes lost to a full RX ring
+  unsigned long watchdogResets;  // Passes the watchdog would have reset
+};
+
+extern unsigned long loopMicros;  // Simulated cost of a pass without waits
+extern void (*onLine)(unsigned long ms, const char* line);  // Each output line
+extern Stats stats;
+
+void boot();                          // setup()
+void loopOnce();                      // One loop() pass
+void runUntil(unsigned long ms);      // loop() passes until millis() reaches ms
+void send(const char* line);          // Host line, queued behind earlier ones
+unsigned long sendMicros(const char* line);  // Time the line takes on the wire
+
+}  // namespace Native
+
+#endif
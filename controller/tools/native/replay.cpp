@@ -0,0 +1,194 @@
+/*
+ * Replay a recorded session on the native build, on a simulated clock.
+ *
+ *   ./replay session.log [-t tolerance_ms] [-l loop_us] [-e tail_ms] [-o output.log]
+ *
+ * The log is the console output of a REC:ON recording (the same file
+ * tools/replay_session.py takes). Recorded commands (REC:C) are typed into
+ * the controller's UART so that their last byte arrives at the recorded
+ * offset; weight samples (REC:P) become the simulated scale reading at
+ * theirs. The replay's state changes (REC:E) are diffed against the
+ * recorded ones, transition by transition.
+ *
+ * The clock is simulated, so a replay is exactly repeatable: -o writes
+ * every output line with its simulated ms, and the files of two builds
+ * can be diffed to see what a change did to the session. Timings against
+ * the field recording are still compared within the tolerance, since the
+ * loop cost (-l, default 200 us per pass) is a model of the board's.
+ *
+ * Exit code 0 when the state sequence matches and every transition lands
+ * within the tolerance, 1 otherwise or when the watchdog would have fired.
+ */
+
+#include <regex>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "native.h"
+#include "hardware.h"
+
+typedef std::pair<unsigned long, std::string> Timed;
+
+static std::vector<Timed> replayed;
+static unsigned long replayStart;
+static FILE* outFile;
+
+// "@<id>:" address prefix and "|<seq>,<ms>" event suffix added by the host link
+static const std::regex address("^@[0-9*]+:");
+static const std::regex eventMeta("\\|\\d+,\\d+$");
+static const std::regex record("REC:([CEP]):(\\d+),(.*)$");
+
+static std::string clean(std::string line) {
+  while (!line.empty() && isspace((unsigned char)line[line.size() - 1])) line.erase(line.size() - 1);
+  line = std::regex_replace(line, address, "");
+  line = std::regex_replace(line, eventMeta, "");
+  while (!line.empty() && isspace((unsigned char)line[line.size() - 1])) line.erase(line.size() - 1);
+  return line;
+}
+
+static bool skipped(const std::string& command) {
+  // Link housekeeping and the recorder itself are not part of the session
+  static const char* const prefixes[] = { "SYNC", "HELLO", "REC:", "PLAY:" };
+  for (const char* prefix : prefixes) {
+    if (command.compare(0, strlen(prefix), prefix) == 0) return true;
+  }
+  return false;
+}
+
+static bool loadRecording(const char* path, std::vector<Timed>& entries, std::vector<Timed>& states) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char buf[512];
+  std::smatch match;
+  while (fgets(buf, sizeof(buf), f)) {
+    std::string line = clean(buf);
+    if (!std::regex_search(line, match, record)) continue;
+    char kind = match[1].str()[0];
+    unsigned long ms = strtoul(match[2].str().c_str(), NULL, 10);
+    std::string value = match[3].str();
+    if (kind == 'E') {
+      states.push_back(Timed(ms, value));
+    } else if (kind == 'P') {
+      entries.push_back(Timed(ms, "P:" + value));
+    } else if (!skipped(value)) {
+      entries.push_back(Timed(ms, value));
+    }
+  }
+  fclose(f);
+
+  // Offsets from the first entry, as tools/replay_session.py
+  unsigned long t0 = entries.empty() ? 0 : entries[0].first;
+  for (Timed& e : entries) e.first -= t0;
+  std::vector<Timed> kept;
+  for (const Timed& s : states) {
+    if (s.first >= t0) kept.push_back(Timed(s.first - t0, s.second));
+  }
+  states.swap(kept);
+  return true;
+}
+
+static void onLine(unsigned long ms, const char* text) {
+  if (outFile) fprintf(outFile, "[%8lu] %s\n", ms, text);
+
+  std::string line = clean(text);
+  std::smatch match;
+  if (replayStart && std::regex_match(line, match, record) && match[1] == "E") {
+    unsigned long at = strtoul(match[2].str().c_str(), NULL, 10);
+    replayed.push_back(Timed(at - replayStart, match[3].str()));
+  }
+}
+
+static bool compare(const std::vector<Timed>& recorded, unsigned long tolerance) {
+  bool ok = recorded.size() == replayed.size();
+  long worst = 0;
+  printf(" #  %-24s%-24sdelta ms\n", "recorded", "replayed");
+  for (size_t i = 0; i < std::max(recorded.size(), replayed.size()); i++) {
+    const Timed* a = i < recorded.size() ? &recorded[i] : NULL;
+    const Timed* b = i < replayed.size() ? &replayed[i] : NULL;
+    std::string note = "SEQUENCE";
+    if (a && b && a->second == b->second) {
+      long delta = (long)b->first - (long)a->first;
+      worst = std::max(worst, labs(delta));
+      note = std::to_string(delta);
+      if ((unsigned long)labs(delta) > tolerance) {
+        note += " TIMING";
+        ok = false;
+      }
+    } else {
+      ok = false;
+    }
+    std::string left = a ? a->second + "@" + std::to_string(a->first) : "-";
+    std::string right = b ? b->second + "@" + std::to_string(b->first) : "-";
+    printf("%2zu  %-24s%-24s%s\n", i, left.c_str(), right.c_str(), note.c_str());
+  }
+  printf("transitions: %zu recorded, %zu replayed\n", recorded.size(), replayed.size());
+  printf("max timing difference: %ld ms (tolerance %lu ms)\n", worst, tolerance);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned long tolerance = 100;
+  unsigned long tail = 5000;
+  const char* outPath = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:l:e:o:")) != -1) {
+    switch (opt) {
+      case 't': tolerance = strtoul(optarg, NULL, 10); break;
+      case 'l': Native::loopMicros = strtoul(optarg, NULL, 10); break;
+      case 'e': tail = strtoul(optarg, NULL, 10); break;
+      case 'o': outPath = optarg; break;
+      default: optind = argc + 1; break;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s session.log [-t tolerance_ms] [-l loop_us] [-e tail_ms] [-o output.log]\n",
+            argv[0]);
+    return 2;
+  }
+
+  std::vector<Timed> entries, recorded;
+  if (!loadRecording(argv[optind], entries, recorded)) return 2;
+  printf("replaying %zu entries, %zu recorded transitions\n", entries.size(), recorded.size());
+
+  if (outPath && !(outFile = fopen(outPath, "w"))) {
+    perror(outPath);
+    return 2;
+  }
+  Native::onLine = onLine;
+  Native::boot();
+
+  // Let the boot output drain, then record the replay from a fixed start
+  Native::runUntil(1000);
+  Native::send("REC:ON");
+  Native::runUntil(1500);
+  replayStart = millis();
+
+  for (const Timed& e : entries) {
+    unsigned long due = replayStart + e.first;
+    if (e.second.compare(0, 2, "P:") == 0) {
+      Native::runUntil(due);
+      if (globalMode == MODE_SIMULATION) {
+        loadCell.simulateReading(atof(e.second.c_str() + 2));
+      }
+    } else {
+      // Typed so the line is complete at its recorded time
+      unsigned long typing = Native::sendMicros(e.second.c_str()) / 1000;
+      Native::runUntil(due > typing ? due - typing : 0);
+      Native::send(e.second.c_str());
+    }
+  }
+  Native::runUntil(millis() + tail);
+  if (outFile) fclose(outFile);
+
+  const Native::Stats& stats = Native::stats;
+  printf("loop passes: %lu, longest %lu us; RX bytes lost: %lu; watchdog resets: %lu\n", stats.loops,
+         stats.maxLoopMicros, stats.rxDropped, stats.watchdogResets);
+  bool ok = compare(recorded, tolerance);
+  return ok && stats.watchdogResets == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""Replay a recorded controller session and compare the state timeline.
+
+Record with REC:ON and keep the serial output (for example
+`pio device monitor | tee session.log`). Then, with the controller in
+simulation mode (MODE:SIM) so recorded weights replace the scale, run:
+
+    python tools/replay_session.py /dev/ttyACM0 session.log [--tolerance 100]
+
+Commands (REC:C) and weight samples (REC:P) are streamed to the controller
+as PLAY:<offset>,<entry>, never more than its replay queue holds, and run
+there at their recorded offsets. The state changes of the replay (REC:E)
+are diffed against the recorded ones, transition by transition.
+
+Exit code 0 when the state sequence matches and every transition lands
+within the tolerance, 1 otherwise. The controller runs on its own clock, so
+timings are compared within the tolerance, not bit for bit.
+Needs pyserial (installed with PlatformIO).
+"""
+
+import argparse
+import re
+import sys
+import time
+
+# "@<id>:" address prefix and "|<seq>,<ms>" event suffix added by the host link
+ADDRESS = re.compile(r"^@[0-9*]+:")
+EVENT_META = re.compile(r"\|\d+,\d+$")
+RECORD = re.compile(r"REC:([CEP]):(\d+),(.*)$")
+
+REPLAY_CMD_LEN = 40  # Session::ReplayEntry command size on the controller
+SKIPPED = ("SYNC", "HELLO")  # Link housekeeping, not part of the session
+
+
+def clean(line):
+    line = line.strip()
+    line = ADDRESS.sub("", line)
+    return EVENT_META.sub("", line).strip()
+
+
+def load_recording(lines):
+    """Entries to replay and recorded states, as offsets from the first entry."""
+    entries = []
+    states = []
+    for line in lines:
+        match = RECORD.search(clean(line))
+        if not match:
+            continue
+        kind, ms, value = match.group(1), int(match.group(2)), match.group(3)
+        if kind == "E":
+            states.append((ms, value))
+        elif kind == "P":
+            entries.append((ms, "P:" + value))
+        elif not value.startswith(SKIPPED):
+            entries.append((ms, value))
+
+    t0 = entries[0][0] if entries else 0
+    return ([(ms - t0, text) for ms, text in entries],
+            [(ms - t0, state) for ms, state in states if ms >= t0])
+
+
+def compare(recorded, replayed, tolerance, out):
+    ok = len(recorded) == len(replayed)
+    worst = 0
+    out.write(" #  %-24s%-24sdelta ms\n" % ("recorded", "replayed"))
+    for i in range(max(len(recorded), len(replayed))):
+        a = recorded[i] if i < len(recorded) else None
+        b = replayed[i] if i < len(replayed) else None
+        note = "SEQUENCE"
+        if a and b and a[1] == b[1]:
+            delta = b[0] - a[0]
+            worst = max(worst, abs(delta))
+            note = str(delta)
+            if abs(delta) > tolerance:
+                note += " TIMING"
+                ok = False
+        else:
+            ok = False
+        out.write("%2d  %-24s%-24s%s\n" % (
+            i,
+            "%s@%d" % (a[1], a[0]) if a else "-",
+            "%s@%d" % (b[1], b[0]) if b else "-",
+            note))
+
+    out.write("transitions: %d recorded, %d replayed\n" % (len(recorded), len(replayed)))
+    out.write("max timing difference: %d ms (tolerance %d ms)\n" % (worst, tolerance))
+    return ok
+
+
+class Replay:
+    """Streams entries through the controller's PLAY queue and collects REC:E."""
+
+    def __init__(self, port, entries):
+        self.port = port
+        self.pending = [e for e in entries if len(e[1]) < REPLAY_CMD_LEN]
+        for _, text in entries:
+            if len(text) >= REPLAY_CMD_LEN:
+                sys.stderr.write("skipping entry too long to replay: %s\n" % text)
+        self.total = len(self.pending)
+        self.last_offset = self.pending[-1][0] if self.pending else 0
+        self.executed = 0
+        self.free = 1  # Learned from the first PLAY:QUEUED
+        self.in_flight = None
+        self.start_ms = None
+        self.worst_lag = 0
+        self.states = []
+
+    def send(self, line):
+        self.port.write((line + "\n").encode())
+
+    def pump(self):
+        # One PLAY line in flight at a time, PLAY:QUEUED reports the free slots
+        if self.in_flight is None and self.free > 0 and self.pending:
+            self.in_flight = self.pending.pop(0)
+            self.send("PLAY:%d,%s" % self.in_flight)
+
+    def handle(self, line):
+        if line.startswith("PLAY:QUEUED:"):
+            self.free = int(line[len("PLAY:QUEUED:"):])
+            self.in_flight = None
+        elif line == "PLAY:FULL":
+            self.pending.insert(0, self.in_flight)  # Sent again once an entry executes
+            self.free = 0
+            self.in_flight = None
+        elif line.startswith("ERROR:PLAY"):
+            sys.stderr.write("%s: %s\n" % (line, self.in_flight[1]))
+            self.total -= 1
+            self.in_flight = None
+        elif line.startswith("PLAY:STARTED:"):
+            self.start_ms = int(line.split(",")[1])
+        elif line.startswith("PLAY:EXEC:"):
+            offset, actual = line[len("PLAY:EXEC:"):].split(",")[:2]
+            self.worst_lag = max(self.worst_lag, int(actual) - int(offset))
+            self.executed += 1
+            self.free += 1
+        else:
+            match = RECORD.match(line)
+            if match and match.group(1) == "E" and self.start_ms is not None:
+                self.states.append((int(match.group(2)) - self.start_ms, match.group(3)))
+        self.pump()
+
+    def poll(self):
+        raw = self.port.readline()
+        if raw:
+            self.handle(clean(raw.decode(errors="replace")))
+
+    def run(self, tail):
+        self.send("PLAY:STOP")
+        self.send("REC:ON")
+        self.pump()
+
+        # Prime the queue before the replay clock starts
+        while self.pending and (self.in_flight is not None or self.free > 0):
+            self.poll()
+        while self.in_flight is not None:
+            self.poll()
+        self.send("PLAY:START")
+
+        # Entries run at their offsets; give up if the controller stops answering
+        deadline = time.monotonic() + self.last_offset / 1000.0 + 10
+        while self.executed < self.total and time.monotonic() < deadline:
+            self.poll()
+        if self.executed < self.total:
+            sys.stderr.write("only %d of %d entries executed\n" % (self.executed, self.total))
+
+        # Let the last commands play out
+        end = time.monotonic() + tail / 1000.0
+        while time.monotonic() < end:
+            self.poll()
+        self.send("REC:OFF")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay a REC:ON session log on the controller")
+    parser.add_argument("port")
+    parser.add_argument("recording")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--tolerance", type=int, default=100, help="ms per transition")
+    parser.add_argument("--tail", type=int, default=5000, help="ms to keep listening after the last entry")
+    args = parser.parse_args()
+
+    with open(args.recording, encoding="utf-8", errors="replace") as f:
+        entries, recorded = load_recording(f)
+    print("replaying %d entries, %d recorded transitions" % (len(entries), len(recorded)))
+
+    import serial  # pyserial, only needed to talk to the controller
+
+    port = serial.Serial()
+    port.port = args.port
+    port.baudrate = args.baud
+    port.timeout = 0.1
+    port.open()
+
+    # Opening the port may have reset the board: wait out the bootloader
+    time.sleep(2)
+    port.reset_input_buffer()
+
+    replay = Replay(port, entries)
+    replay.run(args.tail)
+    port.close()
+
+    print("worst execution lag: %d ms" % replay.worst_lag)
+    return 0 if compare(recorded, replay.states, args.tolerance, sys.stdout) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
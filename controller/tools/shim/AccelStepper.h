@@ -0,0 +1,57 @@
+#ifndef SHIM_ACCEL_STEPPER_H
+#define SHIM_ACCEL_STEPPER_H
+
+#include "Arduino.h"
+
+// AccelStepper 1.64's speed and acceleration algorithm on the simulated
+// clock. step() drives no pins unless a subclass overrides it.
+class AccelStepper {
+public:
+  enum MotorInterfaceType { FUNCTION = 0, DRIVER = 1, FULL2WIRE = 2, FULL4WIRE = 4 };
+  enum Direction { DIRECTION_CCW = 0, DIRECTION_CW = 1 };
+
+  AccelStepper(uint8_t interface = FULL4WIRE, uint8_t pin1 = 2, uint8_t pin2 = 3, uint8_t pin3 = 4,
+               uint8_t pin4 = 5, bool enable = true);
+  virtual ~AccelStepper() {}
+
+  void moveTo(long absolute);
+  void move(long relative) { moveTo(_currentPos + relative); }
+  bool run();
+  bool runSpeed();
+  void setMaxSpeed(float speed);
+  float maxSpeed() { return _maxSpeed; }
+  void setAcceleration(float acceleration);
+  void setSpeed(float speed);
+  float speed() { return _speed; }
+  long distanceToGo() { return _targetPos - _currentPos; }
+  long targetPosition() { return _targetPos; }
+  long currentPosition() { return _currentPos; }
+  void setCurrentPosition(long position);
+  void stop();
+  bool isRunning() { return !(_speed == 0.0 && _targetPos == _currentPos); }
+  void setMinPulseWidth(unsigned int) {}
+  void setEnablePin(uint8_t) {}
+  void setPinsInverted(bool, bool, bool) {}
+  void disableOutputs() {}
+  void enableOutputs() {}
+
+protected:
+  bool _direction;
+  virtual void step(long step) {}
+  void computeNewSpeed();
+
+private:
+  long _currentPos;
+  long _targetPos;
+  float _speed;
+  float _maxSpeed;
+  float _acceleration;
+  unsigned long _stepInterval;
+  unsigned long _lastStepTime;
+  long _n;
+  float _c0;
+  float _cn;
+  float _cmin;
+};
+
+#endif
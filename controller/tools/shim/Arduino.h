@@ -0,0 +1,277 @@
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+// Host model of the Arduino core, enough to build the firmware in src/
+// natively (tools/native, tools/bus_sim).
+//
+// Time is simulated: the tool defines millis()/micros() and simStep(),
+// which advances its world by one tick (UART bytes, timer ISR, ...).
+// Everything that waits on the hardware - delay(), a full UART TX buffer,
+// an HX711 conversion - calls simStep() until the wait is over, so
+// blocking code costs simulated time just as it does on the board.
+//
+// Differences from the AVR build: int is 32 bits and unsigned long 64
+// bits, so overflow and struct layout are not the target's.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <type_traits>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+
+#define F_CPU 16000000UL
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+#define SERIAL_8N1 0x06
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+// Functions rather than the core's macros, so standard headers still build;
+// abs() comes from the C++ <stdlib.h>/<math.h> overloads
+template <class A, class B> inline typename std::common_type<A, B>::type min(A a, B b) {
+  return b < a ? b : a;
+}
+template <class A, class B> inline typename std::common_type<A, B>::type max(A a, B b) {
+  return a < b ? b : a;
+}
+template <class T, class L, class H> inline T constrain(T x, L low, H high) {
+  return x < low ? (T)low : (x > high ? (T)high : x);
+}
+inline bool isDigit(int c) { return isdigit(c) != 0; }
+
+// ---- Provided by the tool --------------------------------------------
+
+unsigned long millis();
+unsigned long micros();
+void simStep();  // Advance the simulated world by one tick
+
+// ---- Time, pins, interrupts --------------------------------------------
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+#define SIM_PINS 70
+
+// Pin levels and modes; tools with several boards switch simPins per board
+struct SimPins {
+  uint8_t mode[SIM_PINS];
+  uint8_t level[SIM_PINS];
+  int pwm[SIM_PINS];
+  SimPins();
+};
+extern SimPins* simPins;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+int analogRead(uint8_t pin);
+
+// Interrupts held off by noInterrupts() run at the next interrupts()
+extern bool simInterruptsEnabled;
+void noInterrupts();
+void interrupts();
+#define cli() noInterrupts()
+#define sei() interrupts()
+
+#define ISR(vector) extern "C" void vector(void)
+#define _BV(b) (1u << (b))
+
+// Registers the firmware touches outside PROFILING builds; plain memory
+extern volatile uint8_t SREG, MCUSR, TIMSK0, OCR0A, TCCR1B, TCCR2B;
+#define OCIE0A 1
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+// ---- String --------------------------------------------------------------
+
+class String {
+public:
+  String(const char* s = "");
+  String(const String& s);
+  String(const __FlashStringHelper* s);
+  explicit String(char c);
+  explicit String(unsigned char n, unsigned char base = 10);
+  explicit String(int n, unsigned char base = 10);
+  explicit String(unsigned int n, unsigned char base = 10);
+  explicit String(long n, unsigned char base = 10);
+  explicit String(unsigned long n, unsigned char base = 10);
+  explicit String(float n, unsigned char decimals = 2);
+  explicit String(double n, unsigned char decimals = 2);
+  ~String();
+  String& operator=(const String& s);
+  String& operator=(const char* s);
+
+  unsigned int length() const { return len; }
+  const char* c_str() const { return buffer; }
+  void reserve(unsigned int size);
+
+  String& operator+=(const String& s) { return append(s.buffer, s.len); }
+  String& operator+=(const char* s) { return append(s, strlen(s)); }
+  String& operator+=(const __FlashStringHelper* s) { return *this += (const char*)s; }
+  String& operator+=(char c) { return append(&c, 1); }
+  String& operator+=(unsigned char n) { return *this += String(n); }
+  String& operator+=(int n) { return *this += String(n); }
+  String& operator+=(unsigned int n) { return *this += String(n); }
+  String& operator+=(long n) { return *this += String(n); }
+  String& operator+=(unsigned long n) { return *this += String(n); }
+  String& operator+=(float n) { return *this += String(n); }
+  String& operator+=(double n) { return *this += String(n); }
+  template <class T> bool concat(const T& value) { *this += value; return true; }
+
+  bool equals(const String& s) const { return len == s.len && strcmp(buffer, s.buffer) == 0; }
+  bool equals(const char* s) const { return strcmp(buffer, s) == 0; }
+  bool equalsIgnoreCase(const String& s) const;
+  bool operator==(const String& s) const { return equals(s); }
+  bool operator==(const char* s) const { return equals(s); }
+  bool operator!=(const String& s) const { return !equals(s); }
+  bool operator!=(const char* s) const { return !equals(s); }
+  bool startsWith(const String& prefix) const { return startsWith(prefix, 0); }
+  bool startsWith(const String& prefix, unsigned int offset) const;
+  bool endsWith(const String& suffix) const;
+
+  char charAt(unsigned int index) const { return index < len ? buffer[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  void setCharAt(unsigned int index, char c) { if (index < len) buffer[index] = c; }
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String& s, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  int lastIndexOf(const String& s) const;
+  String substring(unsigned int from) const { return substring(from, len); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(const String& find, const String& with);
+  void remove(unsigned int index) { remove(index, (unsigned int)-1); }
+  void remove(unsigned int index, unsigned int count);
+  void toUpperCase();
+  void toLowerCase();
+  void trim();
+  long toInt() const { return atol(buffer); }
+  float toFloat() const { return (float)atof(buffer); }
+
+private:
+  char* buffer;
+  unsigned int len;
+  unsigned int capacity;
+
+  String& append(const char* s, unsigned int n);
+  void assign(const char* s, unsigned int n);
+};
+
+template <class T> inline String operator+(const String& a, const T& b) {
+  String result(a);
+  result += b;
+  return result;
+}
+inline String operator+(const char* a, const String& b) {
+  String result(a);
+  result += b;
+  return result;
+}
+
+// ---- Print / Stream --------------------------------------------------
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+  size_t write(const char* s, size_t size) { return write((const uint8_t*)s, size); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+  size_t print(const String& s) { return write(s.c_str(), s.length()); }
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+  template <class T> size_t println(const T& value, int format) {
+    size_t n = print(value, format);
+    return n + println();
+  }
+
+private:
+  size_t printNumber(unsigned long n, uint8_t base);
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long) {}
+};
+
+// Simulated UART: bytes written wait in a 64-byte buffer (63 usable, as
+// in the AVR core; write() blocks while it is full) until the tool's
+// simStep() shifts them out. Received bytes land in a 64-byte ring; the
+// tool drops what does not fit, like the core's RX interrupt.
+class HardwareSerial : public Stream {
+public:
+  HardwareSerial();
+  void begin(unsigned long baud) { this->baud = baud; }
+  void begin(unsigned long baud, uint8_t) { begin(baud); }
+  void end() {}
+  operator bool() { return true; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  int availableForWrite() override;
+  void flush() override;
+  using Print::write;
+
+  // Driven by the tool
+  bool receive(uint8_t c);  // False when the ring is full and c was lost
+  unsigned long baud;
+  uint8_t txBuf[SERIAL_TX_BUFFER_SIZE];
+  uint8_t txHead;
+  uint8_t txCount;
+  bool shifting;           // A byte is in the shift register
+  unsigned long shiftEnd;  // Simulated us when it is out
+  uint8_t rxBuf[SERIAL_RX_BUFFER_SIZE];
+  uint8_t rxHead;
+  uint8_t rxCount;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif
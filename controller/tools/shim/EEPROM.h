@@ -0,0 +1,28 @@
+#ifndef SHIM_EEPROM_H
+#define SHIM_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// 4 KB, erased (0xFF) at start. Tools with several boards share it: only
+// the device ID is stored there, and each board sets its own before it runs.
+struct EEPROMClass {
+  uint8_t cells[4096];
+  EEPROMClass() { memset(cells, 0xFF, sizeof(cells)); }
+  uint8_t read(int address) { return cells[address]; }
+  void write(int address, uint8_t value) { cells[address] = value; }
+  void update(int address, uint8_t value) { cells[address] = value; }
+  uint16_t length() { return sizeof(cells); }
+  template <class T> T& get(int address, T& value) {
+    memcpy(&value, cells + address, sizeof(T));
+    return value;
+  }
+  template <class T> const T& put(int address, const T& value) {
+    memcpy(cells + address, &value, sizeof(T));
+    return value;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef SHIM_HX711_H
+#define SHIM_HX711_H
+
+#include "Arduino.h"
+
+// HX711 with the bogde library's interface. A conversion completes every
+// conversionMicros (the tool sets it from the RATE pin); read() waits for
+// the next one like the real chip, so blocking reads cost simulated time.
+// The raw value comes from source(), or is the constant raw.
+class HX711 {
+public:
+  static bool present;                // DOUT never goes low without a chip
+  static long raw;
+  static long (*source)();            // Overrides raw when set
+  static unsigned long conversionMicros;
+
+  HX711();
+  void begin(uint8_t dout, uint8_t sck, uint8_t gain = 128) { set_gain(gain); }
+  bool is_ready();
+  void wait_ready(unsigned long delayMs = 0);
+  void set_gain(uint8_t gain = 128) { this->gain = gain; }
+  long read();
+  long read_average(uint8_t times = 10);
+  double get_value(uint8_t times = 1) { return read_average(times) - offset; }
+  float get_units(uint8_t times = 1) { return get_value(times) / scale; }
+  void tare(uint8_t times = 10) { set_offset(read_average(times)); }
+  void set_scale(float scale = 1.f) { this->scale = scale; }
+  float get_scale() { return scale; }
+  void set_offset(long offset = 0) { this->offset = offset; }
+  long get_offset() { return offset; }
+  void power_down() {}
+  void power_up() {}
+
+private:
+  uint8_t gain;
+  long offset;
+  float scale;
+  bool converted;
+  unsigned long lastConversion;  // micros() of the last conversion read
+};
+
+#endif
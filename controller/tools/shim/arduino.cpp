@@ -0,0 +1,431 @@
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "avr/wdt.h"
+
+#include <stdio.h>
+
+// =====================================================
+// TIME, PINS, INTERRUPTS
+// =====================================================
+
+void delay(unsigned long ms) {
+  unsigned long start = micros();
+  while (micros() - start < ms * 1000UL) {
+    simStep();
+  }
+}
+
+void delayMicroseconds(unsigned int us) {
+  unsigned long start = micros();
+  while (micros() - start < us) {
+    simStep();
+  }
+}
+
+SimPins::SimPins() {
+  memset(mode, INPUT, sizeof(mode));
+  memset(level, LOW, sizeof(level));
+  memset(pwm, 0, sizeof(pwm));
+}
+
+static SimPins defaultPins;
+SimPins* simPins = &defaultPins;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= SIM_PINS) return;
+  simPins->mode[pin] = mode;
+  if (mode == INPUT_PULLUP) {
+    simPins->level[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= SIM_PINS) return;
+  simPins->level[pin] = value ? HIGH : LOW;
+  simPins->pwm[pin] = value ? 255 : 0;
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < SIM_PINS ? simPins->level[pin] : LOW;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  if (pin >= SIM_PINS) return;
+  simPins->pwm[pin] = value;
+  simPins->level[pin] = value >= 128 ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  return 0;
+}
+
+bool simInterruptsEnabled = true;
+
+void noInterrupts() {
+  simInterruptsEnabled = false;
+}
+
+void interrupts() {
+  simInterruptsEnabled = true;
+}
+
+volatile uint8_t SREG, MCUSR, TIMSK0, OCR0A, TCCR1B, TCCR2B;
+
+// =====================================================
+// EEPROM, WATCHDOG
+// =====================================================
+
+EEPROMClass EEPROM;
+
+SimWatchdog simWatchdog;
+
+void wdt_enable(uint8_t timeout) {
+  static const unsigned long periods[] = { 15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000 };
+  simWatchdog.enabled = true;
+  simWatchdog.timeoutMs = periods[timeout < 10 ? timeout : 9];
+  simWatchdog.lastReset = millis();
+}
+
+void wdt_disable() {
+  simWatchdog.enabled = false;
+}
+
+void wdt_reset() {
+  simWatchdog.lastReset = millis();
+}
+
+bool SimWatchdog::expired() const {
+  return enabled && millis() - lastReset > timeoutMs;
+}
+
+// =====================================================
+// STRING
+// =====================================================
+
+String::String(const char* s) : buffer(NULL), len(0), capacity(0) {
+  assign(s ? s : "", s ? strlen(s) : 0);
+}
+
+String::String(const String& s) : buffer(NULL), len(0), capacity(0) {
+  assign(s.buffer, s.len);
+}
+
+String::String(const __FlashStringHelper* s) : buffer(NULL), len(0), capacity(0) {
+  const char* text = (const char*)s;
+  assign(text, strlen(text));
+}
+
+String::String(char c) : buffer(NULL), len(0), capacity(0) {
+  assign(&c, 1);
+}
+
+static void formatUnsigned(char* out, unsigned long n, unsigned char base) {
+  char digits[66];
+  int i = 0;
+  if (base < 2) base = 10;
+  do {
+    unsigned d = n % base;
+    digits[i++] = d < 10 ? '0' + d : 'a' + d - 10;
+    n /= base;
+  } while (n);
+  while (i) *out++ = digits[--i];
+  *out = '\0';
+}
+
+static void formatSigned(char* out, long n, unsigned char base) {
+  if (n < 0 && base == 10) {
+    *out++ = '-';
+    formatUnsigned(out, -(unsigned long)n, base);
+  } else {
+    formatUnsigned(out, (unsigned long)n, base);
+  }
+}
+
+String::String(unsigned char n, unsigned char base) : buffer(NULL), len(0), capacity(0) {
+  char text[70];
+  formatUnsigned(text, n, base);
+  assign(text, strlen(text));
+}
+
+String::String(int n, unsigned char base) : buffer(NULL), len(0), capacity(0) {
+  char text[70];
+  formatSigned(text, n, base);
+  assign(text, strlen(text));
+}
+
+String::String(unsigned int n, unsigned char base) : buffer(NULL), len(0), capacity(0) {
+  char text[70];
+  formatUnsigned(text, n, base);
+  assign(text, strlen(text));
+}
+
+String::String(long n, unsigned char base) : buffer(NULL), len(0), capacity(0) {
+  char text[70];
+  formatSigned(text, n, base);
+  assign(text, strlen(text));
+}
+
+String::String(unsigned long n, unsigned char base) : buffer(NULL), len(0), capacity(0) {
+  char text[70];
+  formatUnsigned(text, n, base);
+  assign(text, strlen(text));
+}
+
+String::String(float n, unsigned char decimals) : buffer(NULL), len(0), capacity(0) {
+  // dtostrf(n, decimals + 2, decimals) as in the core
+  char text[64];
+  snprintf(text, sizeof(text), "%*.*f", decimals + 2, decimals, (double)n);
+  assign(text, strlen(text));
+}
+
+String::String(double n, unsigned char decimals) : buffer(NULL), len(0), capacity(0) {
+  char text[64];
+  snprintf(text, sizeof(text), "%*.*f", decimals + 2, decimals, n);
+  assign(text, strlen(text));
+}
+
+String::~String() {
+  free(buffer);
+}
+
+String& String::operator=(const String& s) {
+  if (this != &s) assign(s.buffer, s.len);
+  return *this;
+}
+
+String& String::operator=(const char* s) {
+  assign(s, strlen(s));
+  return *this;
+}
+
+void String::reserve(unsigned int size) {
+  if (buffer && capacity >= size) return;
+  char* grown = (char*)realloc(buffer, size + 1);
+  if (!buffer) grown[0] = '\0';
+  buffer = grown;
+  capacity = size;
+}
+
+void String::assign(const char* s, unsigned int n) {
+  // s may point into this string (substring of itself)
+  char* copy = (char*)malloc(n + 1);
+  memcpy(copy, s, n);
+  copy[n] = '\0';
+  free(buffer);
+  buffer = copy;
+  len = capacity = n;
+}
+
+String& String::append(const char* s, unsigned int n) {
+  if (len + n > capacity) {
+    unsigned int offset = s >= buffer && s < buffer + len ? s - buffer : (unsigned int)-1;
+    reserve(len + n);
+    if (offset != (unsigned int)-1) s = buffer + offset;
+  }
+  memmove(buffer + len, s, n);
+  len += n;
+  buffer[len] = '\0';
+  return *this;
+}
+
+bool String::equalsIgnoreCase(const String& s) const {
+  if (len != s.len) return false;
+  for (unsigned int i = 0; i < len; i++) {
+    if (tolower((unsigned char)buffer[i]) != tolower((unsigned char)s.buffer[i])) return false;
+  }
+  return true;
+}
+
+bool String::startsWith(const String& prefix, unsigned int offset) const {
+  if (offset > len || prefix.len > len - offset) return false;
+  return strncmp(buffer + offset, prefix.buffer, prefix.len) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  if (suffix.len > len) return false;
+  return strcmp(buffer + len - suffix.len, suffix.buffer) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  if (from >= len) return -1;
+  const char* p = strchr(buffer + from, c);
+  return p ? p - buffer : -1;
+}
+
+int String::indexOf(const String& s, unsigned int from) const {
+  if (from >= len) return -1;
+  const char* p = strstr(buffer + from, s.buffer);
+  return p ? p - buffer : -1;
+}
+
+int String::lastIndexOf(char c) const {
+  const char* p = strrchr(buffer, c);
+  return p ? p - buffer : -1;
+}
+
+int String::lastIndexOf(const String& s) const {
+  int found = -1;
+  for (int i = indexOf(s); i >= 0; i = indexOf(s, i + 1)) found = i;
+  return found;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    unsigned int t = from;
+    from = to;
+    to = t;
+  }
+  if (from >= len) return String();
+  if (to > len) to = len;
+  String result;
+  result.assign(buffer + from, to - from);
+  return result;
+}
+
+void String::replace(const String& find, const String& with) {
+  if (find.len == 0) return;
+  String result;
+  unsigned int pos = 0;
+  for (int i = indexOf(find); i >= 0; i = indexOf(find, pos)) {
+    result.append(buffer + pos, i - pos);
+    result += with;
+    pos = i + find.len;
+  }
+  result.append(buffer + pos, len - pos);
+  *this = result;
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index >= len) return;
+  if (count > len - index) count = len - index;
+  memmove(buffer + index, buffer + index + count, len - index - count + 1);
+  len -= count;
+}
+
+void String::toUpperCase() {
+  for (unsigned int i = 0; i < len; i++) buffer[i] = toupper((unsigned char)buffer[i]);
+}
+
+void String::toLowerCase() {
+  for (unsigned int i = 0; i < len; i++) buffer[i] = tolower((unsigned char)buffer[i]);
+}
+
+void String::trim() {
+  unsigned int begin = 0;
+  while (begin < len && isspace((unsigned char)buffer[begin])) begin++;
+  unsigned int end = len;
+  while (end > begin && isspace((unsigned char)buffer[end - 1])) end--;
+  memmove(buffer, buffer + begin, end - begin);
+  len = end - begin;
+  buffer[len] = '\0';
+}
+
+// =====================================================
+// PRINT
+// =====================================================
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char text[70];
+  formatUnsigned(text, n, base);
+  return write(text);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == 0) return write((uint8_t)n);
+  if (base == 10 && n < 0) {
+    return print('-') + printNumber(-(unsigned long)n, 10);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  if (base == 0) return write((uint8_t)n);
+  return printNumber(n, base);
+}
+
+size_t Print::print(double number, int digits) {
+  // Print::printFloat() of the core, including its limits
+  if (isnan(number)) return print("nan");
+  if (isinf(number)) return print("inf");
+  if (number > 4294967040.0) return print("ovf");
+  if (number < -4294967040.0) return print("ovf");
+
+  size_t n = 0;
+  if (number < 0.0) {
+    n += print('-');
+    number = -number;
+  }
+  double rounding = 0.5;
+  for (int i = 0; i < digits; i++) rounding /= 10.0;
+  number += rounding;
+
+  unsigned long whole = (unsigned long)number;
+  double remainder = number - (double)whole;
+  n += print(whole);
+  if (digits > 0) n += print('.');
+  while (digits-- > 0) {
+    remainder *= 10.0;
+    unsigned int digit = (unsigned int)remainder;
+    n += print(digit);
+    remainder -= digit;
+  }
+  return n;
+}
+
+// =====================================================
+// SIMULATED UART
+// =====================================================
+
+HardwareSerial::HardwareSerial() {
+  baud = 9600;
+  memset(txBuf, 0, sizeof(txBuf));
+  txHead = txCount = 0;
+  shifting = false;
+  shiftEnd = 0;
+  rxHead = rxCount = 0;
+}
+
+int HardwareSerial::available() { return rxCount; }
+
+int HardwareSerial::peek() { return rxCount ? rxBuf[rxHead] : -1; }
+
+int HardwareSerial::read() {
+  if (rxCount == 0) {
+    return -1;
+  }
+  uint8_t c = rxBuf[rxHead];
+  rxHead = (rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+  rxCount--;
+  return c;
+}
+
+bool HardwareSerial::receive(uint8_t c) {
+  if (rxCount >= SERIAL_RX_BUFFER_SIZE - 1) {
+    return false;
+  }
+  rxBuf[(rxHead + rxCount++) % SERIAL_RX_BUFFER_SIZE] = c;
+  return true;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  // Like the AVR core: block while the buffer is full
+  while (txCount >= SERIAL_TX_BUFFER_SIZE - 1) {
+    simStep();
+  }
+  txBuf[(txHead + txCount++) % SERIAL_TX_BUFFER_SIZE] = c;
+  return 1;
+}
+
+int HardwareSerial::availableForWrite() { return SERIAL_TX_BUFFER_SIZE - 1 - txCount; }
+
+void HardwareSerial::flush() {
+  while (txCount > 0 || shifting) {
+    simStep();
+  }
+}
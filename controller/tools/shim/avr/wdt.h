@@ -0,0 +1,30 @@
+#ifndef SHIM_AVR_WDT_H
+#define SHIM_AVR_WDT_H
+
+#include <stdint.h>
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+// The tool checks expired() as time advances and treats it as a reset
+struct SimWatchdog {
+  bool enabled;
+  unsigned long timeoutMs;
+  unsigned long lastReset;
+  bool expired() const;
+};
+extern SimWatchdog simWatchdog;
+
+void wdt_enable(uint8_t timeout);
+void wdt_disable();
+void wdt_reset();
+
+#endif
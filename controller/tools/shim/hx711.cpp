@@ -0,0 +1,34 @@
+#include "HX711.h"
+
+bool HX711::present = false;
+long HX711::raw = 0;
+long (*HX711::source)() = NULL;
+unsigned long HX711::conversionMicros = 100000;  // 10 SPS
+
+HX711::HX711() : gain(128), offset(0), scale(1.f), converted(false), lastConversion(0) {}
+
+bool HX711::is_ready() {
+  // The first conversion is done by the time the firmware boots
+  return present && (!converted || micros() - lastConversion >= conversionMicros);
+}
+
+void HX711::wait_ready(unsigned long delayMs) {
+  while (!is_ready()) {
+    simStep();
+  }
+}
+
+long HX711::read() {
+  wait_ready();
+  converted = true;
+  lastConversion = micros();
+  return source ? source() : raw;
+}
+
+long HX711::read_average(uint8_t times) {
+  long sum = 0;
+  for (uint8_t i = 0; i < times; i++) {
+    sum += read();
+  }
+  return times ? sum / times : 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * simavr driver for the profiling build (pio run -e profile).
+ *
+ *   ./sim_harness firmware.elf [-s script] [-r raw] [-p sps] [-t tail_ms]
+ *
+ * Runs the firmware on a simulated ATmega2560 at 16 MHz and:
+ *   - prints every line the firmware writes on UART0 with the simulated
+ *     time in ms,
+ *   - types the lines of the script into UART0 at 9600 baud, each at its
+ *     simulated time ("<ms> <command>" per line, '#' starts a comment),
+ *     holding each byte back while the firmware's 64-byte RX ring (Serial,
+ *     found in the ELF symbol table) is full. simavr's XON/XOFF only
+ *     tracks the UART's hardware FIFO, which the RX interrupt empties into
+ *     that ring: on its own it lets the ring overflow during a long loop(),
+ *   - answers the HX711 protocol on DOUT (A0 = PF0) / SCK (A1 = PF1) with a
+ *     constant raw reading (-r, default 0) at 10 or 80 SPS (-p).
+ * Position and index sensors stay low (inactive). The run ends tail_ms
+ * (default 2000) after the last script line.
+ */
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "avr_ioport.h"
+#include "avr_uart.h"
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_time.h"
+
+#define F_CPU 16000000
+#define BYTE_US 1042 /* 10 bits at 9600 baud */
+#define MAX_LINES 256
+
+typedef struct {
+	unsigned long ms;
+	char text[200];
+} script_line_t;
+
+static avr_t *avr;
+
+/* ---- UART ---------------------------------------------------------- */
+
+static script_line_t script[MAX_LINES];
+static int script_count;
+static int script_index;
+static size_t char_index;
+static int rx_blocked;
+static avr_irq_t *uart_in;
+
+/*
+ * HardwareSerial of the Arduino AVR core 1.8: vtable pointer, Print's
+ * write_error, Stream's _timeout and _startMillis, six register pointers
+ * (_udr last), _written, then the RX ring's head and tail indices.
+ */
+#define SERIAL_UDR_OFFSET 22
+#define SERIAL_RX_HEAD_OFFSET 25
+#define SERIAL_RX_TAIL_OFFSET 26
+#define SERIAL_RX_SIZE 64
+#define UDR0_ADDR 0xC6
+#define DATA_SPACE 0x800000 /* avr-gcc links SRAM at this ELF address */
+
+static uint32_t serial_addr; /* 0: not found, pace on XON/XOFF alone */
+static int serial_checked;
+
+static char out_line[512];
+static size_t out_len;
+
+static unsigned long now_ms(void)
+{
+	return (unsigned long)(avr->cycle / (F_CPU / 1000));
+}
+
+static void uart_out_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	if (value == '\r')
+		return;
+	if (value == '\n' || out_len == sizeof(out_line) - 1) {
+		out_line[out_len] = '\0';
+		printf("[%8lu] %s\n", now_ms(), out_line);
+		fflush(stdout);
+		out_len = 0;
+		return;
+	}
+	out_line[out_len++] = (char)value;
+}
+
+static void uart_xon_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	rx_blocked = 0;
+}
+
+static void uart_xoff_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	rx_blocked = 1;
+}
+
+static int find_symbol(const char *path, const char *name, uint32_t *value)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return 0;
+
+	Elf32_Ehdr eh;
+	int found = 0;
+	if (fread(&eh, sizeof(eh), 1, f) != 1 || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_shentsize != sizeof(Elf32_Shdr)) {
+		fclose(f);
+		return 0;
+	}
+	Elf32_Shdr *sections = calloc(eh.e_shnum, sizeof(Elf32_Shdr));
+	fseek(f, eh.e_shoff, SEEK_SET);
+	if (fread(sections, sizeof(Elf32_Shdr), eh.e_shnum, f) != eh.e_shnum)
+		eh.e_shnum = 0;
+
+	for (int i = 0; i < eh.e_shnum && !found; i++) {
+		if (sections[i].sh_type != SHT_SYMTAB || sections[i].sh_link >= eh.e_shnum)
+			continue;
+		Elf32_Shdr *strtab = &sections[sections[i].sh_link];
+		char *names = malloc(strtab->sh_size);
+		Elf32_Sym *symbols = malloc(sections[i].sh_size);
+		fseek(f, strtab->sh_offset, SEEK_SET);
+		int ok = fread(names, 1, strtab->sh_size, f) == strtab->sh_size;
+		fseek(f, sections[i].sh_offset, SEEK_SET);
+		ok = ok && fread(symbols, 1, sections[i].sh_size, f) == sections[i].sh_size;
+		for (size_t j = 0; ok && j < sections[i].sh_size / sizeof(Elf32_Sym); j++) {
+			if (symbols[j].st_name < strtab->sh_size &&
+			    strcmp(names + symbols[j].st_name, name) == 0 &&
+			    ELF32_ST_TYPE(symbols[j].st_info) == STT_OBJECT) {
+				*value = symbols[j].st_value;
+				found = 1;
+				break;
+			}
+		}
+		free(names);
+		free(symbols);
+	}
+	free(sections);
+	fclose(f);
+	return found;
+}
+
+static uint16_t data_word(uint32_t addr)
+{
+	return avr->data[addr] | (avr->data[addr + 1] << 8);
+}
+
+/* Bytes waiting in the firmware's RX ring, -1 if it cannot be read */
+static int rx_ring_used(void)
+{
+	if (!serial_addr)
+		return -1;
+	if (!serial_checked) {
+		/* Constructed by now: its _udr must point at UDR0, or the layout is not the 1.8 core's */
+		serial_checked = 1;
+		if (data_word(serial_addr + SERIAL_UDR_OFFSET) != UDR0_ADDR) {
+			fprintf(stderr, "Serial does not match the Arduino core layout, pacing on XON/XOFF only\n");
+			serial_addr = 0;
+			return -1;
+		}
+	}
+	uint8_t head = avr->data[serial_addr + SERIAL_RX_HEAD_OFFSET];
+	uint8_t tail = avr->data[serial_addr + SERIAL_RX_TAIL_OFFSET];
+	return (uint8_t)(head - tail) % SERIAL_RX_SIZE;
+}
+
+static avr_cycle_count_t type_next(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	if (script_index >= script_count)
+		return 0;
+
+	script_line_t *line = &script[script_index];
+	if (now_ms() < line->ms)
+		return when + avr_usec_to_cycles(avr, (line->ms - now_ms()) * 1000);
+	/* The ring holds SIZE - 1; keep one more free for a byte still in the FIFO */
+	if (rx_blocked || rx_ring_used() >= SERIAL_RX_SIZE - 2)
+		return when + avr_usec_to_cycles(avr, BYTE_US);
+
+	if (char_index == 0)
+		printf("[%8lu] > %s\n", now_ms(), line->text);
+
+	char c = line->text[char_index];
+	if (c == '\0') {
+		avr_raise_irq(uart_in, '\n');
+		script_index++;
+		char_index = 0;
+	} else {
+		avr_raise_irq(uart_in, (uint8_t)c);
+		char_index++;
+	}
+	return when + avr_usec_to_cycles(avr, BYTE_US);
+}
+
+static void load_script(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	char buf[256];
+	while (fgets(buf, sizeof(buf), f) && script_count < MAX_LINES) {
+		char *text;
+		unsigned long ms = strtoul(buf, &text, 10);
+		if (buf[0] == '#' || text == buf)
+			continue;
+		while (*text == ' ' || *text == '\t')
+			text++;
+		text[strcspn(text, "\r\n")] = '\0';
+		if (*text == '\0')
+			continue;
+		script[script_count].ms = ms;
+		snprintf(script[script_count].text, sizeof(script[0].text), "%s", text);
+		script_count++;
+	}
+	fclose(f);
+}
+
+/* ---- HX711 --------------------------------------------------------- */
+
+static avr_irq_t *hx_dout;
+static uint32_t hx_raw;
+static int hx_pulses;
+static int hx_sck;
+static unsigned long hx_period_us = 100000;
+
+static avr_cycle_count_t hx_ready(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+	hx_pulses = 0;
+	avr_raise_irq(hx_dout, 0); /* DOUT low: conversion ready */
+	return 0;
+}
+
+static void hx_sck_hook(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	int rising = value && !hx_sck;
+	hx_sck = value != 0;
+	if (!rising)
+		return;
+
+	/* 24 data bits MSB first, then 1-3 pulses select the next gain */
+	hx_pulses++;
+	if (hx_pulses <= 24) {
+		avr_raise_irq(hx_dout, (hx_raw >> (24 - hx_pulses)) & 1);
+	} else if (hx_pulses == 25) {
+		avr_raise_irq(hx_dout, 1);
+		avr_cycle_timer_register_usec(avr, hx_period_us, hx_ready, NULL);
+	}
+}
+
+/* ---- Main ---------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+	unsigned long tail_ms = 2000;
+	const char *script_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:r:p:t:")) != -1) {
+		switch (opt) {
+		case 's':
+			script_path = optarg;
+			break;
+		case 'r':
+			hx_raw = (uint32_t)strtol(optarg, NULL, 0) & 0xFFFFFF;
+			break;
+		case 'p':
+			hx_period_us = atoi(optarg) == 80 ? 12500 : 100000;
+			break;
+		case 't':
+			tail_ms = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s firmware.elf [-s script] [-r raw] [-p 10|80] [-t tail_ms]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s firmware.elf [-s script] [-r raw] [-p 10|80] [-t tail_ms]\n", argv[0]);
+		return 1;
+	}
+
+	elf_firmware_t firmware;
+	memset(&firmware, 0, sizeof(firmware));
+	if (elf_read_firmware(argv[optind], &firmware) != 0) {
+		fprintf(stderr, "cannot read %s\n", argv[optind]);
+		return 1;
+	}
+
+	avr = avr_make_mcu_by_name("atmega2560");
+	if (!avr) {
+		fprintf(stderr, "simavr has no atmega2560 core\n");
+		return 1;
+	}
+	avr_init(avr);
+	avr->frequency = F_CPU;
+	avr_load_firmware(avr, &firmware);
+
+	uint32_t serial_value;
+	if (find_symbol(argv[optind], "Serial", &serial_value) && serial_value >= DATA_SPACE)
+		serial_addr = serial_value - DATA_SPACE;
+	else
+		fprintf(stderr, "no Serial symbol in %s, pacing on XON/XOFF only\n", argv[optind]);
+
+	/* UART0: our own line printer instead of simavr's stdio dump */
+	uint32_t flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+				uart_out_hook, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON),
+				uart_xon_hook, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF),
+				uart_xoff_hook, NULL);
+	uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+
+	/* HX711 on PF0 (DOUT, input) and PF1 (SCK, output) */
+	hx_dout = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('F'), 0);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('F'), 1), hx_sck_hook, NULL);
+	avr_cycle_timer_register_usec(avr, hx_period_us, hx_ready, NULL);
+
+	if (script_path) {
+		load_script(script_path);
+		avr_cycle_timer_register_usec(avr, 1000, type_next, NULL);
+	}
+	unsigned long end_ms = (script_count ? script[script_count - 1].ms : 0) + tail_ms;
+
+	int state = cpu_Running;
+	while (state != cpu_Done && state != cpu_Crashed && now_ms() < end_ms)
+		state = avr_run(avr);
+
+	if (state == cpu_Crashed) {
+		fprintf(stderr, "firmware crashed at %lu ms\n", now_ms());
+		return 1;
+	}
+	return 0;
+}
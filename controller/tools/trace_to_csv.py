@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Convert a TRACE:DUMP from the controller into CSV.
+
+Capture the serial output to a file (for example
+`pio device monitor | tee trace.log`), send TRACE:DUMP, then run:
+
+    python tools/trace_to_csv.py trace.log > trace.csv
+
+Reads stdin when no file is given. Columns: sample, ms, raw, grams
+(grams use the OFFSET/ESCALA reported in the dump header). Every dump in
+the log is written; each one starts with a comment line with its header.
+"""
+
+import re
+import sys
+
+# "@<id>:" address prefix and "|<seq>,<ms>" event suffix added by the host link
+ADDRESS = re.compile(r"^@[0-9*]+:")
+EVENT_META = re.compile(r"\|\d+,\d+$")
+
+SAMPLE_BYTES = 5
+
+
+def clean(line):
+    line = line.strip()
+    line = ADDRESS.sub("", line)
+    return EVENT_META.sub("", line).strip()
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def parse_header(line):
+    fields = {}
+    for part in line[len("TRACE:INICIO,"):].split(","):
+        key, _, value = part.partition(":")
+        fields[key] = value
+    return fields
+
+
+def decode(packed, first):
+    rows = []
+    for i in range(0, len(packed) - SAMPLE_BYTES + 1, SAMPLE_BYTES):
+        ms = packed[i] | packed[i + 1] << 8
+        raw = packed[i + 2] | packed[i + 3] << 8 | packed[i + 4] << 16
+        if raw & 0x800000:
+            raw -= 1 << 24
+        rows.append((first + i // SAMPLE_BYTES, ms, raw))
+    return rows
+
+
+def convert(lines, out):
+    header = None
+    packed = bytearray()
+    dumps = 0
+
+    for line in lines:
+        line = clean(line)
+        if line.startswith("TRACE:INICIO,"):
+            header = parse_header(line)
+            packed = bytearray()
+        elif line.startswith("TRACE:D:") and header is not None:
+            _, _, first, data = line.split(":", 3)
+            if int(first) * SAMPLE_BYTES != len(packed):
+                sys.stderr.write("missing trace line before sample %s\n" % first)
+                header = None
+                continue
+            packed += bytes.fromhex(data)
+        elif line.startswith("TRACE:FIN,") and header is not None:
+            expected = int(line.split("CRC:")[1])
+            if crc8(packed) != expected:
+                sys.stderr.write("CRC mismatch, dump skipped\n")
+                header = None
+                continue
+
+            offset = int(header.get("OFFSET", "0"))
+            scale = float(header.get("ESCALA", "1")) or 1.0
+            out.write("# %s\n" % ",".join("%s=%s" % kv for kv in header.items()))
+            out.write("sample,ms,raw,grams\n")
+            for sample, ms, raw in decode(packed, 0):
+                out.write("%d,%d,%d,%.4f\n" % (sample, ms, raw, (raw - offset) / scale))
+            dumps += 1
+            header = None
+
+    return dumps
+
+
+def main():
+    if len(sys.argv) > 1:
+        with open(sys.argv[1], encoding="utf-8", errors="replace") as f:
+            dumps = convert(f, sys.stdout)
+    else:
+        dumps = convert(sys.stdin, sys.stdout)
+
+    if dumps == 0:
+        sys.stderr.write("no complete TRACE dump found\n")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())